@@ -7,7 +7,22 @@
 			"target_name": "addon",
 			"sources": [
 				"./native/lib.cc",
-				"./native/util.cc"
+				"./native/util.cc",
+				"./native/region.cc",
+				"./native/overlay.cc",
+				"./native/framediff.cc",
+				"./native/imagescale.cc",
+				"./native/components.cc",
+				"./native/iconindex.cc",
+				"./native/assetpack.cc",
+				"./native/resultcache.cc",
+				"./native/ncc.cc",
+				"./native/chatlines.cc",
+				"./native/textmetrics.cc",
+				"./native/windowqueries.cc",
+				"./native/pixelwatch.cc",
+				"./native/capturequota.cc",
+				"./native/scratch.cc"
 			],
 			"include_dirs": [
 				"<!@(node -p \"require('node-addon-api').include\")"
@@ -55,7 +70,14 @@
 					"sources": [
 						"./native/os_x11_linux.cc",
 						"./native/linux/x11.cc",
-						"./native/linux/shm.cc"
+						"./native/linux/shm.cc",
+						"./native/linux/overlay.cc",
+						"./native/linux/procstats.cc",
+						"./native/linux/randr.cc",
+						"./native/linux/cursor.cc",
+						"./native/linux/damage.cc",
+						"./native/linux/xinput.cc",
+						"./native/linux/glcapture.cc"
 					],
 					'cflags': [
 						'<!@(<(pkg-config) --cflags xcb)',
@@ -64,7 +86,13 @@
 						'<!@(<(pkg-config) --cflags xcb-composite)',
 						'<!@(<(pkg-config) --cflags xcb-record)',
 						'<!@(<(pkg-config) --cflags xcb-shape)',
-						'<!@(<(pkg-config) --cflags libprocps)'
+						'<!@(<(pkg-config) --cflags xcb-randr)',
+						'<!@(<(pkg-config) --cflags xcb-xfixes)',
+						'<!@(<(pkg-config) --cflags xcb-damage)',
+						'<!@(<(pkg-config) --cflags xcb-xinput)',
+						'<!@(<(pkg-config) --cflags libprocps)',
+						'<!@(<(pkg-config) --cflags freetype2)',
+						'<!@(<(pkg-config) --cflags fontconfig)'
 					],
 					'ldflags': [
 						'<!@(<(pkg-config) --libs-only-L --libs-only-other xcb)',
@@ -73,7 +101,13 @@
 						'<!@(<(pkg-config) --libs-only-L --libs-only-other xcb-composite)',
 						'<!@(<(pkg-config) --libs-only-L --libs-only-other xcb-record)',
 						'<!@(<(pkg-config) --libs-only-L --libs-only-other xcb-shape)',
-						'<!@(<(pkg-config) --libs-only-L --libs-only-other libprocps)'
+						'<!@(<(pkg-config) --libs-only-L --libs-only-other xcb-randr)',
+						'<!@(<(pkg-config) --libs-only-L --libs-only-other xcb-xfixes)',
+						'<!@(<(pkg-config) --libs-only-L --libs-only-other xcb-damage)',
+						'<!@(<(pkg-config) --libs-only-L --libs-only-other xcb-xinput)',
+						'<!@(<(pkg-config) --libs-only-L --libs-only-other libprocps)',
+						'<!@(<(pkg-config) --libs-only-L --libs-only-other freetype2)',
+						'<!@(<(pkg-config) --libs-only-L --libs-only-other fontconfig)'
 					],
 					'libraries': [
 						'<!@(<(pkg-config) --libs-only-l xcb)',
@@ -82,7 +116,14 @@
 						'<!@(<(pkg-config) --libs-only-l xcb-composite)',
 						'<!@(<(pkg-config) --libs-only-l xcb-record)',
 						'<!@(<(pkg-config) --libs-only-l xcb-shape)',
-						'<!@(<(pkg-config) --libs-only-l libprocps)'
+						'<!@(<(pkg-config) --libs-only-l xcb-randr)',
+						'<!@(<(pkg-config) --libs-only-l xcb-xfixes)',
+						'<!@(<(pkg-config) --libs-only-l xcb-damage)',
+						'<!@(<(pkg-config) --libs-only-l xcb-xinput)',
+						'<!@(<(pkg-config) --libs-only-l libprocps)',
+						'<!@(<(pkg-config) --libs-only-l freetype2)',
+						'<!@(<(pkg-config) --libs-only-l fontconfig)',
+						'-lrt'
 					],
 					"cflags_cc": [ "-std=c++17" ],
 				}],
@@ -95,6 +136,23 @@
 					]
 				}],
 			]
+		},
+		{
+			# LD_PRELOAD shim for the rs client that serves the OpenGL capture mode, see native/linux/glframes.h
+			"target_name": "alt1glhook",
+			"type": "none",
+			"conditions": [
+				['OS=="linux"', {
+					"type": "shared_library",
+					"product_prefix": "",
+					"sources": [
+						"./native/linux/glhook/glhook.cc"
+					],
+					"cflags": ["-fPIC", "-fvisibility=hidden"],
+					"cflags_cc": [ "-std=c++17" ],
+					"libraries": ["-lGL", "-ldl", "-lrt"]
+				}]
+			]
 		}
 	]
 }
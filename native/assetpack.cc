@@ -0,0 +1,120 @@
+#include "assetpack.h"
+#ifdef OS_WIN
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+std::shared_ptr<AssetPack> AssetPack::Open(const std::string& path, std::string& error) {
+	std::shared_ptr<AssetPack> pack(new AssetPack());
+#ifdef OS_WIN
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		error = "could not open asset pack";
+		return nullptr;
+	}
+	LARGE_INTEGER filesize;
+	GetFileSizeEx(file, &filesize);
+	HANDLE mapping = (filesize.QuadPart == 0 ? NULL : CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL));
+	CloseHandle(file);
+	if (mapping == NULL) {
+		error = "could not map asset pack";
+		return nullptr;
+	}
+	pack->mapping = mapping;
+	//copy on write, js gets writable views of the pack and writes must not fault
+	pack->base = (const byte*)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+	pack->size = (size_t)filesize.QuadPart;
+	if (!pack->base) {
+		error = "could not map asset pack";
+		return nullptr;
+	}
+#else
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		error = "could not open asset pack";
+		return nullptr;
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0) {
+		close(fd);
+		error = "could not open asset pack";
+		return nullptr;
+	}
+	//private writable mapping, js gets writable views of the pack and writes have to copy the page instead of faulting
+	void* mapped = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	//the mapping stays valid after closing the descriptor
+	close(fd);
+	if (mapped == MAP_FAILED) {
+		error = "could not map asset pack";
+		return nullptr;
+	}
+	//the whole pack is read at startup anyway, read it ahead without breaking the sharing with the page cache
+	madvise(mapped, info.st_size, MADV_WILLNEED);
+	pack->base = (const byte*)mapped;
+	pack->size = info.st_size;
+#endif
+	if (!pack->Validate(error)) {
+		return nullptr;
+	}
+	return pack;
+}
+
+AssetPack::~AssetPack() {
+#ifdef OS_WIN
+	if (base) { UnmapViewOfFile(base); }
+	if (mapping) { CloseHandle((HANDLE)mapping); }
+#else
+	if (base) { munmap((void*)base, size); }
+#endif
+}
+
+//everything is bounds checked once here so the accessors can trust the file
+bool AssetPack::Validate(std::string& error) const {
+	auto inside = [this](uint64_t offset, uint64_t length) {return offset <= size && length <= size - offset; };
+	if (size < sizeof(AssetPackHeader)) {
+		error = "asset pack is truncated";
+		return false;
+	}
+	auto& header = Header();
+	if (header.magic != assetPackMagic || header.version != assetPackVersion) {
+		error = "not an asset pack or unsupported version";
+		return false;
+	}
+	if (header.filesize != size || !inside(sizeof(AssetPackHeader), (uint64_t)header.entrycount * sizeof(AssetPackEntry))) {
+		error = "asset pack is truncated";
+		return false;
+	}
+	for (uint32_t i = 0; i < header.entrycount; i++) {
+		auto& entry = Entry(i);
+		if (!inside(entry.nameoffset, entry.namelength) || !inside(entry.dataoffset, entry.datasize) || entry.dataoffset % 64 != 0) {
+			error = "asset pack entry out of bounds";
+			return false;
+		}
+		if (entry.kind == AssetKind::Image) {
+			if ((uint64_t)entry.image.width * entry.image.height * 4 > entry.datasize) {
+				error = "asset pack image out of bounds";
+				return false;
+			}
+		} else if (entry.kind == AssetKind::Font) {
+			if ((uint64_t)entry.font.charcount * sizeof(AssetPackGlyph) > entry.datasize) {
+				error = "asset pack font out of bounds";
+				return false;
+			}
+			auto glyphs = Glyphs(entry);
+			for (uint32_t j = 0; j < entry.font.charcount; j++) {
+				if (glyphs[j].pixeloffset % 4 != 0 || !inside(glyphs[j].pixeloffset, (uint64_t)glyphs[j].pixelcount * sizeof(float))) {
+					error = "asset pack glyph out of bounds";
+					return false;
+				}
+			}
+		} else {
+			error = "unknown asset pack entry";
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <memory>
+#include "util.h"
+
+/**
+ * Read-only view of a reader asset pack built by src/tools/buildassetpack.ts.
+ * The file is memory mapped and used in place, everything in it is little endian and every data blob starts on a
+ * 64 byte boundary with padding up to the next boundary, so simd loads never have to care about alignment or the tail.
+ *
+ * layout:
+ *   AssetPackHeader
+ *   AssetPackEntry[entrycount]
+ *   names, utf-8 without terminator
+ *   data blobs
+ * image blobs are tight rgba rows, font blobs are AssetPackGlyph[charcount] followed by the float pixel lists of the glyphs
+ */
+
+constexpr uint32_t assetPackMagic = 0x4b503141;//"A1PK"
+constexpr uint32_t assetPackVersion = 1;
+
+enum class AssetKind : uint32_t { Image = 1, Font = 2 };
+
+struct AssetPackHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entrycount;
+	uint32_t filesize;
+	uint32_t reserved[12];
+};
+
+struct AssetPackEntry {
+	AssetKind kind;
+	uint32_t nameoffset;
+	uint32_t namelength;
+	uint32_t dataoffset;
+	uint32_t datasize;
+	union {
+		struct { uint32_t width, height; } image;
+		//mirrors FontDefinition from @alt1/ocr, maxspaces is UINT32_MAX and minrating NaN when the font doesn't set them
+		struct { uint32_t charcount, width, spacewidth, shadow, height, basey, maxspaces; float minrating; } font;
+		uint32_t params[11];
+	};
+};
+
+struct AssetPackGlyph {
+	//utf-16 code unit of the character, only single unit characters are used in fonts
+	uint32_t chr;
+	uint32_t width;
+	float bonus;
+	uint32_t secondary;
+	//offset in the file and number of floats
+	uint32_t pixeloffset;
+	uint32_t pixelcount;
+	uint32_t reserved[2];
+};
+
+static_assert(sizeof(AssetPackHeader) == 64, "asset pack header layout");
+static_assert(sizeof(AssetPackEntry) == 64, "asset pack entry layout");
+static_assert(sizeof(AssetPackGlyph) == 32, "asset pack glyph layout");
+
+class AssetPack {
+	const byte* base = nullptr;
+	size_t size = 0;
+	//platform handle of the mapping
+	void* mapping = nullptr;
+
+	AssetPack() = default;
+	bool Validate(std::string& error) const;
+public:
+	~AssetPack();
+	AssetPack(const AssetPack&) = delete;
+	AssetPack& operator=(const AssetPack&) = delete;
+
+	// Maps and validates the file, returns nullptr and fills in error on failure
+	static std::shared_ptr<AssetPack> Open(const std::string& path, std::string& error);
+
+	uint32_t EntryCount() const { return Header().entrycount; }
+	const AssetPackHeader& Header() const { return *reinterpret_cast<const AssetPackHeader*>(base); }
+	const AssetPackEntry& Entry(uint32_t index) const { return reinterpret_cast<const AssetPackEntry*>(base + sizeof(AssetPackHeader))[index]; }
+	std::string Name(const AssetPackEntry& entry) const { return std::string(reinterpret_cast<const char*>(base + entry.nameoffset), entry.namelength); }
+	const byte* Data(uint32_t offset) const { return base + offset; }
+	const AssetPackGlyph* Glyphs(const AssetPackEntry& entry) const { return reinterpret_cast<const AssetPackGlyph*>(base + entry.dataoffset); }
+};
@@ -0,0 +1,82 @@
+#include <algorithm>
+#include "capturequota.h"
+
+using Clock = std::chrono::steady_clock;
+
+//requesters that were idle this long and have full buckets are dropped
+constexpr auto requesterTimeout = std::chrono::seconds(60);
+
+void TokenBucket::Refill(Clock::time_point now, double newrate, double newcapacity) {
+	if (!started) {
+		//new buckets start full
+		tokens = newcapacity;
+		started = true;
+	} else {
+		double elapsed = std::chrono::duration<double>(now - last).count();
+		tokens = std::min(tokens + elapsed * rate, newcapacity);
+	}
+	last = now;
+	rate = newrate;
+	capacity = newcapacity;
+}
+
+double TokenBucket::WaitFor(double amount, double reserve) const {
+	//requests larger than the bucket only need a full bucket, they leave it in debt
+	double needed = std::min(amount, capacity - reserve) + reserve;
+	if (tokens >= needed) {
+		return 0;
+	}
+	if (rate <= 0) {
+		return 1;
+	}
+	return (needed - tokens) / rate;
+}
+
+void CaptureScheduler::Prune(Clock::time_point now) {
+	if (now - lastPrune < std::chrono::seconds(1)) {
+		return;
+	}
+	lastPrune = now;
+	for (auto it = requesters.begin(); it != requesters.end();) {
+		if (now - it->second.lastSeen > requesterTimeout && it->second.captures.Full() && it->second.bytes.Full()) {
+			it = requesters.erase(it);
+		} else {
+			it++;
+		}
+	}
+}
+
+double CaptureScheduler::Request(const std::string& name, size_t bytes, bool foreground, bool force) {
+	auto now = Clock::now();
+	Prune(now);
+	auto& requester = requesters[name];
+	requester.lastSeen = now;
+
+	double share = (foreground ? 1 : opts.backgroundShare);
+	double capturerate = opts.capturesPerSecond * share;
+	double byterate = opts.bytesPerSecond * share;
+	//at least one capture has to fit in a bucket
+	requester.captures.Refill(now, capturerate, std::max(capturerate * opts.burst, 1.0));
+	requester.bytes.Refill(now, byterate, byterate * opts.burst);
+	total.Refill(now, opts.totalBytesPerSecond, opts.totalBytesPerSecond * opts.burst);
+
+	if (!force) {
+		double reserve = (foreground ? 0 : total.Capacity() * opts.foregroundReserve);
+		double wait = std::max({ requester.captures.WaitFor(1), requester.bytes.WaitFor(bytes), total.WaitFor(bytes, reserve) });
+		if (wait > 0) {
+			requester.stats.deferred++;
+			return std::max(wait * 1000, 1.0);
+		}
+	}
+	requester.captures.Take(1);
+	requester.bytes.Take(bytes);
+	total.Take(bytes);
+	requester.stats.captures++;
+	requester.stats.bytes += bytes;
+	return 0;
+}
+
+CaptureQuotaStats CaptureScheduler::Stats(const std::string& name) const {
+	auto requester = requesters.find(name);
+	return (requester == requesters.end() ? CaptureQuotaStats() : requester->second.stats);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <string>
+#include <chrono>
+#include <unordered_map>
+#include "util.h"
+
+/**
+ * Capture accounting per requesting app. Every app has token buckets for captures and bytes per second, all apps
+ * share one bucket for the total bytes per second. Background apps get a fraction of the per app rates and can't
+ * touch the part of the total budget that is reserved for the foreground, so total capture load stays bounded.
+ */
+
+struct CaptureQuotaOptions {
+	//per app limits for foreground apps
+	double capturesPerSecond = 30;
+	double bytesPerSecond = 150e6;
+	//limit over all apps together
+	double totalBytesPerSecond = 400e6;
+	//seconds worth of tokens a bucket can save up
+	double burst = 1;
+	//fraction of the per app rates background apps get
+	double backgroundShare = 0.25;
+	//fraction of the total budget that only foreground apps can use
+	double foregroundReserve = 0.25;
+};
+
+class TokenBucket {
+	double tokens = 0;
+	double rate = 0;
+	double capacity = 0;
+	std::chrono::steady_clock::time_point last;
+	bool started = false;
+public:
+	// Adds the tokens earned since the last refill, rate changes apply from now on
+	void Refill(std::chrono::steady_clock::time_point now, double rate, double capacity);
+	// Seconds until at least amount tokens are available above reserve, 0 if they already are
+	double WaitFor(double amount, double reserve = 0) const;
+	void Take(double amount) { tokens -= amount; }
+	bool Full() const { return tokens >= capacity; }
+	double Capacity() const { return capacity; }
+};
+
+struct CaptureQuotaStats {
+	uint64_t captures = 0;
+	uint64_t bytes = 0;
+	//requests that had to wait or were refused
+	uint64_t deferred = 0;
+};
+
+class CaptureScheduler {
+	struct Requester {
+		TokenBucket captures;
+		TokenBucket bytes;
+		CaptureQuotaStats stats;
+		std::chrono::steady_clock::time_point lastSeen;
+	};
+	std::unordered_map<std::string, Requester> requesters;
+	TokenBucket total;
+	CaptureQuotaOptions opts;
+	std::chrono::steady_clock::time_point lastPrune;
+	void Prune(std::chrono::steady_clock::time_point now);
+public:
+	// Takes the tokens for the capture and returns 0 if it can run now, returns the milliseconds to wait otherwise.
+	// Forced requests always run and leave the buckets in debt, for callers that can't wait
+	double Request(const std::string& requester, size_t bytes, bool foreground, bool force);
+	void Configure(const CaptureQuotaOptions& options) { opts = options; }
+	const CaptureQuotaOptions& Options() const { return opts; }
+	CaptureQuotaStats Stats(const std::string& requester) const;
+};
@@ -0,0 +1,74 @@
+#include <algorithm>
+#include "chatlines.h"
+#include "resultcache.h"
+#include "scratch.h"
+
+ChatLineUpdate ChatLineTracker::Push(const JSImageView& box, const ChatLineOptions& opts) {
+	ChatLineUpdate update;
+	int lh = std::max(opts.lineheight, 1);
+	int count = box.height / lh;
+	//partial band at the top is skipped, chat lines are anchored to the bottom of the box
+	int top = box.height - count * lh;
+
+	std::vector<uint64_t> hashes(count, 0);
+	std::vector<ChatLine> bands(count);
+	ScratchScope scratch;
+	int* classes = scratch.Alloc<int>(box.width);
+	size_t masksize = (size_t)box.width * lh;
+	byte* mask = scratch.Alloc<byte>(masksize);
+	for (int i = 0; i < count; i++) {
+		auto& band = bands[i];
+		band = { i, JSRectangle(0, top + i * lh, box.width, lh), -1, -1, -1 };
+		bool hastext = false;
+		for (int y = 0; y < lh; y++) {
+			ClassifyColorRow(box.Pixel(0, band.rect.y + y), box.width, opts.colors, classes);
+			byte* maskrow = mask + (size_t)y * box.width;
+			for (int x = 0; x < box.width; x++) {
+				maskrow[x] = (byte)(classes[x] + 1);
+				if (classes[x] != -1 && !hastext) {
+					hastext = true;
+					band.textx = x;
+					band.texty = band.rect.y + y;
+					band.colorclass = classes[x];
+				}
+			}
+		}
+		if (hastext) {
+			//never 0, that marks empty bands
+			hashes[i] = HashBytes(mask, masksize, 0) | 1;
+		}
+	}
+
+	bool comparable = (box.width == width && lh == lineheight && (int)previous.size() == count);
+	//scroll offset with the most matching text lines, the smallest offset wins ties
+	int best = -1;
+	int bestmatches = 0;
+	if (comparable) {
+		for (int k = 0; k < count; k++) {
+			int matches = 0;
+			for (int j = 0; j + k < count; j++) {
+				if (hashes[j] != 0 && hashes[j] == previous[j + k]) { matches++; }
+			}
+			if (matches > bestmatches) {
+				best = k;
+				bestmatches = matches;
+			}
+		}
+		//nothing to match against, an empty chat can't have scrolled
+		bool anytext = false;
+		for (auto h : previous) { anytext |= (h != 0); }
+		if (!anytext) { best = 0; }
+	}
+
+	update.scroll = best;
+	for (int j = 0; j < count; j++) {
+		if (hashes[j] == 0) { continue; }
+		if (best == -1 || j + best >= count || hashes[j] != previous[j + best]) {
+			update.lines.push_back(bands[j]);
+		}
+	}
+	previous = std::move(hashes);
+	width = box.width;
+	lineheight = lh;
+	return update;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "util.h"
+#include "components.h"
+
+/**
+ * Incremental chatbox reading. The chatbox is cut into line bands from the bottom up, every band is hashed on
+ * its text colored pixels only so the translucent background doesn't matter. Matching the hashes against the
+ * previous frame gives the scroll offset, only lines that are new or changed have to go through OCR.
+ */
+
+struct ChatLineOptions {
+	//line pitch in pixels of the chat font
+	int lineheight = 14;
+	//text colors, pixels that match none of them are ignored
+	std::vector<ComponentColorClass> colors;
+};
+
+struct ChatLine {
+	//index of the band counted from the top of the chatbox
+	int index;
+	JSRectangle rect;
+	//first text pixel of the band in row major order, a starting point for the OCR
+	int textx, texty;
+	//color class of that pixel
+	int colorclass;
+};
+
+struct ChatLineUpdate {
+	//number of lines the chat moved up since the previous frame, -1 if the frames couldn't be matched
+	int scroll = 0;
+	//lines that are new or changed, top to bottom, empty bands are left out
+	std::vector<ChatLine> lines;
+};
+
+/**
+ * Line hashes of the previous chatbox frame
+ */
+class ChatLineTracker {
+	//top to bottom, 0 for bands without text
+	std::vector<uint64_t> previous;
+	int width = 0;
+	int lineheight = 0;
+public:
+	ChatLineUpdate Push(const JSImageView& box, const ChatLineOptions& opts);
+};
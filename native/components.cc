@@ -0,0 +1,138 @@
+#include <algorithm>
+#include <cstdlib>
+#include "components.h"
+#include "scratch.h"
+
+struct ComponentStats {
+	int x1, y1, x2, y2;
+	int area;
+	int64_t sumx, sumy;
+	int colorclass;
+	void Merge(const ComponentStats& other) {
+		x1 = std::min(x1, other.x1);
+		y1 = std::min(y1, other.y1);
+		x2 = std::max(x2, other.x2);
+		y2 = std::max(y2, other.y2);
+		area += other.area;
+		sumx += other.sumx;
+		sumy += other.sumy;
+	}
+};
+
+//union-find over provisional labels, parents always have a lower label than their children
+class LabelSets {
+	std::vector<int> parent;
+public:
+	int Add() {
+		parent.push_back((int)parent.size());
+		return (int)parent.size() - 1;
+	}
+	int Find(int label) {
+		int root = label;
+		while (parent[root] != root) { root = parent[root]; }
+		//path compression
+		while (parent[label] != root) {
+			int next = parent[label];
+			parent[label] = root;
+			label = next;
+		}
+		return root;
+	}
+	int Union(int a, int b) {
+		a = Find(a);
+		b = Find(b);
+		if (a < b) { parent[b] = a; return a; }
+		parent[a] = b;
+		return b;
+	}
+	size_t Size() const { return parent.size(); }
+};
+
+void ClassifyColorRow(const byte* row, int width, const std::vector<ComponentColorClass>& classes, int* out) {
+	if (classes.empty()) {
+		for (int x = 0; x < width; x++) {
+			out[x] = (row[x * 4 + 3] >= 128 ? 0 : -1);
+		}
+		return;
+	}
+	for (int x = 0; x < width; x++) {
+		const byte* px = row + x * 4;
+		out[x] = -1;
+		for (size_t i = 0; i < classes.size(); i++) {
+			auto& cls = classes[i];
+			if (std::abs(px[0] - cls.r) <= cls.tolerance && std::abs(px[1] - cls.g) <= cls.tolerance && std::abs(px[2] - cls.b) <= cls.tolerance) {
+				out[x] = (int)i;
+				break;
+			}
+		}
+	}
+}
+
+std::vector<ImageComponent> FindComponents(const JSImageView& img, const ComponentOptions& opts) {
+	int width = img.width;
+	//only the previous row of labels is needed, stats are collected per provisional label during the first pass
+	//and the second pass folds them into their root label instead of relabeling the whole image
+	ScratchScope scratch;
+	int* classes[2] = { scratch.Alloc<int>(width), scratch.Alloc<int>(width) };
+	int* labels[2] = { scratch.Alloc<int>(width, -1), scratch.Alloc<int>(width, -1) };
+	LabelSets sets;
+	std::vector<ComponentStats> stats;
+
+	for (int y = 0; y < img.height; y++) {
+		int* cls = classes[y & 1];
+		int* prevcls = classes[(y + 1) & 1];
+		int* lbl = labels[y & 1];
+		int* prevlbl = labels[(y + 1) & 1];
+		ClassifyColorRow(img.Pixel(0, y), width, opts.classes, cls);
+		for (int x = 0; x < width; x++) {
+			int c = cls[x];
+			lbl[x] = -1;
+			if (c < 0) { continue; }
+			int label = -1;
+			auto join = [&](int other) {
+				label = (label == -1 ? sets.Find(other) : sets.Union(label, other));
+			};
+			if (x > 0 && cls[x - 1] == c) { join(lbl[x - 1]); }
+			if (y > 0) {
+				if (prevcls[x] == c) { join(prevlbl[x]); }
+				if (opts.diagonal) {
+					if (x > 0 && prevcls[x - 1] == c) { join(prevlbl[x - 1]); }
+					if (x + 1 < width && prevcls[x + 1] == c) { join(prevlbl[x + 1]); }
+				}
+			}
+			if (label == -1) {
+				label = sets.Add();
+				stats.push_back(ComponentStats{ x, y, x, y, 0, 0, 0, c });
+			}
+			lbl[x] = label;
+			auto& st = stats[label];
+			st.x1 = std::min(st.x1, x);
+			st.x2 = std::max(st.x2, x);
+			st.y2 = y;
+			st.area++;
+			st.sumx += x;
+			st.sumy += y;
+		}
+	}
+
+	//roots always have the lowest label of their set, so folding from the back never touches a label twice
+	for (int label = (int)sets.Size() - 1; label >= 0; label--) {
+		int root = sets.Find(label);
+		if (root != label) {
+			stats[root].Merge(stats[label]);
+			stats[label].area = 0;
+		}
+	}
+
+	std::vector<ImageComponent> out;
+	for (auto& st : stats) {
+		if (st.area == 0) { continue; }
+		int w = st.x2 - st.x1 + 1;
+		int h = st.y2 - st.y1 + 1;
+		if (st.area < opts.minArea || st.area > opts.maxArea) { continue; }
+		if (w < opts.minWidth || w > opts.maxWidth || h < opts.minHeight || h > opts.maxHeight) { continue; }
+		out.push_back(ImageComponent{ JSRectangle(st.x1, st.y1, w, h), st.area, (double)st.sumx / st.area, (double)st.sumy / st.area, st.colorclass });
+		if (out.size() >= opts.maxCount) { break; }
+	}
+	return out;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "util.h"
+
+/**
+ * Connected component labeling over color classes, finds blobs of similar colored pixels such as
+ * interface boxes or icons so readers can look at candidate areas instead of scanning whole captures
+ */
+
+struct ComponentColorClass {
+	byte r = 0, g = 0, b = 0;
+	//largest per channel difference that still matches
+	byte tolerance = 0;
+};
+
+struct ComponentOptions {
+	//pixels are assigned to the first matching class, with no classes every pixel with alpha >= 128 is class 0
+	std::vector<ComponentColorClass> classes;
+	//also connect diagonal neighbours
+	bool diagonal = false;
+	int minArea = 1;
+	int maxArea = INT32_MAX;
+	int minWidth = 1, minHeight = 1;
+	int maxWidth = INT32_MAX, maxHeight = INT32_MAX;
+	//stop after this many components passed the filter
+	size_t maxCount = 10000;
+};
+
+struct ImageComponent {
+	JSRectangle bounds;
+	int area;
+	double cx, cy;
+	int colorclass;
+};
+
+// Color class of every pixel of a row, -1 for pixels without a class. Pixels take the first matching class,
+// with no classes every pixel with alpha >= 128 is class 0
+void ClassifyColorRow(const byte* row, int width, const std::vector<ComponentColorClass>& classes, int* out);
+// Components in row major order of their first pixel
+std::vector<ImageComponent> FindComponents(const JSImageView& img, const ComponentOptions& opts);
@@ -0,0 +1,95 @@
+#include <algorithm>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FRAMEDIFF_SSE2
+#endif
+#include "framediff.h"
+#include "region.h"
+#include "scratch.h"
+
+//true if any byte differs by more than tolerance
+static bool SpanDiffers(const byte* a, const byte* b, size_t len, byte tolerance) {
+	size_t i = 0;
+#ifdef FRAMEDIFF_SSE2
+	const __m128i tol = _mm_set1_epi8((char)tolerance);
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= len; i += 16) {
+		__m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+		__m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+		//saturating subtract both ways gives the absolute difference, subtracting the tolerance leaves only the excess
+		__m128i diff = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+		__m128i excess = _mm_subs_epu8(diff, tol);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(excess, zero)) != 0xffff) {
+			return true;
+		}
+	}
+#endif
+	for (; i < len; i++) {
+		int diff = a[i] - b[i];
+		if (diff > tolerance || -diff > tolerance) {
+			return true;
+		}
+	}
+	return false;
+}
+
+std::vector<JSRectangle> DiffFrames(const JSImageView& a, const JSImageView& b, const FrameDiffOptions& opts) {
+	int width = std::min(a.width, b.width);
+	int height = std::min(a.height, b.height);
+	int tilesize = std::max(opts.tilesize, 1);
+	int tilecols = (width + tilesize - 1) / tilesize;
+
+	std::vector<JSRectangle> changed;
+	ScratchScope scratch;
+	bool* dirty = scratch.Alloc<bool>(tilecols);
+	for (int tiley = 0; tiley < height; tiley += tilesize) {
+		int tileheight = std::min(tilesize, height - tiley);
+		std::fill(dirty, dirty + tilecols, false);
+		int remaining = tilecols;
+		//row by row to stay in memory order, tiles that are already dirty are skipped for the rest of the tile row
+		for (int y = tiley; y < tiley + tileheight && remaining != 0; y++) {
+			const byte* rowa = a.Pixel(0, y);
+			const byte* rowb = b.Pixel(0, y);
+			for (int col = 0; col < tilecols; col++) {
+				if (dirty[col]) { continue; }
+				int x = col * tilesize;
+				size_t len = (size_t)std::min(tilesize, width - x) * 4;
+				if (SpanDiffers(rowa + x * 4, rowb + x * 4, len, opts.tolerance)) {
+					dirty[col] = true;
+					remaining--;
+				}
+			}
+		}
+		//horizontal runs of dirty tiles, vertical merging is left to the region
+		for (int col = 0; col < tilecols;) {
+			if (!dirty[col]) { col++; continue; }
+			int start = col;
+			while (col < tilecols && dirty[col]) { col++; }
+			int x1 = start * tilesize;
+			int x2 = std::min(col * tilesize, width);
+			changed.push_back(JSRectangle(x1, tiley, x2 - x1, tileheight));
+		}
+	}
+	return ShapeRegion::FromRects(changed).ToRects();
+}
+
+std::vector<JSRectangle> FrameDiffStream::Push(const JSImageView& frame, const FrameDiffOptions& opts) {
+	std::vector<JSRectangle> changed;
+	if (frame.width == width && frame.height == height && !previous.empty()) {
+		changed = DiffFrames(JSImageView(previous.data(), width, height), frame, opts);
+	} else if (frame.width != 0 && frame.height != 0) {
+		changed.push_back(JSRectangle(0, 0, frame.width, frame.height));
+	}
+
+	width = frame.width;
+	height = frame.height;
+	size_t rowbytes = (size_t)width * 4;
+	previous.resize(rowbytes * height);
+	//only changed tiles are stored, tiles within tolerance keep their old reference so slow drifts still get reported eventually
+	for (auto& rect : changed) {
+		for (int y = rect.y; y < rect.y + rect.height; y++) {
+			memcpy(previous.data() + y * rowbytes + rect.x * 4, frame.Pixel(rect.x, y), (size_t)rect.width * 4);
+		}
+	}
+	return changed;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vector>
+#include "util.h"
+
+/**
+ * Change detection between two captures of the same area. Images are compared in square tiles and the
+ * changed tiles are returned as a minimal y-x banded rectangle list, readers only need to look at those areas.
+ */
+
+struct FrameDiffOptions {
+	//largest per channel difference that still counts as unchanged
+	byte tolerance = 0;
+	//tile size in pixels, larger tiles are cheaper but give coarser rects
+	int tilesize = 16;
+};
+
+// Rects covering every tile in which a and b differ, both images should have the same size
+std::vector<JSRectangle> DiffFrames(const JSImageView& a, const JSImageView& b, const FrameDiffOptions& opts);
+
+/**
+ * Keeps a copy of the last frame of a stream of captures so every new frame can be diffed against it.
+ * The first frame, and any frame with a different size, is reported as changed completely
+ */
+class FrameDiffStream {
+	std::vector<byte> previous;
+	int width = 0;
+	int height = 0;
+public:
+	std::vector<JSRectangle> Push(const JSImageView& frame, const FrameDiffOptions& opts);
+};
@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <cmath>
+#include "iconindex.h"
+#include "scratch.h"
+
+//the hash is taken from the lowest 8x8 frequencies of the 32x32 dct of the downsampled luminance
+constexpr int hashSampleSize = 32;
+constexpr int hashFrequencies = 8;
+//chunk radius 3 already probes 697 buckets per chunk, a linear scan is cheaper beyond that
+constexpr int maxChunkRadius = IconQueryOptions::distanceLimit / 4 - 1;
+constexpr double pi = 3.14159265358979323846;
+
+static const std::vector<double>& DctTable() {
+	static std::vector<double> table = [] {
+		std::vector<double> t(hashFrequencies * hashSampleSize);
+		for (int u = 0; u < hashFrequencies; u++) {
+			for (int x = 0; x < hashSampleSize; x++) {
+				t[u * hashSampleSize + x] = std::cos((2 * x + 1) * u * pi / (2 * hashSampleSize));
+			}
+		}
+		return t;
+	}();
+	return table;
+}
+
+IconHash IconHash::FromImage(const JSImageView& img) {
+	IconHash hash;
+	if (img.width <= 0 || img.height <= 0) { return hash; }
+
+	//area average into 32x32 luminance, small icons get their pixels repeated
+	double luma[hashSampleSize * hashSampleSize];
+	for (int oy = 0; oy < hashSampleSize; oy++) {
+		int y1 = oy * img.height / hashSampleSize;
+		int y2 = std::max(y1 + 1, (oy + 1) * img.height / hashSampleSize);
+		for (int ox = 0; ox < hashSampleSize; ox++) {
+			int x1 = ox * img.width / hashSampleSize;
+			int x2 = std::max(x1 + 1, (ox + 1) * img.width / hashSampleSize);
+			int sum = 0;
+			for (int y = y1; y < y2; y++) {
+				const byte* px = img.Pixel(x1, y);
+				for (int x = x1; x < x2; x++, px += 4) {
+					sum += px[0] * 299 + px[1] * 587 + px[2] * 114;
+				}
+			}
+			luma[oy * hashSampleSize + ox] = sum / 1000.0 / ((x2 - x1) * (y2 - y1));
+		}
+	}
+
+	//separable dct, only the frequencies we need
+	auto& table = DctTable();
+	double rows[hashSampleSize * hashFrequencies];
+	for (int y = 0; y < hashSampleSize; y++) {
+		for (int u = 0; u < hashFrequencies; u++) {
+			double sum = 0;
+			for (int x = 0; x < hashSampleSize; x++) { sum += luma[y * hashSampleSize + x] * table[u * hashSampleSize + x]; }
+			rows[y * hashFrequencies + u] = sum;
+		}
+	}
+	double coefs[hashFrequencies * hashFrequencies];
+	for (int v = 0; v < hashFrequencies; v++) {
+		for (int u = 0; u < hashFrequencies; u++) {
+			double sum = 0;
+			for (int y = 0; y < hashSampleSize; y++) { sum += rows[y * hashFrequencies + u] * table[v * hashSampleSize + y]; }
+			coefs[v * hashFrequencies + u] = sum;
+		}
+	}
+	double sorted[hashFrequencies * hashFrequencies];
+	std::copy(coefs, coefs + 64, sorted);
+	std::nth_element(sorted, sorted + 32, sorted + 64);
+	double median = sorted[32];
+	for (int i = 0; i < 64; i++) {
+		if (coefs[i] > median) { hash.phash |= (uint64_t)1 << i; }
+	}
+
+	//quadrant colors
+	for (int q = 0; q < 4; q++) {
+		int x1 = (q & 1) * img.width / 2, x2 = std::max(x1 + 1, ((q & 1) + 1) * img.width / 2);
+		int y1 = (q >> 1) * img.height / 2, y2 = std::max(y1 + 1, ((q >> 1) + 1) * img.height / 2);
+		int r = 0, g = 0, b = 0;
+		for (int y = y1; y < y2; y++) {
+			const byte* px = img.Pixel(x1, y);
+			for (int x = x1; x < x2; x++, px += 4) { r += px[0]; g += px[1]; b += px[2]; }
+		}
+		int count = (x2 - x1) * (y2 - y1);
+		hash.color[q * 3 + 0] = (byte)(r / count);
+		hash.color[q * 3 + 1] = (byte)(g / count);
+		hash.color[q * 3 + 2] = (byte)(b / count);
+	}
+	return hash;
+}
+
+static int HammingDistance(uint64_t a, uint64_t b) {
+	uint64_t x = a ^ b;
+	int count = 0;
+	//kernighan, hashes of near matches have few set bits
+	while (x) { x &= x - 1; count++; }
+	return count;
+}
+
+static double ColorDistance(const IconHash& a, const IconHash& b) {
+	int sum = 0;
+	for (int i = 0; i < 12; i++) { sum += std::abs(a.color[i] - b.color[i]); }
+	return sum / 12.0;
+}
+
+uint32_t IconIndex::Add(const std::string& key, const JSImageView& img) {
+	uint32_t id = (uint32_t)icons.size();
+	Icon icon;
+	icon.key = key;
+	icon.hash = IconHash::FromImage(img);
+	icon.pixels = OwnedImage(img.width, img.height);
+	for (int y = 0; y < img.height; y++) {
+		memcpy(icon.pixels.data.data() + (size_t)y * img.width * 4, img.Pixel(0, y), (size_t)img.width * 4);
+	}
+	for (int chunk = 0; chunk < 4; chunk++) {
+		chunkTables[chunk][(uint16_t)(icon.hash.phash >> (chunk * 16))].push_back(id);
+	}
+	icons.push_back(std::move(icon));
+	visited.push_back(0);
+	return id;
+}
+
+bool IconIndex::Verify(const Icon& icon, const JSImageView& img, byte tolerance) const {
+	if (img.width != icon.pixels.width || img.height != icon.pixels.height) { return false; }
+	for (int y = 0; y < img.height; y++) {
+		const byte* ref = icon.pixels.data.data() + (size_t)y * icon.pixels.width * 4;
+		const byte* px = img.Pixel(0, y);
+		for (int x = 0; x < img.width; x++, ref += 4, px += 4) {
+			if (ref[3] < 128) { continue; }
+			if (std::abs(ref[0] - px[0]) > tolerance || std::abs(ref[1] - px[1]) > tolerance || std::abs(ref[2] - px[2]) > tolerance) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+//calls f for every 16 bit value within hamming distance 'radius' of 'value', only flipping bits from 'firstbit' up
+template<typename F>
+static void EnumerateNeighbours(uint16_t value, int radius, int firstbit, F& f) {
+	f(value);
+	if (radius == 0) { return; }
+	for (int bit = firstbit; bit < 16; bit++) {
+		EnumerateNeighbours((uint16_t)(value ^ (1 << bit)), radius - 1, bit + 1, f);
+	}
+}
+
+std::vector<IconMatch> IconIndex::Query(const JSImageView& img, const IconQueryOptions& opts) {
+	IconHash hash = IconHash::FromImage(img);
+	int maxdist = std::clamp(opts.maxDistance, 0, 64);
+	int chunkradius = maxdist / 4;
+	if (++stamp == 0) {
+		//stamp wrapped around
+		std::fill(visited.begin(), visited.end(), 0);
+		stamp = 1;
+	}
+
+	//every icon is considered at most once, only the returned top matches are copied out of scratch memory
+	ScratchScope scratch;
+	IconMatch* matches = scratch.Alloc<IconMatch>(icons.size());
+	size_t matchcount = 0;
+	auto consider = [&](uint32_t id) {
+		if (visited[id] == stamp) { return; }
+		visited[id] = stamp;
+		auto& icon = icons[id];
+		int dist = HammingDistance(hash.phash, icon.hash.phash);
+		if (dist > maxdist) { return; }
+		matches[matchcount++] = IconMatch{ id, dist, ColorDistance(hash, icon.hash), false };
+	};
+	if (chunkradius > maxChunkRadius) {
+		for (uint32_t id = 0; id < icons.size(); id++) { consider(id); }
+	} else {
+		for (int chunk = 0; chunk < 4; chunk++) {
+			auto& table = chunkTables[chunk];
+			auto probe = [&](uint16_t value) {
+				auto bucket = table.find(value);
+				if (bucket == table.end()) { return; }
+				for (uint32_t id : bucket->second) { consider(id); }
+			};
+			EnumerateNeighbours((uint16_t)(hash.phash >> (chunk * 16)), chunkradius, 0, probe);
+		}
+	}
+
+	auto score = [&](const IconMatch& m) {return m.distance + opts.colorWeight * m.colorDistance; };
+	IconMatch* end = matches + matchcount;
+	std::sort(matches, end, [&](const IconMatch& a, const IconMatch& b) {return score(a) < score(b); });
+	if (opts.verify) {
+		//verified matches go first, the order is kept otherwise
+		for (auto match = matches; match != end; match++) { match->verified = Verify(icons[match->id], img, opts.verifyTolerance); }
+		std::stable_partition(matches, end, [](const IconMatch& m) {return m.verified; });
+	}
+	return std::vector<IconMatch>(matches, matches + std::min(matchcount, opts.count));
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <unordered_map>
+#include "util.h"
+#include "imagescale.h"
+
+/**
+ * Lookup of captured icons in a library of known reference icons.
+ * Every icon gets a 64 bit dct hash of its luminance plus a coarse color signature, candidates are found with
+ * multi-index hashing: the hash is split into 4 16 bit chunks and by the pigeonhole principle any hash within
+ * hamming distance d has at least one chunk within floor(d/4), so only those chunk buckets need to be probed.
+ */
+
+struct IconHash {
+	uint64_t phash = 0;
+	//mean rgb of the 2x2 quadrants
+	byte color[12] = {};
+	static IconHash FromImage(const JSImageView& img);
+};
+
+struct IconQueryOptions {
+	//largest hamming distance of the dct hash, below distanceLimit
+	int maxDistance = 8;
+	//from here on the multi-index probe visits more buckets than a scan of the whole index, queries fall back to that
+	static constexpr int distanceLimit = 16;
+	//weight of the mean per channel color difference when ranking matches
+	double colorWeight = 0.25;
+	size_t count = 5;
+	//compare candidates pixel by pixel, the query has to have the same size as the reference
+	bool verify = false;
+	//largest per channel difference in verification, transparent reference pixels are ignored
+	byte verifyTolerance = 0;
+};
+
+struct IconMatch {
+	uint32_t id;
+	int distance;
+	double colorDistance;
+	bool verified;
+};
+
+class IconIndex {
+	struct Icon {
+		std::string key;
+		IconHash hash;
+		OwnedImage pixels;
+	};
+	std::vector<Icon> icons;
+	std::unordered_map<uint16_t, std::vector<uint32_t>> chunkTables[4];
+	//per icon query stamp to skip candidates that were found through more than one chunk
+	std::vector<uint32_t> visited;
+	uint32_t stamp = 0;
+
+	bool Verify(const Icon& icon, const JSImageView& img, byte tolerance) const;
+public:
+	uint32_t Add(const std::string& key, const JSImageView& img);
+	std::vector<IconMatch> Query(const JSImageView& img, const IconQueryOptions& opts);
+	const std::string& Key(uint32_t id) const { return icons[id].key; }
+	size_t Size() const { return icons.size(); }
+};
@@ -0,0 +1,130 @@
+#include <algorithm>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define IMAGESCALE_SSE2
+#endif
+#include "imagescale.h"
+#include "ncc.h"
+#include "scratch.h"
+
+//adds one row of 8 bit channels to a row of 16 bit sums, at most 8 rows are summed so this can't overflow
+static void AccumulateRow(const byte* row, uint16_t* sums, size_t len) {
+	size_t i = 0;
+#ifdef IMAGESCALE_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= len; i += 16) {
+		__m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+		__m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + i));
+		__m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + i + 8));
+		lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(pixels, zero));
+		hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(pixels, zero));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(sums + i), lo);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(sums + i + 8), hi);
+	}
+#endif
+	for (; i < len; i++) {
+		sums[i] += row[i];
+	}
+}
+
+void DownscaleBox(const byte* src, int srcstride, int width, int height, int scale, byte* dst, int dststride, bool bgrx) {
+	int outwidth = DownscaledSize(width, scale);
+	int outheight = DownscaledSize(height, scale);
+	//channel order of the source, the output is always rgba
+	const int r = (bgrx ? 2 : 0), g = 1, b = (bgrx ? 0 : 2);
+	ScratchScope scratch;
+	size_t sumcount = (size_t)width * 4;
+	uint16_t* sums = scratch.Alloc<uint16_t>(sumcount);
+	for (int outy = 0; outy < outheight; outy++) {
+		int y1 = outy * scale;
+		int rows = std::min(scale, height - y1);
+		//vertical pass over the full row width in simd, the horizontal pass only touches the (scale times smaller) sums
+		std::fill(sums, sums + sumcount, 0);
+		for (int y = y1; y < y1 + rows; y++) {
+			AccumulateRow(src + (size_t)y * srcstride, sums, sumcount);
+		}
+		byte* out = dst + (size_t)outy * dststride;
+		for (int outx = 0; outx < outwidth; outx++) {
+			int x1 = outx * scale;
+			int cols = std::min(scale, width - x1);
+			uint32_t sr = 0, sg = 0, sb = 0, sa = 0;
+			const uint16_t* block = sums + (size_t)x1 * 4;
+			for (int x = 0; x < cols; x++, block += 4) {
+				sr += block[r];
+				sg += block[g];
+				sb += block[b];
+				sa += block[3];
+			}
+			uint32_t count = rows * cols;
+			out[0] = (byte)((sr + count / 2) / count);
+			out[1] = (byte)((sg + count / 2) / count);
+			out[2] = (byte)((sb + count / 2) / count);
+			out[3] = (bgrx ? 255 : (byte)((sa + count / 2) / count));
+			out += 4;
+		}
+	}
+}
+
+OwnedImage ResizeBilinear(const JSImageView& img, int width, int height) {
+	OwnedImage ret(width, height);
+	if (img.width == 0 || img.height == 0) { return ret; }
+	double fx = (double)img.width / width;
+	double fy = (double)img.height / height;
+	//horizontal sample positions are the same for every row
+	ScratchScope scratch;
+	int* x0 = scratch.Alloc<int>(width);
+	int* x1 = scratch.Alloc<int>(width);
+	int* wx = scratch.Alloc<int>(width);
+	for (int x = 0; x < width; x++) {
+		double sx = std::min(std::max((x + 0.5) * fx - 0.5, 0.0), img.width - 1.0);
+		x0[x] = (int)sx;
+		x1[x] = std::min(x0[x] + 1, img.width - 1);
+		wx[x] = (int)((sx - x0[x]) * 256 + 0.5);
+	}
+	for (int y = 0; y < height; y++) {
+		double sy = std::min(std::max((y + 0.5) * fy - 0.5, 0.0), img.height - 1.0);
+		int y0 = (int)sy;
+		int y1 = std::min(y0 + 1, img.height - 1);
+		int wy = (int)((sy - y0) * 256 + 0.5);
+		byte* dst = ret.data.data() + (size_t)y * width * 4;
+		for (int x = 0; x < width; x++) {
+			const byte* a = img.Pixel(x0[x], y0);
+			const byte* b = img.Pixel(x1[x], y0);
+			const byte* c = img.Pixel(x0[x], y1);
+			const byte* d = img.Pixel(x1[x], y1);
+			for (int ch = 0; ch < 4; ch++) {
+				int top = a[ch] * (256 - wx[x]) + b[ch] * wx[x];
+				int bottom = c[ch] * (256 - wx[x]) + d[ch] * wx[x];
+				dst[x * 4 + ch] = (byte)((top * (256 - wy) + bottom * wy + (1 << 15)) >> 16);
+			}
+		}
+	}
+	return ret;
+}
+
+void ImagePyramid::Build(const JSImageView& img, int levelcount) {
+	levels.clear();
+	integrals.clear();
+	levels.reserve(levelcount);
+	OwnedImage base(img.width, img.height);
+	for (int y = 0; y < img.height; y++) {
+		memcpy(base.data.data() + (size_t)y * img.width * 4, img.Pixel(0, y), (size_t)img.width * 4);
+	}
+	levels.push_back(std::move(base));
+	while ((int)levels.size() < levelcount) {
+		auto& prev = levels.back();
+		if (prev.width <= 1 && prev.height <= 1) { break; }
+		OwnedImage next(DownscaledSize(prev.width, 2), DownscaledSize(prev.height, 2));
+		DownscaleBox(prev.data.data(), prev.width * 4, prev.width, prev.height, 2, next.data.data(), next.width * 4, false);
+		levels.push_back(std::move(next));
+	}
+}
+
+const IntegralImage& ImagePyramid::Integral(size_t level) {
+	integrals.resize(levels.size());
+	if (!integrals[level]) {
+		integrals[level] = std::make_shared<IntegralImage>();
+		integrals[level]->Build(levels[level].View());
+	}
+	return *integrals[level];
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "util.h"
+
+/**
+ * Box filter downscaling by 2, 4 or 8, used for scaled capture output and image pyramids.
+ * Arbitrary factors (interface scaling of needles) use bilinear resampling instead
+ */
+
+//valid downscale factors
+inline bool IsValidDownscale(int scale) { return scale == 1 || scale == 2 || scale == 4 || scale == 8; }
+//size of one dimension after scaling, partial blocks at the edges become one (averaged) pixel
+inline int DownscaledSize(int size, int scale) { return (size + scale - 1) / scale; }
+
+// Averages every scale*scale block of src into one pixel of dst, dst has to have room for the downscaled size.
+// With 'bgrx' the source is read as x11/gdi BGRX and written as opaque RGBA, so this can replace the plain capture copy
+void DownscaleBox(const byte* src, int srcstride, int width, int height, int scale, byte* dst, int dststride, bool bgrx);
+
+//rgba image that owns its pixels
+struct OwnedImage {
+	std::vector<byte> data;
+	int width = 0;
+	int height = 0;
+	OwnedImage() = default;
+	OwnedImage(int w, int h) :data((size_t)w * h * 4), width(w), height(h) {}
+	JSImageView View() { return JSImageView(data.data(), width, height); }
+};
+
+// Bilinear resample of img to the given size, pixel centers are aligned
+OwnedImage ResizeBilinear(const JSImageView& img, int width, int height);
+
+/**
+ * Successive 1/2 box filtered copies of an image, level 0 is the full size image. Searched coarse-to-fine with
+ * MatchNccPyramid
+ */
+class ImagePyramid {
+	std::vector<OwnedImage> levels;
+	//summed-area tables of the levels, built the first time a search needs them
+	std::vector<std::shared_ptr<IntegralImage>> integrals;
+public:
+	void Build(const JSImageView& img, int levelcount);
+	size_t LevelCount() const { return levels.size(); }
+	OwnedImage& Level(size_t level) { return levels[level]; }
+	const IntegralImage& Integral(size_t level);
+};
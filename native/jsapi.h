@@ -1,5 +1,18 @@
 #include <map>
+#include <mutex>
 #include "os.h"
+#include "framediff.h"
+#include "imagescale.h"
+#include "components.h"
+#include "iconindex.h"
+#include "assetpack.h"
+#include "resultcache.h"
+#include "ncc.h"
+#include "scratch.h"
+#include "chatlines.h"
+#include "textmetrics.h"
+#include "windowqueries.h"
+#include "capturequota.h"
 #include "../libs/Alt1Native.h"
 
 
@@ -9,12 +22,19 @@ const std::map<CaptureMode, std::string> captureModeText = {
 	{CaptureMode::OpenGL,"opengl"}
 };
 
+//process wide, a client process can only be hooked once no matter how many environments ask for it
+std::mutex hookedWindowsMutex;
 std::map<OSWindow, Alt1Native::HookedProcess*> hookedWindows;
 
 Napi::Value HookWindow(const Napi::CallbackInfo& info) {
 #ifdef OPENGL_SUPPORTED
 	auto wnd = OSWindow::FromJsValue(info[0]);
 
+	std::lock_guard<std::mutex> lock(hookedWindowsMutex);
+	auto existing = hookedWindows.find(wnd);
+	if (existing != hookedWindows.end()) {
+		return Napi::BigInt::New(info.Env(), (uintptr_t)existing->second);
+	}
 	auto handle = Alt1Native::HookProcess(wnd.handle);
 	hookedWindows[wnd] = handle;
 	return Napi::BigInt::New(info.Env(), (uintptr_t)handle);
@@ -23,23 +43,75 @@ Napi::Value HookWindow(const Napi::CallbackInfo& info) {
 #endif
 }
 
-Napi::Value CaptureWindowMulti(const Napi::CallbackInfo& info) {
-	auto env = info.Env();
-	auto wnd = OSWindow::FromJsValue(info[0]);
-
-	//convert the capture mode string
-	auto captmodetext = info[1].As<Napi::String>().Utf8Value();
-	bool modematched = false;
-	CaptureMode captmode = CaptureMode::Desktop;
+CaptureMode CaptureModeFromJsValue(const Napi::Value& val) {
+	auto captmodetext = val.As<Napi::String>().Utf8Value();
 	for (auto mode : captureModeText) {
 		if (mode.second == captmodetext) {
-			modematched = true;
-			captmode = mode.first;
-			break;
+			return mode.first;
 		}
 	}
-	if (!modematched) {
-		throw Napi::RangeError::New(env, "unknown capture mode");
+	throw Napi::RangeError::New(val.Env(), "unknown capture mode");
+}
+
+void ValidateCaptureRect(Napi::Env env, const JSRectangle& rect) {
+	if (rect.width <= 0 || rect.height <= 0 || rect.width > 1e4 || rect.height > 1e4) {
+		throw Napi::TypeError::New(env, "invalid capture size");
+	}
+}
+
+//byte size of a capture after downscaling
+size_t CaptureSize(const JSRectangle& rect, int scale) {
+	return (size_t)DownscaledSize(rect.width, scale) * DownscaledSize(rect.height, scale) * 4;
+}
+
+int CaptureScaleFromJsValue(const Napi::Value& val) {
+	if (val.IsUndefined() || val.IsNull()) { return 1; }
+	int scale = val.As<Napi::Number>().Int32Value();
+	if (!IsValidDownscale(scale)) {
+		throw Napi::RangeError::New(val.Env(), "capture scale should be 1, 2, 4 or 8");
+	}
+	return scale;
+}
+
+//packed variant of CaptureWindowMulti, all rects are captured into one buffer
+//returns {data, offsets} where offsets[i] is the byte offset of rect i and offsets[n] the total size
+Napi::Value CaptureWindowMultiPacked(Napi::Env env, OSWindow wnd, CaptureMode captmode, const Napi::Value& rectsval, int scale) {
+	auto rects = JSRectangle::FromPackedArray(rectsval);
+	auto offsets = Napi::Uint32Array::New(env, rects.size() + 1);
+	size_t total = 0;
+	for (size_t i = 0; i < rects.size(); i++) {
+		ValidateCaptureRect(env, rects[i]);
+		offsets[i] = (uint32_t)total;
+		total += CaptureSize(rects[i], scale);
+		if (total > UINT32_MAX) {
+			throw Napi::RangeError::New(env, "combined capture size too large");
+		}
+	}
+	offsets[rects.size()] = (uint32_t)total;
+
+	auto buffer = Napi::ArrayBuffer::New(env, total);
+	vector<CaptureRect> capts;
+	capts.reserve(rects.size());
+	for (size_t i = 0; i < rects.size(); i++) {
+		capts.push_back(CaptureRect((byte*)buffer.Data() + offsets[i], CaptureSize(rects[i], scale), rects[i], scale));
+	}
+	OSCaptureMulti(wnd, captmode, capts, env);
+
+	auto ret = Napi::Object::New(env);
+	ret.Set("data", Napi::Uint8Array::New(env, total, buffer, 0, napi_uint8_clamped_array));
+	ret.Set("offsets", offsets);
+	return ret;
+}
+
+Napi::Value CaptureWindowMulti(const Napi::CallbackInfo& info) {
+	auto env = info.Env();
+	auto wnd = OSWindow::FromJsValue(info[0]);
+	auto captmode = CaptureModeFromJsValue(info[1]);
+	//optional downscale factor, the output of each rect is ceil(width/scale) by ceil(height/scale)
+	int scale = CaptureScaleFromJsValue(info[3]);
+
+	if (info[2].IsTypedArray()) {
+		return CaptureWindowMultiPacked(env, wnd, captmode, info[2], scale);
 	}
 
 	//convert the capture rect object to c++
@@ -53,14 +125,11 @@ Napi::Value CaptureWindowMulti(const Napi::CallbackInfo& info) {
 		auto val = obj.Get(key);
 		if (val.IsNull() || val.IsUndefined()) { continue; }
 		auto rect = JSRectangle::FromJsValue(val);
-		if (rect.width <= 0 || rect.height <= 0 || rect.width > 1e4 || rect.height > 1e4)
-		{
-			throw Napi::TypeError::New(env, "invalid capture size");
-		}
+		ValidateCaptureRect(env, rect);
 
-		size_t size = (size_t)rect.width * rect.height * 4;
+		size_t size = CaptureSize(rect, scale);
 		auto buffer = Napi::ArrayBuffer::New(env, size);
-		CaptureRect capt(buffer.Data(), buffer.ByteLength(), rect);
+		CaptureRect capt(buffer.Data(), buffer.ByteLength(), rect, scale);
 		auto view = Napi::Uint8Array::New(env, size, buffer, 0, napi_uint8_clamped_array);
 		ret.Set(key, view);
 		capts.push_back(capt);
@@ -77,9 +146,66 @@ Napi::Value GetRsHandles(const Napi::CallbackInfo& info) {
 }
 
 Napi::Value JSGetActiveWindow(const Napi::CallbackInfo& info) { return OSGetActiveWindow().ToJS(info.Env()); }
-Napi::Value GetWindowBounds(const Napi::CallbackInfo& info) { return OSWindow::FromJsValue(info[0]).GetBounds().ToJs(info.Env()); }
-Napi::Value GetClientBounds(const Napi::CallbackInfo& info) { return OSWindow::FromJsValue(info[0]).GetClientBounds().ToJs(info.Env()); }
+//bounds of a list of windows as one packed Int32Array of [x,y,width,height] quads
+template<typename F>
+Napi::Value GetBoundsPacked(const Napi::Value& val, F getbounds) {
+	auto arr = val.As<Napi::Array>();
+	vector<JSRectangle> rects(arr.Length());
+	for (uint32_t i = 0; i < arr.Length(); i++) {
+		rects[i] = getbounds(OSWindow::FromJsValue(arr[i]));
+	}
+	return JSRectangle::ToPackedArray(val.Env(), rects);
+}
+
+Napi::Value GetWindowBounds(const Napi::CallbackInfo& info) {
+	if (info[0].IsArray()) { return GetBoundsPacked(info[0], [](OSWindow wnd) {return wnd.GetBounds(); }); }
+	return OSWindow::FromJsValue(info[0]).GetBounds().ToJs(info.Env());
+}
+Napi::Value GetClientBounds(const Napi::CallbackInfo& info) {
+	if (info[0].IsArray()) { return GetBoundsPacked(info[0], [](OSWindow wnd) {return wnd.GetClientBounds(); }); }
+	return OSWindow::FromJsValue(info[0]).GetClientBounds().ToJs(info.Env());
+}
 Napi::Value GetWindowTitle(const Napi::CallbackInfo& info) { return Napi::String::New(info.Env(), OSWindow::FromJsValue(info[0]).GetTitle()); }
+
+//async versions of the window queries above, they resolve on the js thread once the query thread answered them
+Napi::Value GetRsHandlesAsync(const Napi::CallbackInfo& info) {
+	return QueueWindowQueries(info.Env(), { WindowQuery(WindowQueryType::RsHandles) }, [](Napi::Env env, vector<WindowQuery>& res) {
+		auto& handles = res[0].windows;
+		auto ret = Napi::Array::New(env, handles.size());
+		for (size_t i = 0; i < handles.size(); i++) { ret.Set(i, handles[i].ToJS(env)); }
+		return Napi::Value(ret);
+	});
+}
+
+Napi::Value QueueBoundsQueries(const Napi::CallbackInfo& info, WindowQueryType type) {
+	vector<WindowQuery> queries;
+	if (!info[0].IsArray()) {
+		queries.push_back(WindowQuery(type, OSWindow::FromJsValue(info[0])));
+		return QueueWindowQueries(info.Env(), queries, [](Napi::Env env, vector<WindowQuery>& res) { return res[0].rect.ToJs(env); });
+	}
+	auto arr = info[0].As<Napi::Array>();
+	for (uint32_t i = 0; i < arr.Length(); i++) {
+		queries.push_back(WindowQuery(type, OSWindow::FromJsValue(arr[i])));
+	}
+	return QueueWindowQueries(info.Env(), queries, [](Napi::Env env, vector<WindowQuery>& res) {
+		vector<JSRectangle> rects;
+		rects.reserve(res.size());
+		for (auto& query : res) { rects.push_back(query.rect); }
+		return JSRectangle::ToPackedArray(env, rects);
+	});
+}
+Napi::Value GetWindowBoundsAsync(const Napi::CallbackInfo& info) { return QueueBoundsQueries(info, WindowQueryType::Bounds); }
+Napi::Value GetClientBoundsAsync(const Napi::CallbackInfo& info) { return QueueBoundsQueries(info, WindowQueryType::ClientBounds); }
+Napi::Value GetWindowTitleAsync(const Napi::CallbackInfo& info) {
+	return QueueWindowQueries(info.Env(), { WindowQuery(WindowQueryType::Title, OSWindow::FromJsValue(info[0])) }, [](Napi::Env env, vector<WindowQuery>& res) {
+		return Napi::Value(Napi::String::New(env, res[0].title));
+	});
+}
+Napi::Value GetActiveWindowAsync(const Napi::CallbackInfo& info) {
+	return QueueWindowQueries(info.Env(), { WindowQuery(WindowQueryType::ActiveWindow) }, [](Napi::Env env, vector<WindowQuery>& res) {
+		return res[0].window.ToJS(env);
+	});
+}
 Napi::Value GetMouseState(const Napi::CallbackInfo& info) { return Napi::Boolean::New(info.Env(), OSGetMouseState()); }
 
 void SetWindowParent(const Napi::CallbackInfo& info) {
@@ -90,18 +216,901 @@ void SetWindowParent(const Napi::CallbackInfo& info) {
 
 void SetWindowShape(const Napi::CallbackInfo& info) {
 #ifdef OS_LINUX
-	auto arr = info[1].As<Napi::Array>();
 	std::vector<JSRectangle> rects;
-	rects.reserve(arr.Length());
-	for (uint32_t i = 0; i < arr.Length(); i++) {
-		rects.push_back(JSRectangle::FromJsValue(arr[i]));
+	if (info[1].IsTypedArray()) {
+		rects = JSRectangle::FromPackedArray(info[1]);
+	} else {
+		auto arr = info[1].As<Napi::Array>();
+		rects.reserve(arr.Length());
+		for (uint32_t i = 0; i < arr.Length(); i++) {
+			rects.push_back(JSRectangle::FromJsValue(arr[i]));
+		}
 	}
-	OSSetWindowShape(OSWindow::FromJsValue(info[0]), rects);
+	OSSetWindowShape(OSWindow::FromJsValue(info[0]), ShapeRegion::FromRects(rects));
 #else
 	throw Napi::Error::New(info.Env(), "SetWindowShape is not implemented on this operating system");
 #endif
 }
 
+//sets the clickable region of a window to all pixels in an ImageData-like mask with alpha >= threshold
+void SetWindowShapeMask(const Napi::CallbackInfo& info) {
+#ifdef OS_LINUX
+	auto img = JSImageView::FromJsValue(info[1]);
+	byte threshold = (info[2].IsNumber() ? (byte)info[2].As<Napi::Number>().Uint32Value() : 1);
+	OSSetWindowShape(OSWindow::FromJsValue(info[0]), ShapeRegion::FromAlphaMask(img.data, img.width, img.height, img.stride, threshold));
+#else
+	throw Napi::Error::New(info.Env(), "SetWindowShapeMask is not implemented on this operating system");
+#endif
+}
+
+const std::map<std::string, OverlayCommandType> overlayCommandTypes = {
+	{"draw",OverlayCommandType::Draw},
+	{"setgroup",OverlayCommandType::SetGroup},
+	{"cleargroup",OverlayCommandType::ClearGroup},
+	{"freezegroup",OverlayCommandType::FreezeGroup},
+	{"continuegroup",OverlayCommandType::ContinueGroup},
+	{"refreshgroup",OverlayCommandType::RefreshGroup},
+	{"setgroupzindex",OverlayCommandType::SetGroupZIndex}
+};
+
+const std::map<std::string, OverlayPrimitiveType> overlayPrimitiveTypes = {
+	{"line",OverlayPrimitiveType::Line},
+	{"rect",OverlayPrimitiveType::Rect},
+	{"text",OverlayPrimitiveType::Text},
+	{"sprite",OverlayPrimitiveType::Sprite}
+};
+
+int OptionalInt(const Napi::Object& obj, const char* key, int fallback = 0) {
+	auto val = obj.Get(key);
+	return (val.IsNumber() ? val.As<Napi::Number>().Int32Value() : fallback);
+}
+
+//converts the OverlayCommand type from src/shared.ts
+OverlayCommand OverlayCommandFromJsValue(const Napi::Value& val) {
+	auto env = val.Env();
+	auto obj = val.As<Napi::Object>();
+	OverlayCommand command;
+	auto commandtype = overlayCommandTypes.find(obj.Get("command").As<Napi::String>().Utf8Value());
+	if (commandtype == overlayCommandTypes.end()) {
+		throw Napi::RangeError::New(env, "unknown overlay command");
+	}
+	command.type = commandtype->second;
+	if (command.type != OverlayCommandType::Draw) {
+		command.groupid = obj.Get("groupid").As<Napi::String>().Utf8Value();
+		command.zindex = OptionalInt(obj, "zindex");
+		return command;
+	}
+
+	command.time = OptionalInt(obj, "time");
+	auto action = obj.Get("action").As<Napi::Object>();
+	auto& prim = command.action;
+	auto primtype = overlayPrimitiveTypes.find(action.Get("type").As<Napi::String>().Utf8Value());
+	if (primtype == overlayPrimitiveTypes.end()) {
+		throw Napi::RangeError::New(env, "unknown overlay primitive");
+	}
+	prim.type = primtype->second;
+	prim.color = (uint32_t)OptionalInt(action, "color");
+	prim.linewidth = OptionalInt(action, "linewidth", 1);
+	prim.x = OptionalInt(action, "x");
+	prim.y = OptionalInt(action, "y");
+	switch (prim.type) {
+	case OverlayPrimitiveType::Line:
+		prim.x1 = OptionalInt(action, "x1");
+		prim.y1 = OptionalInt(action, "y1");
+		prim.x2 = OptionalInt(action, "x2");
+		prim.y2 = OptionalInt(action, "y2");
+		break;
+	case OverlayPrimitiveType::Rect:
+		prim.width = OptionalInt(action, "width");
+		prim.height = OptionalInt(action, "height");
+		break;
+	case OverlayPrimitiveType::Text:
+		prim.size = OptionalInt(action, "size", 12);
+		prim.text = action.Get("text").As<Napi::String>().Utf8Value();
+		prim.font = (action.Get("font").IsString() ? action.Get("font").As<Napi::String>().Utf8Value() : "");
+		prim.shadow = action.Get("shadow").ToBoolean();
+		prim.center = action.Get("center").ToBoolean();
+		break;
+	case OverlayPrimitiveType::Sprite: {
+		auto img = JSImageView::FromJsValue(action.Get("sprite"));
+		prim.width = img.width;
+		prim.height = img.height;
+		prim.sprite.assign(img.data, img.data + (size_t)img.width * img.height * 4);
+		break;
+	}
+	}
+	return command;
+}
+
+void OverlayCommands(const Napi::CallbackInfo& info) {
+#ifdef OS_LINUX
+	auto wnd = OSWindow::FromJsValue(info[0]);
+	int frameid = info[1].As<Napi::Number>().Int32Value();
+	auto arr = info[2].As<Napi::Array>();
+	vector<OverlayCommand> commands;
+	commands.reserve(arr.Length());
+	for (uint32_t i = 0; i < arr.Length(); i++) {
+		commands.push_back(OverlayCommandFromJsValue(arr[i]));
+	}
+	OSOverlayCommands(wnd, frameid, std::move(commands));
+#else
+	throw Napi::Error::New(info.Env(), "OverlayCommands is not implemented on this operating system");
+#endif
+}
+
+void OverlayCloseFrame(const Napi::CallbackInfo& info) {
+#ifdef OS_LINUX
+	OSOverlayCloseFrame(OSWindow::FromJsValue(info[0]), info[1].As<Napi::Number>().Int32Value());
+#else
+	throw Napi::Error::New(info.Env(), "OverlayCloseFrame is not implemented on this operating system");
+#endif
+}
+
+Napi::Value GetProcessStats(const Napi::CallbackInfo& info) {
+#ifdef OS_LINUX
+	auto env = info.Env();
+	auto stats = OSGetProcessStats(OSWindow::FromJsValue(info[0]));
+	if (stats.pid == 0) {
+		return env.Null();
+	}
+	auto ret = Napi::Object::New(env);
+	ret.Set("pid", stats.pid);
+	ret.Set("cpu", stats.cpuValid ? Napi::Number::New(env, stats.cpu) : env.Null());
+	ret.Set("rss", (double)stats.rss);
+	ret.Set("threads", stats.threads);
+	return ret;
+#else
+	throw Napi::Error::New(info.Env(), "GetProcessStats is not implemented on this operating system");
+#endif
+}
+
+Napi::Value GetMonitors(const Napi::CallbackInfo& info) {
+#ifdef OS_LINUX
+	auto env = info.Env();
+	auto monitors = OSGetMonitors();
+	auto ret = Napi::Array::New(env, monitors.size());
+	for (size_t i = 0; i < monitors.size(); i++) {
+		auto obj = monitors[i].bounds.ToJs(env);
+		obj.Set("mmwidth", monitors[i].mmWidth);
+		obj.Set("mmheight", monitors[i].mmHeight);
+		obj.Set("primary", monitors[i].primary);
+		obj.Set("name", monitors[i].name);
+		obj.Set("scale", monitors[i].scale);
+		ret.Set(i, obj);
+	}
+	return ret;
+#else
+	throw Napi::Error::New(info.Env(), "GetMonitors is not implemented on this operating system");
+#endif
+}
+
+//ImageData-like image of the mouse cursor with its hotspot and serial, null if the cursor still has the given serial
+Napi::Value GetCursorImage(const Napi::CallbackInfo& info) {
+#ifdef OS_LINUX
+	auto env = info.Env();
+	uint32_t known = (info[0].IsNumber() ? info[0].As<Napi::Number>().Uint32Value() : 0);
+	OSCursorImage cursor;
+	if (!OSGetCursorImage(known, cursor)) {
+		return env.Null();
+	}
+	auto ret = Napi::Object::New(env);
+	auto data = Napi::Uint8Array::New(env, cursor.pixels.size(), napi_uint8_clamped_array);
+	if (!cursor.pixels.empty()) {
+		memcpy(data.Data(), cursor.pixels.data(), cursor.pixels.size());
+	}
+	ret.Set("data", data);
+	ret.Set("width", cursor.width);
+	ret.Set("height", cursor.height);
+	ret.Set("hotx", cursor.hotX);
+	ret.Set("hoty", cursor.hotY);
+	ret.Set("serial", cursor.serial);
+	return ret;
+#else
+	throw Napi::Error::New(info.Env(), "GetCursorImage is not implemented on this operating system");
+#endif
+}
+
+PixelPredicate PixelPredicateFromJsValue(const Napi::Value& val) {
+	auto env = val.Env();
+	auto obj = val.As<Napi::Object>();
+	PixelPredicate pred;
+	pred.rect = JSRectangle(OptionalInt(obj, "x"), OptionalInt(obj, "y"), OptionalInt(obj, "width", 1), OptionalInt(obj, "height", 1));
+	if (pred.rect.width < 1 || pred.rect.height < 1 || pred.rect.width > 4096 || pred.rect.height > 4096) {
+		throw Napi::RangeError::New(env, "predicate size should be between 1 and 4096");
+	}
+	auto type = obj.Get("type").As<Napi::String>().Utf8Value();
+	if (type == "color") {
+		pred.type = PixelPredicateType::Color;
+		auto col = obj.Get("color").As<Napi::Array>();
+		pred.r = (byte)col.Get(0u).As<Napi::Number>().Uint32Value();
+		pred.g = (byte)col.Get(1u).As<Napi::Number>().Uint32Value();
+		pred.b = (byte)col.Get(2u).As<Napi::Number>().Uint32Value();
+		pred.tolerance = (byte)std::min(std::max(OptionalInt(obj, "tolerance"), 0), 255);
+	} else if (type == "brightness") {
+		pred.type = PixelPredicateType::Brightness;
+		pred.threshold = OptionalInt(obj, "threshold", pred.threshold);
+		pred.below = obj.Get("below").ToBoolean();
+	} else if (type == "hash") {
+		pred.type = PixelPredicateType::Hash;
+	} else {
+		throw Napi::RangeError::New(env, "unknown pixel predicate type");
+	}
+	return pred;
+}
+
+//evaluates the predicates natively every time new window content arrives, cb gets the indices of the predicates that fired
+//returns a watch id for pixelWatchRemove
+Napi::Value PixelWatchAdd(const Napi::CallbackInfo& info) {
+#ifdef OS_LINUX
+	auto env = info.Env();
+	auto wnd = OSWindow::FromJsValue(info[0]);
+	auto arr = info[1].As<Napi::Array>();
+	if (arr.Length() == 0 || arr.Length() > 256) {
+		throw Napi::RangeError::New(env, "a pixel watch needs between 1 and 256 predicates");
+	}
+	std::vector<PixelPredicate> predicates;
+	for (uint32_t i = 0; i < arr.Length(); i++) {
+		predicates.push_back(PixelPredicateFromJsValue(arr.Get(i)));
+	}
+	auto cb = info[2].As<Napi::Function>();
+	int interval = (info[3].IsObject() ? OptionalInt(info[3].As<Napi::Object>(), "interval", 50) : 50);
+	if (interval < 0) {
+		throw Napi::RangeError::New(env, "interval can't be negative");
+	}
+	return Napi::Number::New(env, OSAddPixelWatch(wnd, std::move(predicates), interval, cb));
+#else
+	throw Napi::Error::New(info.Env(), "PixelWatchAdd is not implemented on this operating system");
+#endif
+}
+
+void PixelWatchRemove(const Napi::CallbackInfo& info) {
+#ifdef OS_LINUX
+	OSRemovePixelWatch(info[0].As<Napi::Number>().Int32Value());
+#else
+	throw Napi::Error::New(info.Env(), "PixelWatchRemove is not implemented on this operating system");
+#endif
+}
+
+FrameDiffOptions FrameDiffOptionsFromJsValue(const Napi::Value& val) {
+	FrameDiffOptions opts;
+	if (!val.IsObject()) { return opts; }
+	auto obj = val.As<Napi::Object>();
+	auto tolerance = obj.Get("tolerance");
+	if (tolerance.IsNumber()) { opts.tolerance = (byte)std::min(tolerance.As<Napi::Number>().Uint32Value(), 255u); }
+	auto tile = obj.Get("tile");
+	if (tile.IsNumber()) {
+		opts.tilesize = tile.As<Napi::Number>().Int32Value();
+		if (opts.tilesize < 1 || opts.tilesize > 1024) { throw Napi::RangeError::New(val.Env(), "tile size should be between 1 and 1024"); }
+	}
+	return opts;
+}
+
+//changed areas between two ImageData-like images as a packed Int32Array
+Napi::Value JSDiffFrames(const Napi::CallbackInfo& info) {
+	auto a = JSImageView::FromJsValue(info[0]);
+	auto b = JSImageView::FromJsValue(info[1]);
+	if (a.width != b.width || a.height != b.height) {
+		throw Napi::RangeError::New(info.Env(), "images should have the same size");
+	}
+	return JSRectangle::ToPackedArray(info.Env(), DiffFrames(a, b, FrameDiffOptionsFromJsValue(info[2])));
+}
+
+//changed areas of an image compared to the previous image passed with the same stream id
+Napi::Value DiffStream(const Napi::CallbackInfo& info) {
+	auto inst = info.Env().GetInstanceData<PluginInstance>();
+	auto id = info[0].As<Napi::String>().Utf8Value();
+	auto& stream = inst->diffStreams[id];
+	if (!stream) { stream = std::make_shared<FrameDiffStream>(); }
+	auto frame = JSImageView::FromJsValue(info[1]);
+	return JSRectangle::ToPackedArray(info.Env(), stream->Push(frame, FrameDiffOptionsFromJsValue(info[2])));
+}
+
+void DiffStreamClose(const Napi::CallbackInfo& info) {
+	auto inst = info.Env().GetInstanceData<PluginInstance>();
+	inst->diffStreams.erase(info[0].As<Napi::String>().Utf8Value());
+}
+
+Napi::Object OwnedImageToJs(Napi::Env env, const OwnedImage& img) {
+	auto ret = Napi::Object::New(env);
+	auto data = Napi::Uint8Array::New(env, img.data.size(), napi_uint8_clamped_array);
+	if (!img.data.empty()) {
+		memcpy(data.Data(), img.data.data(), img.data.size());
+	}
+	ret.Set("data", data);
+	ret.Set("width", img.width);
+	ret.Set("height", img.height);
+	return ret;
+}
+
+//builds a pyramid of successive half size images and keeps it under the given id for nccMatchPyramid
+//returns the level count, levels are only copied to js when asked for with pyramidLevel
+Napi::Value PyramidBuild(const Napi::CallbackInfo& info) {
+	auto env = info.Env();
+	auto inst = env.GetInstanceData<PluginInstance>();
+	auto id = info[0].As<Napi::String>().Utf8Value();
+	auto img = JSImageView::FromJsValue(info[1]);
+	int levels = (info[2].IsNumber() ? info[2].As<Napi::Number>().Int32Value() : 4);
+	if (levels < 1 || levels > 16) {
+		throw Napi::RangeError::New(env, "pyramid level count should be between 1 and 16");
+	}
+	auto pyramid = std::make_shared<ImagePyramid>();
+	pyramid->Build(img, levels);
+	inst->pyramids[id] = pyramid;
+	return Napi::Number::New(env, (double)pyramid->LevelCount());
+}
+
+Napi::Value PyramidLevel(const Napi::CallbackInfo& info) {
+	auto env = info.Env();
+	auto inst = env.GetInstanceData<PluginInstance>();
+	auto pyramid = inst->pyramids.find(info[0].As<Napi::String>().Utf8Value());
+	uint32_t level = info[1].As<Napi::Number>().Uint32Value();
+	if (pyramid == inst->pyramids.end() || level >= pyramid->second->LevelCount()) {
+		return env.Null();
+	}
+	return OwnedImageToJs(env, pyramid->second->Level(level));
+}
+
+void PyramidClose(const Napi::CallbackInfo& info) {
+	auto inst = info.Env().GetInstanceData<PluginInstance>();
+	inst->pyramids.erase(info[0].As<Napi::String>().Utf8Value());
+}
+
+ComponentOptions ComponentOptionsFromJsValue(const Napi::Value& val) {
+	ComponentOptions opts;
+	if (!val.IsObject()) { return opts; }
+	auto obj = val.As<Napi::Object>();
+	auto colors = obj.Get("colors");
+	if (colors.IsArray()) {
+		auto arr = colors.As<Napi::Array>();
+		for (uint32_t i = 0; i < arr.Length(); i++) {
+			auto color = arr.Get(i).As<Napi::Object>();
+			ComponentColorClass cls;
+			cls.r = (byte)color.Get("r").As<Napi::Number>().Uint32Value();
+			cls.g = (byte)color.Get("g").As<Napi::Number>().Uint32Value();
+			cls.b = (byte)color.Get("b").As<Napi::Number>().Uint32Value();
+			cls.tolerance = (byte)OptionalInt(color, "tolerance", 0);
+			opts.classes.push_back(cls);
+		}
+	}
+	opts.diagonal = obj.Get("diagonal").ToBoolean();
+	opts.minArea = OptionalInt(obj, "minArea", opts.minArea);
+	opts.maxArea = OptionalInt(obj, "maxArea", opts.maxArea);
+	opts.minWidth = OptionalInt(obj, "minWidth", opts.minWidth);
+	opts.maxWidth = OptionalInt(obj, "maxWidth", opts.maxWidth);
+	opts.minHeight = OptionalInt(obj, "minHeight", opts.minHeight);
+	opts.maxHeight = OptionalInt(obj, "maxHeight", opts.maxHeight);
+	int maxCount = OptionalInt(obj, "maxCount", (int)opts.maxCount);
+	if (maxCount < 1) {
+		throw Napi::RangeError::New(val.Env(), "maxCount should be at least 1");
+	}
+	opts.maxCount = maxCount;
+	return opts;
+}
+
+//blobs of pixels with the same color class, returns [{x,y,width,height,area,cx,cy,colorclass}]
+Napi::Value JSFindComponents(const Napi::CallbackInfo& info) {
+	auto env = info.Env();
+	auto img = JSImageView::FromJsValue(info[0]);
+	auto opts = ComponentOptionsFromJsValue(info[1]);
+	if (opts.classes.size() > 256) {
+		throw Napi::RangeError::New(env, "too many color classes");
+	}
+	auto components = FindComponents(img, opts);
+	auto ret = Napi::Array::New(env, components.size());
+	for (size_t i = 0; i < components.size(); i++) {
+		auto& comp = components[i];
+		auto obj = comp.bounds.ToJs(env);
+		obj.Set("area", comp.area);
+		obj.Set("cx", comp.cx);
+		obj.Set("cy", comp.cy);
+		obj.Set("colorclass", comp.colorclass);
+		ret.Set(i, obj);
+	}
+	return ret;
+}
+
+IconIndex& GetIconIndex(Napi::Env env, const Napi::Value& id) {
+	auto inst = env.GetInstanceData<PluginInstance>();
+	auto& index = inst->iconIndexes[id.As<Napi::String>().Utf8Value()];
+	if (!index) { index = std::make_shared<IconIndex>(); }
+	return *index;
+}
+
+//adds a reference icon to the index with the given id, the index is created on first use
+Napi::Value IconIndexAdd(const Napi::CallbackInfo& info) {
+	auto& index = GetIconIndex(info.Env(), info[0]);
+	auto key = info[1].As<Napi::String>().Utf8Value();
+	auto img = JSImageView::FromJsValue(info[2]);
+	if (img.width == 0 || img.height == 0) {
+		throw Napi::RangeError::New(info.Env(), "icon is empty");
+	}
+	return Napi::Number::New(info.Env(), index.Add(key, img));
+}
+
+Napi::Array IconMatchesToJs(Napi::Env env, IconIndex& index, const vector<IconMatch>& matches) {
+	auto ret = Napi::Array::New(env, matches.size());
+	for (size_t i = 0; i < matches.size(); i++) {
+		auto obj = Napi::Object::New(env);
+		obj.Set("key", index.Key(matches[i].id));
+		obj.Set("id", matches[i].id);
+		obj.Set("distance", matches[i].distance);
+		obj.Set("colordistance", matches[i].colorDistance);
+		obj.Set("verified", matches[i].verified);
+		ret.Set(i, obj);
+	}
+	return ret;
+}
+
+//nearest reference icons of an image, or of every rect of a packed rect list inside the image
+Napi::Value IconIndexQuery(const Napi::CallbackInfo& info) {
+	auto env = info.Env();
+	auto& index = GetIconIndex(env, info[0]);
+	auto img = JSImageView::FromJsValue(info[1]);
+	IconQueryOptions opts;
+	if (info[2].IsObject()) {
+		auto obj = info[2].As<Napi::Object>();
+		opts.maxDistance = OptionalInt(obj, "maxDistance", opts.maxDistance);
+		//larger distances would silently turn every query into a scan of the whole index
+		if (opts.maxDistance < 0 || opts.maxDistance >= IconQueryOptions::distanceLimit) {
+			throw Napi::RangeError::New(env, "maxDistance should be between 0 and " + std::to_string(IconQueryOptions::distanceLimit - 1));
+		}
+		opts.count = std::max(OptionalInt(obj, "count", (int)opts.count), 0);
+		opts.verify = obj.Get("verify").ToBoolean();
+		opts.verifyTolerance = (byte)OptionalInt(obj, "verifyTolerance", 0);
+		auto weight = obj.Get("colorWeight");
+		if (weight.IsNumber()) { opts.colorWeight = weight.As<Napi::Number>().DoubleValue(); }
+	}
+	if (!info[3].IsTypedArray()) {
+		return IconMatchesToJs(env, index, index.Query(img, opts));
+	}
+	auto rects = JSRectangle::FromPackedArray(info[3]);
+	auto ret = Napi::Array::New(env, rects.size());
+	for (size_t i = 0; i < rects.size(); i++) {
+		if (!img.Contains(rects[i])) {
+			throw Napi::RangeError::New(env, "query rect is outside of the image");
+		}
+		ret.Set(i, IconMatchesToJs(env, index, index.Query(img.Sub(rects[i]), opts)));
+	}
+	return ret;
+}
+
+void IconIndexClose(const Napi::CallbackInfo& info) {
+	auto inst = info.Env().GetInstanceData<PluginInstance>();
+	inst->iconIndexes.erase(info[0].As<Napi::String>().Utf8Value());
+}
+
+//process wide, every environment uses the same mapping of a pack
+std::mutex assetPacksMutex;
+std::map<std::string, std::weak_ptr<AssetPack>> assetPacks;
+
+//view of pack memory, the mapping is kept alive until the js buffer is collected. Writes copy the page, they are
+//visible to every load of the same pack in this process but never reach the file
+Napi::ArrayBuffer AssetPackBuffer(Napi::Env env, const std::shared_ptr<AssetPack>& pack, uint32_t offset, size_t size) {
+	auto hint = new std::shared_ptr<AssetPack>(pack);
+	try {
+		return Napi::ArrayBuffer::New(env, (void*)pack->Data(offset), size, [](Napi::Env, void*, std::shared_ptr<AssetPack>* hint) {delete hint; }, hint);
+	} catch (const Napi::Error&) {
+		//runtimes with a v8 sandbox don't allow external buffers, fall back to a copy
+		delete hint;
+		auto buffer = Napi::ArrayBuffer::New(env, size);
+		memcpy(buffer.Data(), pack->Data(offset), size);
+		return buffer;
+	}
+}
+
+//maps a reader asset pack and returns {images:{[name]:ImageData-like}, fonts:{[name]:FontDefinition}} backed by the mapped file
+Napi::Value LoadAssetPack(const Napi::CallbackInfo& info) {
+	auto env = info.Env();
+	auto path = info[0].As<Napi::String>().Utf8Value();
+	std::shared_ptr<AssetPack> pack;
+	{
+		std::lock_guard<std::mutex> lock(assetPacksMutex);
+		pack = assetPacks[path].lock();
+		if (!pack) {
+			std::string error;
+			pack = AssetPack::Open(path, error);
+			if (!pack) {
+				throw Napi::Error::New(env, error);
+			}
+			assetPacks[path] = pack;
+		}
+	}
+
+	auto images = Napi::Object::New(env);
+	auto fonts = Napi::Object::New(env);
+	for (uint32_t i = 0; i < pack->EntryCount(); i++) {
+		auto& entry = pack->Entry(i);
+		if (entry.kind == AssetKind::Image) {
+			size_t size = (size_t)entry.image.width * entry.image.height * 4;
+			auto img = Napi::Object::New(env);
+			img.Set("data", Napi::Uint8Array::New(env, size, AssetPackBuffer(env, pack, entry.dataoffset, size), 0, napi_uint8_clamped_array));
+			img.Set("width", entry.image.width);
+			img.Set("height", entry.image.height);
+			images.Set(pack->Name(entry), img);
+		} else if (entry.kind == AssetKind::Font) {
+			auto font = Napi::Object::New(env);
+			font.Set("width", entry.font.width);
+			font.Set("spacewidth", entry.font.spacewidth);
+			font.Set("shadow", entry.font.shadow != 0);
+			font.Set("height", entry.font.height);
+			font.Set("basey", entry.font.basey);
+			if (entry.font.maxspaces != UINT32_MAX) { font.Set("maxspaces", entry.font.maxspaces); }
+			if (entry.font.minrating == entry.font.minrating) { font.Set("minrating", entry.font.minrating); }
+			//one buffer over the whole font blob, glyph pixels are views into it
+			auto glyphs = pack->Glyphs(entry);
+			auto blob = AssetPackBuffer(env, pack, entry.dataoffset, entry.datasize);
+			auto chars = Napi::Array::New(env, entry.font.charcount);
+			for (uint32_t j = 0; j < entry.font.charcount; j++) {
+				auto& glyph = glyphs[j];
+				auto chr = Napi::Object::New(env);
+				chr.Set("chr", Napi::String::New(env, std::u16string(1, (char16_t)glyph.chr)));
+				chr.Set("width", glyph.width);
+				chr.Set("bonus", glyph.bonus);
+				chr.Set("secondary", glyph.secondary != 0);
+				if (glyph.pixeloffset >= entry.dataoffset && glyph.pixeloffset + (size_t)glyph.pixelcount * 4 <= (size_t)entry.dataoffset + entry.datasize) {
+					chr.Set("pixels", Napi::Float32Array::New(env, glyph.pixelcount, blob, glyph.pixeloffset - entry.dataoffset));
+				} else {
+					chr.Set("pixels", Napi::Float32Array::New(env, 0));
+				}
+				chars.Set(j, chr);
+			}
+			font.Set("chars", chars);
+			fonts.Set(pack->Name(entry), font);
+		}
+	}
+	auto ret = Napi::Object::New(env);
+	ret.Set("images", images);
+	ret.Set("fonts", fonts);
+	return ret;
+}
+
+//builds the luma and summed-area tables of an image and keeps them under the given id for nccMatch
+void IntegralBuild(const Napi::CallbackInfo& info) {
+	auto inst = info.Env().GetInstanceData<PluginInstance>();
+	auto id = info[0].As<Napi::String>().Utf8Value();
+	auto integral = std::make_shared<IntegralImage>();
+	integral->Build(JSImageView::FromJsValue(info[1]));
+	inst->integrals[id] = integral;
+}
+
+void IntegralClose(const Napi::CallbackInfo& info) {
+	auto inst = info.Env().GetInstanceData<PluginInstance>();
+	inst->integrals.erase(info[0].As<Napi::String>().Utf8Value());
+}
+
+//haystack can be the id of a previously built integral image or an ImageData-like image, which is built into temp
+//in the scratch memory of the caller and only lives for this call
+const IntegralImage& IntegralFromJsValue(const Napi::Value& val, IntegralImage& temp, ScratchScope& scratch) {
+	auto env = val.Env();
+	if (val.IsString()) {
+		auto inst = env.GetInstanceData<PluginInstance>();
+		auto integral = inst->integrals.find(val.As<Napi::String>().Utf8Value());
+		if (integral == inst->integrals.end()) {
+			throw Napi::Error::New(env, "unknown integral image id");
+		}
+		return *integral->second;
+	}
+	temp.Build(JSImageView::FromJsValue(val), scratch);
+	return temp;
+}
+
+NccOptions NccOptionsFromJsValue(const Napi::Value& val) {
+	NccOptions opts;
+	if (!val.IsObject()) { return opts; }
+	auto obj = val.As<Napi::Object>();
+	auto threshold = obj.Get("threshold");
+	if (threshold.IsNumber()) { opts.threshold = threshold.As<Napi::Number>().DoubleValue(); }
+	opts.count = std::max(OptionalInt(obj, "count", (int)opts.count), 0);
+	auto area = obj.Get("area");
+	if (area.IsObject()) { opts.area = JSRectangle::FromJsValue(area); }
+	return opts;
+}
+
+Napi::Array NccMatchesToJs(Napi::Env env, const vector<NccMatch>& matches) {
+	auto ret = Napi::Array::New(env, matches.size());
+	for (size_t i = 0; i < matches.size(); i++) {
+		auto obj = Napi::Object::New(env);
+		obj.Set("x", matches[i].x);
+		obj.Set("y", matches[i].y);
+		obj.Set("score", matches[i].score);
+		ret.Set(i, obj);
+	}
+	return ret;
+}
+
+//normalized cross-correlation matches of needle in haystack, returns [{x,y,score}] best first
+Napi::Value JSNccMatch(const Napi::CallbackInfo& info) {
+	auto env = info.Env();
+	ScratchScope scratch;
+	IntegralImage temp;
+	auto& haystack = IntegralFromJsValue(info[0], temp, scratch);
+	NccNeedle needle(JSImageView::FromJsValue(info[1]), scratch);
+	if (!needle.HasContrast()) {
+		throw Napi::RangeError::New(env, "needle has no contrast");
+	}
+	return NccMatchesToJs(env, MatchNcc(haystack, needle, NccOptionsFromJsValue(info[2])));
+}
+
+//nccMatch against level 0 of a pyramid from pyramidBuild, searched coarse-to-fine
+Napi::Value NccMatchPyramid(const Napi::CallbackInfo& info) {
+	auto env = info.Env();
+	auto inst = env.GetInstanceData<PluginInstance>();
+	auto pyramid = inst->pyramids.find(info[0].As<Napi::String>().Utf8Value());
+	if (pyramid == inst->pyramids.end()) {
+		throw Napi::Error::New(env, "unknown pyramid id");
+	}
+	auto img = JSImageView::FromJsValue(info[1]);
+	ScratchScope scratch;
+	if (!NccNeedle(img, scratch).HasContrast()) {
+		throw Napi::RangeError::New(env, "needle has no contrast");
+	}
+	return NccMatchesToJs(env, MatchNccPyramid(*pyramid->second, img, NccOptionsFromJsValue(info[2])));
+}
+
+//renders a needle at every given scale factor and keeps the set under the given id for nccMatchScaled
+void NccNeedleBuild(const Napi::CallbackInfo& info) {
+	auto env = info.Env();
+	auto inst = env.GetInstanceData<PluginInstance>();
+	auto id = info[0].As<Napi::String>().Utf8Value();
+	auto img = JSImageView::FromJsValue(info[1]);
+	auto arr = info[2].As<Napi::Array>();
+	vector<double> scales;
+	for (uint32_t i = 0; i < arr.Length(); i++) {
+		double scale = arr.Get(i).As<Napi::Number>().DoubleValue();
+		if (!(scale > 0 && scale <= 8)) {
+			throw Napi::RangeError::New(env, "needle scale should be between 0 and 8");
+		}
+		scales.push_back(scale);
+	}
+	if (scales.empty() || img.width == 0 || img.height == 0) {
+		throw Napi::RangeError::New(env, "needle set is empty");
+	}
+	ScratchScope scratch;
+	if (!NccNeedle(img, scratch).HasContrast()) {
+		throw Napi::RangeError::New(env, "needle has no contrast");
+	}
+	inst->scaledNeedles[id] = std::make_shared<ScaledNeedleSet>(img, scales);
+}
+
+void NccNeedleClose(const Napi::CallbackInfo& info) {
+	auto inst = info.Env().GetInstanceData<PluginInstance>();
+	auto id = info[0].As<Napi::String>().Utf8Value();
+	inst->scaledNeedles.erase(id);
+	inst->bestScales.erase(id);
+}
+
+//matches of a needle set at all its scales, returns [{x,y,width,height,score,scale}] best first
+//with opts.client the best scale is remembered for that client and searched first next time
+Napi::Value NccMatchScaled(const Napi::CallbackInfo& info) {
+	auto env = info.Env();
+	auto inst = env.GetInstanceData<PluginInstance>();
+	ScratchScope scratch;
+	IntegralImage temp;
+	auto& haystack = IntegralFromJsValue(info[0], temp, scratch);
+	auto needleid = info[1].As<Napi::String>().Utf8Value();
+	auto needles = inst->scaledNeedles.find(needleid);
+	if (needles == inst->scaledNeedles.end()) {
+		throw Napi::Error::New(env, "unknown needle set id");
+	}
+	auto& set = *needles->second;
+	auto opts = NccOptionsFromJsValue(info[2]);
+	std::string client;
+	if (info[2].IsObject()) {
+		auto clientval = info[2].As<Napi::Object>().Get("client");
+		if (clientval.IsString()) { client = clientval.As<Napi::String>().Utf8Value(); }
+	}
+	int preferred = -1;
+	if (!client.empty()) {
+		auto& clients = inst->bestScales[needleid];
+		auto best = clients.find(client);
+		if (best != clients.end()) { preferred = set.IndexOf(best->second); }
+	}
+	auto matches = MatchNccScaled(haystack, set, opts, preferred);
+	if (!client.empty() && !matches.empty()) {
+		inst->bestScales[needleid][client] = set.Scale(matches[0].scaleIndex);
+	}
+	auto ret = Napi::Array::New(env, matches.size());
+	for (size_t i = 0; i < matches.size(); i++) {
+		auto obj = matches[i].rect.ToJs(env);
+		obj.Set("score", matches[i].score);
+		obj.Set("scale", set.Scale(matches[i].scaleIndex));
+		ret.Set(i, obj);
+	}
+	return ret;
+}
+
+//colors are [r,g,b] triplets like the chat colors of @alt1/ocr, with one shared tolerance
+ChatLineOptions ChatLineOptionsFromJsValue(const Napi::Value& val) {
+	auto env = val.Env();
+	ChatLineOptions opts;
+	auto obj = val.As<Napi::Object>();
+	opts.lineheight = OptionalInt(obj, "lineheight", opts.lineheight);
+	if (opts.lineheight < 1 || opts.lineheight > 256) {
+		throw Napi::RangeError::New(env, "line height should be between 1 and 256");
+	}
+	byte tolerance = (byte)std::min(std::max(OptionalInt(obj, "tolerance", 8), 0), 255);
+	auto colors = obj.Get("colors").As<Napi::Array>();
+	for (uint32_t i = 0; i < colors.Length(); i++) {
+		auto col = colors.Get(i).As<Napi::Array>();
+		ComponentColorClass cls;
+		cls.r = (byte)col.Get(0u).As<Napi::Number>().Uint32Value();
+		cls.g = (byte)col.Get(1u).As<Napi::Number>().Uint32Value();
+		cls.b = (byte)col.Get(2u).As<Napi::Number>().Uint32Value();
+		cls.tolerance = tolerance;
+		opts.colors.push_back(cls);
+	}
+	if (opts.colors.empty()) {
+		throw Napi::RangeError::New(env, "at least one text color is required");
+	}
+	return opts;
+}
+
+//new and changed lines of a chatbox image compared to the previous image with the same tracker id
+//returns {scroll,lines:[{index,x,y,width,height,textx,texty,color}]}, color is an index into opts.colors
+Napi::Value ChatLinesPush(const Napi::CallbackInfo& info) {
+	auto env = info.Env();
+	auto inst = env.GetInstanceData<PluginInstance>();
+	auto& tracker = inst->chatTrackers[info[0].As<Napi::String>().Utf8Value()];
+	if (!tracker) { tracker = std::make_shared<ChatLineTracker>(); }
+	auto img = JSImageView::FromJsValue(info[1]);
+	auto update = tracker->Push(img, ChatLineOptionsFromJsValue(info[2]));
+	auto lines = Napi::Array::New(env, update.lines.size());
+	for (size_t i = 0; i < update.lines.size(); i++) {
+		auto& line = update.lines[i];
+		auto obj = line.rect.ToJs(env);
+		obj.Set("index", line.index);
+		obj.Set("textx", line.textx);
+		obj.Set("texty", line.texty);
+		obj.Set("color", line.colorclass);
+		lines.Set(i, obj);
+	}
+	auto ret = Napi::Object::New(env);
+	ret.Set("scroll", update.scroll);
+	ret.Set("lines", lines);
+	return ret;
+}
+
+void ChatLinesClose(const Napi::CallbackInfo& info) {
+	auto inst = info.Env().GetInstanceData<PluginInstance>();
+	inst->chatTrackers.erase(info[0].As<Napi::String>().Utf8Value());
+}
+
+//ink metrics of the single color text line at x,y, null if there is no ink of that color near the point
+Napi::Value JSMeasureTextLine(const Napi::CallbackInfo& info) {
+	auto env = info.Env();
+	auto img = JSImageView::FromJsValue(info[0]);
+	int x = info[1].As<Napi::Number>().Int32Value();
+	int y = info[2].As<Napi::Number>().Int32Value();
+	auto col = info[3].As<Napi::Array>();
+	ComponentColorClass color;
+	color.r = (byte)col.Get(0u).As<Napi::Number>().Uint32Value();
+	color.g = (byte)col.Get(1u).As<Napi::Number>().Uint32Value();
+	color.b = (byte)col.Get(2u).As<Napi::Number>().Uint32Value();
+	color.tolerance = (byte)(info[4].IsNumber() ? std::min(info[4].As<Napi::Number>().Uint32Value(), 255u) : 8);
+	auto metrics = MeasureTextLine(img, x, y, color, TextMetricsOptions());
+	if (!metrics.found) { return env.Null(); }
+	auto ret = Napi::Object::New(env);
+	ret.Set("top", metrics.top);
+	ret.Set("baseline", metrics.baseline);
+	ret.Set("bottom", metrics.bottom);
+	ret.Set("ascent", metrics.ascent);
+	ret.Set("stroke", metrics.stroke);
+	ret.Set("confidence", metrics.confidence);
+	return ret;
+}
+
+//default memory budget of the reader cache
+constexpr size_t readerCacheBudget = 16 * 1024 * 1024;
+
+ResultCache& GetReaderCache(Napi::Env env) {
+	auto inst = env.GetInstanceData<PluginInstance>();
+	if (!inst->readerCache) { inst->readerCache = std::make_shared<ResultCache>(readerCacheBudget); }
+	return *inst->readerCache;
+}
+
+uint64_t ReaderCacheKeyFromJsValue(const Napi::Value& val) {
+	bool lossless;
+	uint64_t key = val.As<Napi::BigInt>().Uint64Value(&lossless);
+	if (!lossless) { throw Napi::RangeError::New(val.Env(), "invalid cache key"); }
+	return key;
+}
+
+//content hash of an image combined with the reader id and its serialized parameters
+Napi::Value ReaderCacheKey(const Napi::CallbackInfo& info) {
+	auto img = JSImageView::FromJsValue(info[0]);
+	std::string reader = info[1].As<Napi::String>().Utf8Value();
+	reader.push_back('\0');
+	if (info[2].IsString()) { reader += info[2].As<Napi::String>().Utf8Value(); }
+	return Napi::BigInt::New(info.Env(), HashImage(img, HashBytes(reader.data(), reader.size(), 0)));
+}
+
+Napi::Value ReaderCacheGet(const Napi::CallbackInfo& info) {
+	auto value = GetReaderCache(info.Env()).Get(ReaderCacheKeyFromJsValue(info[0]));
+	if (!value) { return info.Env().Null(); }
+	return Napi::String::New(info.Env(), *value);
+}
+
+void ReaderCacheSet(const Napi::CallbackInfo& info) {
+	GetReaderCache(info.Env()).Set(ReaderCacheKeyFromJsValue(info[0]), info[1].As<Napi::String>().Utf8Value());
+}
+
+//optionally sets a new memory budget in bytes, returns the cache statistics
+Napi::Value ReaderCacheConfigure(const Napi::CallbackInfo& info) {
+	auto env = info.Env();
+	auto& cache = GetReaderCache(env);
+	if (info[0].IsNumber()) {
+		double budget = info[0].As<Napi::Number>().DoubleValue();
+		if (!(budget >= 0)) { throw Napi::RangeError::New(env, "invalid cache budget"); }
+		cache.SetBudget((size_t)budget);
+	}
+	auto ret = Napi::Object::New(env);
+	ret.Set("entries", (double)cache.Size());
+	ret.Set("bytes", (double)cache.Used());
+	ret.Set("hits", (double)cache.hits);
+	ret.Set("misses", (double)cache.misses);
+	return ret;
+}
+
+CaptureScheduler& GetCaptureScheduler(Napi::Env env) {
+	auto inst = env.GetInstanceData<PluginInstance>();
+	if (!inst->captureScheduler) { inst->captureScheduler = std::make_shared<CaptureScheduler>(); }
+	return *inst->captureScheduler;
+}
+
+//accounts a capture of the given size to the requester, returns 0 if it can run now or the milliseconds to wait
+Napi::Value CaptureQuotaRequest(const Napi::CallbackInfo& info) {
+	auto env = info.Env();
+	auto requester = info[0].As<Napi::String>().Utf8Value();
+	double bytes = info[1].As<Napi::Number>().DoubleValue();
+	if (!(bytes >= 0)) { throw Napi::RangeError::New(env, "invalid capture size"); }
+	bool foreground = info[2].ToBoolean();
+	bool force = info[3].ToBoolean();
+	return Napi::Number::New(env, GetCaptureScheduler(env).Request(requester, (size_t)bytes, foreground, force));
+}
+
+//optionally changes the quotas, returns the current ones
+Napi::Value CaptureQuotaConfigure(const Napi::CallbackInfo& info) {
+	auto env = info.Env();
+	auto& scheduler = GetCaptureScheduler(env);
+	CaptureQuotaOptions opts = scheduler.Options();
+	if (info[0].IsObject()) {
+		auto obj = info[0].As<Napi::Object>();
+		auto number = [&](const char* key, double& target) {
+			auto val = obj.Get(key);
+			if (val.IsUndefined()) { return; }
+			double num = val.As<Napi::Number>().DoubleValue();
+			if (!(num >= 0)) { throw Napi::RangeError::New(env, std::string("invalid quota ") + key); }
+			target = num;
+		};
+		number("capturesPerSecond", opts.capturesPerSecond);
+		number("bytesPerSecond", opts.bytesPerSecond);
+		number("totalBytesPerSecond", opts.totalBytesPerSecond);
+		number("burst", opts.burst);
+		number("backgroundShare", opts.backgroundShare);
+		number("foregroundReserve", opts.foregroundReserve);
+		if (opts.backgroundShare > 1 || opts.foregroundReserve > 1) { throw Napi::RangeError::New(env, "shares should be between 0 and 1"); }
+		scheduler.Configure(opts);
+	}
+	auto ret = Napi::Object::New(env);
+	ret.Set("capturesPerSecond", opts.capturesPerSecond);
+	ret.Set("bytesPerSecond", opts.bytesPerSecond);
+	ret.Set("totalBytesPerSecond", opts.totalBytesPerSecond);
+	ret.Set("burst", opts.burst);
+	ret.Set("backgroundShare", opts.backgroundShare);
+	ret.Set("foregroundReserve", opts.foregroundReserve);
+	return ret;
+}
+
+Napi::Value JSCaptureQuotaStats(const Napi::CallbackInfo& info) {
+	auto env = info.Env();
+	auto stats = GetCaptureScheduler(env).Stats(info[0].As<Napi::String>().Utf8Value());
+	auto ret = Napi::Object::New(env);
+	ret.Set("captures", (double)stats.captures);
+	ret.Set("bytes", (double)stats.bytes);
+	ret.Set("deferred", (double)stats.deferred);
+	return ret;
+}
+
 void NewWindowListener(const Napi::CallbackInfo& info) {
 	auto wnd = OSWindow::FromJsValue(info[0]);
 	auto typestring = info[1].As<Napi::String>().Utf8Value();
@@ -2,10 +2,20 @@
 
 #include "jsapi.h"
 
+void DestroyInstance(Napi::Env env, PluginInstance* inst) {
+	inst->closing->store(true);
+	// The query thread uses the shared connection, it has to be gone before the last instance closes that
+	DetachWindowQueries();
+	OSDetachInstance(inst);
+	delete inst;
+}
+
 Napi::Object Init(Napi::Env env, Napi::Object exports) {
+	//one instance per environment, worker_threads each get their own
 	auto inst = new PluginInstance();
-	//TODO need delete destructor to get rid of the mem again?
-	env.SetInstanceData<>(inst);
+	env.SetInstanceData<PluginInstance, DestroyInstance>(inst);
+	OSAttachInstance(inst);
+	AttachWindowQueries();
 
 	exports.Set("captureWindowMulti", Napi::Function::New(env, CaptureWindowMulti));
 	exports.Set("getRsHandles", Napi::Function::New(env, GetRsHandles));
@@ -14,8 +24,49 @@ Napi::Object Init(Napi::Env env, Napi::Object exports) {
 	exports.Set("getWindowTitle", Napi::Function::New(env, GetWindowTitle));
 	exports.Set("setWindowParent", Napi::Function::New(env, SetWindowParent));
 	exports.Set("getActiveWindow", Napi::Function::New(env, JSGetActiveWindow));
+	exports.Set("getRsHandlesAsync", Napi::Function::New(env, GetRsHandlesAsync));
+	exports.Set("getWindowBoundsAsync", Napi::Function::New(env, GetWindowBoundsAsync));
+	exports.Set("getClientBoundsAsync", Napi::Function::New(env, GetClientBoundsAsync));
+	exports.Set("getWindowTitleAsync", Napi::Function::New(env, GetWindowTitleAsync));
+	exports.Set("getActiveWindowAsync", Napi::Function::New(env, GetActiveWindowAsync));
 	exports.Set("getMouseState", Napi::Function::New(env, GetMouseState));
 	exports.Set("setWindowShape", Napi::Function::New(env, SetWindowShape));
+	exports.Set("setWindowShapeMask", Napi::Function::New(env, SetWindowShapeMask));
+	exports.Set("overlayCommands", Napi::Function::New(env, OverlayCommands));
+	exports.Set("overlayCloseFrame", Napi::Function::New(env, OverlayCloseFrame));
+	exports.Set("getProcessStats", Napi::Function::New(env, GetProcessStats));
+	exports.Set("getMonitors", Napi::Function::New(env, GetMonitors));
+	exports.Set("getCursorImage", Napi::Function::New(env, GetCursorImage));
+	exports.Set("pixelWatchAdd", Napi::Function::New(env, PixelWatchAdd));
+	exports.Set("pixelWatchRemove", Napi::Function::New(env, PixelWatchRemove));
+	exports.Set("diffFrames", Napi::Function::New(env, JSDiffFrames));
+	exports.Set("diffStream", Napi::Function::New(env, DiffStream));
+	exports.Set("diffStreamClose", Napi::Function::New(env, DiffStreamClose));
+	exports.Set("pyramidBuild", Napi::Function::New(env, PyramidBuild));
+	exports.Set("pyramidLevel", Napi::Function::New(env, PyramidLevel));
+	exports.Set("pyramidClose", Napi::Function::New(env, PyramidClose));
+	exports.Set("findComponents", Napi::Function::New(env, JSFindComponents));
+	exports.Set("iconIndexAdd", Napi::Function::New(env, IconIndexAdd));
+	exports.Set("iconIndexQuery", Napi::Function::New(env, IconIndexQuery));
+	exports.Set("iconIndexClose", Napi::Function::New(env, IconIndexClose));
+	exports.Set("loadAssetPack", Napi::Function::New(env, LoadAssetPack));
+	exports.Set("integralBuild", Napi::Function::New(env, IntegralBuild));
+	exports.Set("integralClose", Napi::Function::New(env, IntegralClose));
+	exports.Set("nccMatch", Napi::Function::New(env, JSNccMatch));
+	exports.Set("nccMatchPyramid", Napi::Function::New(env, NccMatchPyramid));
+	exports.Set("nccNeedleBuild", Napi::Function::New(env, NccNeedleBuild));
+	exports.Set("nccNeedleClose", Napi::Function::New(env, NccNeedleClose));
+	exports.Set("nccMatchScaled", Napi::Function::New(env, NccMatchScaled));
+	exports.Set("chatLinesPush", Napi::Function::New(env, ChatLinesPush));
+	exports.Set("chatLinesClose", Napi::Function::New(env, ChatLinesClose));
+	exports.Set("measureTextLine", Napi::Function::New(env, JSMeasureTextLine));
+	exports.Set("readerCacheKey", Napi::Function::New(env, ReaderCacheKey));
+	exports.Set("readerCacheGet", Napi::Function::New(env, ReaderCacheGet));
+	exports.Set("readerCacheSet", Napi::Function::New(env, ReaderCacheSet));
+	exports.Set("readerCacheConfigure", Napi::Function::New(env, ReaderCacheConfigure));
+	exports.Set("captureQuotaRequest", Napi::Function::New(env, CaptureQuotaRequest));
+	exports.Set("captureQuotaConfigure", Napi::Function::New(env, CaptureQuotaConfigure));
+	exports.Set("captureQuotaStats", Napi::Function::New(env, JSCaptureQuotaStats));
 
 	exports.Set("newWindowListener", Napi::Function::New(env, NewWindowListener));
 	exports.Set("removeWindowListener", Napi::Function::New(env, RemoveWindowListener));
@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <xcb/xfixes.h>
+#include "x11.h"
+#include "cursor.h"
+
+namespace priv_os_x11 {
+	std::mutex cursorMutex; // Locks the cached image and the version handshake
+	OSCursorImage cachedCursor;
+	bool cursorValid = false;
+	bool xfixesReady = false;
+	// Serial of the current cursor as reported by CursorNotify, only valid while cursorTracked is set
+	std::atomic<uint32_t> cursorSerial(0);
+	std::atomic<bool> cursorTracked(false);
+
+	// XFixes requests are only valid after the client announced its version
+	const xcb_query_extension_reply_t* xfixesExtension() {
+		const xcb_query_extension_reply_t* ext = xcb_get_extension_data(connection, &xcb_xfixes_id);
+		if (!ext || !ext->present) {
+			return NULL;
+		}
+		std::lock_guard<std::mutex> lock(cursorMutex);
+		if (!xfixesReady) {
+			xcb_xfixes_query_version_cookie_t cookie = xcb_xfixes_query_version(connection, XCB_XFIXES_MAJOR_VERSION, XCB_XFIXES_MINOR_VERSION);
+			std::unique_ptr<xcb_xfixes_query_version_reply_t, decltype(&free)> reply { xcb_xfixes_query_version_reply(connection, cookie, NULL), &free };
+			// Cursor notifications and images are in version 2 and up
+			if (!reply || reply->major_version < 2) {
+				return NULL;
+			}
+			xfixesReady = true;
+		}
+		return ext;
+	}
+
+	bool queryCursorImage(OSCursorImage& out) {
+		xcb_xfixes_get_cursor_image_cookie_t cookie = xcb_xfixes_get_cursor_image(connection);
+		std::unique_ptr<xcb_xfixes_get_cursor_image_reply_t, decltype(&free)> reply { xcb_xfixes_get_cursor_image_reply(connection, cookie, NULL), &free };
+		if (!reply) {
+			return false;
+		}
+		out.serial = reply->cursor_serial;
+		out.hotX = reply->xhot;
+		out.hotY = reply->yhot;
+		out.width = reply->width;
+		out.height = reply->height;
+		// Pixels are premultiplied argb in native order, js wants straight rgba
+		const uint32_t* src = xcb_xfixes_get_cursor_image_cursor_image(reply.get());
+		size_t count = (size_t)out.width * out.height;
+		out.pixels.resize(count * 4);
+		for (size_t i = 0; i < count; i++) {
+			uint32_t argb = src[i];
+			uint32_t a = argb >> 24;
+			uint32_t r = (argb >> 16) & 0xff, g = (argb >> 8) & 0xff, b = argb & 0xff;
+			if (a != 0 && a != 255) {
+				r = std::min(255u, (r * 255 + a / 2) / a);
+				g = std::min(255u, (g * 255 + a / 2) / a);
+				b = std::min(255u, (b * 255 + a / 2) / a);
+			}
+			byte* dst = &out.pixels[i * 4];
+			dst[0] = r;
+			dst[1] = g;
+			dst[2] = b;
+			dst[3] = a;
+		}
+		return true;
+	}
+
+	bool getCursorImage(uint32_t knownSerial, OSCursorImage& out) {
+		ensureConnection();
+		if (!xfixesExtension()) {
+			return false;
+		}
+		bool tracked = cursorTracked;
+		uint32_t serial = cursorSerial;
+		if (tracked) {
+			// Nothing changed since the last notification, no need to ask the server
+			if (serial != 0 && serial == knownSerial) {
+				return false;
+			}
+			std::lock_guard<std::mutex> lock(cursorMutex);
+			if (cursorValid && cachedCursor.serial == serial) {
+				out = cachedCursor;
+				return true;
+			}
+		}
+		OSCursorImage image;
+		if (!queryCursorImage(image)) {
+			return false;
+		}
+		if (tracked) {
+			std::lock_guard<std::mutex> lock(cursorMutex);
+			cachedCursor = image;
+			cursorValid = true;
+			// Unless a newer notification came in while we were waiting on the image
+			cursorSerial.compare_exchange_strong(serial, image.serial);
+		}
+		if (image.serial == knownSerial) {
+			return false;
+		}
+		out = std::move(image);
+		return true;
+	}
+
+	void startCursorTracking() {
+		if (xfixesExtension()) {
+			xcb_xfixes_select_cursor_input(connection, rootWindow, XCB_XFIXES_CURSOR_NOTIFY_MASK_DISPLAY_CURSOR);
+		}
+		cursorSerial = 0;
+		cursorTracked = true;
+	}
+
+	void stopCursorTracking() {
+		cursorTracked = false;
+		if (xfixesExtension()) {
+			xcb_xfixes_select_cursor_input(connection, rootWindow, 0);
+		}
+		std::lock_guard<std::mutex> lock(cursorMutex);
+		cursorValid = false;
+		cachedCursor = OSCursorImage();
+	}
+
+	bool handleCursorEvent(const xcb_generic_event_t* event, uint32_t& serial) {
+		const xcb_query_extension_reply_t* ext = xcb_get_extension_data(connection, &xcb_xfixes_id);
+		if (!ext || !ext->present || (event->response_type & ~0x80) != ext->first_event + XCB_XFIXES_CURSOR_NOTIFY) {
+			return false;
+		}
+		const xcb_xfixes_cursor_notify_event_t* notify = reinterpret_cast<const xcb_xfixes_cursor_notify_event_t*>(event);
+		serial = notify->cursor_serial;
+		cursorSerial = serial;
+		return true;
+	}
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <xcb/xcb.h>
+#include "../os.h"
+
+namespace priv_os_x11 {
+	/**
+	 * Select XFixes cursor change events on the root window, the caller has to pass every event it receives to
+	 * handleCursorEvent for as long as tracking is on
+	 */
+	void startCursorTracking();
+	void stopCursorTracking();
+
+	/**
+	 * Records the new cursor serial if the event is an XFixes cursor notification, returns whether it was one
+	 */
+	bool handleCursorEvent(const xcb_generic_event_t* event, uint32_t& serial);
+
+	/**
+	 * Current cursor image, returns false without touching out if the cursor still has knownSerial.
+	 * While tracking is on the image is cached until the next cursor change
+	 */
+	bool getCursorImage(uint32_t knownSerial, OSCursorImage& out);
+}
@@ -0,0 +1,310 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <poll.h>
+#include <xcb/composite.h>
+#include <xcb/damage.h>
+#include "x11.h"
+#include "shm.h"
+#include "damage.h"
+#include "../scratch.h"
+
+namespace priv_os_x11 {
+	struct PixelWatch {
+		int id;
+		xcb_window_t window;
+		xcb_damage_damage_t damage;
+		PixelWatchSet predicates;
+		std::chrono::milliseconds interval;
+		std::chrono::steady_clock::time_point nextEvaluation;
+		// New content in the watched area since the last evaluation, the first frame is always evaluated
+		bool dirty = true;
+		bool removed = false;
+		PluginInstance* owner;
+		Napi::ThreadSafeFunction callback;
+		PixelWatch(std::vector<PixelPredicate> predicates) :predicates(std::move(predicates)) {}
+	};
+
+	std::mutex watchMutex; // Locks pixelWatches and their dirty/removed flags
+	std::mutex watchThreadMutex; // Locks the thread and its connection. Never locked from inside the watch thread
+	std::map<int, std::shared_ptr<PixelWatch>> pixelWatches;
+	int nextWatchId = 1;
+
+	// Own connection, waiting for damage events on the shared connection would interfere with the window thread
+	xcb_connection_t* watchConnection = NULL;
+	const xcb_query_extension_reply_t* damageExtension = NULL;
+	// Input-only window owned by watchConnection, a client message to it wakes up the watch thread
+	xcb_window_t watchWakeWindow = XCB_NONE;
+	std::thread watchThread;
+	std::atomic<bool> watchThreadStop(false);
+
+	void wakeWatchThread() {
+		xcb_client_message_event_t wake;
+		memset(&wake, 0, sizeof(wake));
+		wake.response_type = XCB_CLIENT_MESSAGE;
+		wake.format = 32;
+		wake.window = watchWakeWindow;
+		wake.type = XCB_ATOM_NONE;
+		xcb_send_event(watchConnection, 0, watchWakeWindow, XCB_EVENT_MASK_NO_EVENT, reinterpret_cast<const char*>(&wake));
+		xcb_flush(watchConnection);
+	}
+
+	void handleWatchEvent(xcb_connection_t* conn, xcb_generic_event_t* event) {
+		// Errors are expected here, windows can be destroyed while watched which also destroys their damage objects
+		if ((event->response_type & ~0x80) != damageExtension->first_event + XCB_DAMAGE_NOTIFY) {
+			return;
+		}
+		xcb_damage_notify_event_t* notify = reinterpret_cast<xcb_damage_notify_event_t*>(event);
+		// Repair everything, the next change sends a new event
+		xcb_damage_subtract(conn, notify->damage, XCB_NONE, XCB_NONE);
+		std::lock_guard<std::mutex> lock(watchMutex);
+		for (auto& entry : pixelWatches) {
+			auto& watch = entry.second;
+			if (watch->damage != notify->damage) {
+				continue;
+			}
+			JSRectangle bounds = watch->predicates.Bounds();
+			auto& area = notify->area;
+			if (area.x < bounds.x + bounds.width && area.x + area.width > bounds.x && area.y < bounds.y + bounds.height && area.y + area.height > bounds.y) {
+				watch->dirty = true;
+			}
+		}
+	}
+
+	// Grabs only the bounding box of the predicates, the parts outside of the window are black
+	std::vector<int> evaluateWatch(xcb_connection_t* conn, PixelWatch& watch) {
+		JSRectangle bounds = watch.predicates.Bounds();
+		xcb_pixmap_t pixmap = xcb_generate_id(conn);
+		xcb_composite_name_window_pixmap(conn, watch.window, pixmap);
+		xcb_get_geometry_cookie_t cookie = xcb_get_geometry_unchecked(conn, pixmap);
+		std::unique_ptr<xcb_get_geometry_reply_t, decltype(&free)> geometry { xcb_get_geometry_reply(conn, cookie, NULL), &free };
+		std::vector<int> fired;
+		if (geometry) {
+			int x1 = std::max(bounds.x, 0), y1 = std::max(bounds.y, 0);
+			int x2 = std::min(bounds.x + bounds.width, (int)geometry->width), y2 = std::min(bounds.y + bounds.height, (int)geometry->height);
+			if (x1 < x2 && y1 < y2) {
+				// Every pixel is written by the copy, only the fired ids leave the scope
+				ScratchScope scratch;
+				size_t size = (size_t)bounds.width * bounds.height * 4;
+				byte* frame = scratch.Alloc<byte>(size);
+				try {
+					XShmCapture capture(conn, pixmap, x1, y1, x2 - x1, y2 - y1);
+					capture.copy(reinterpret_cast<char*>(frame), size, bounds.x - x1, bounds.y - y1, bounds.width, bounds.height);
+					fired = watch.predicates.Evaluate(JSImageView(frame, bounds.width, bounds.height));
+				} catch (std::exception* e) {
+					std::cout << "native: pixel watch capture failed: " << e->what() << std::endl;
+					delete e;
+				}
+			}
+		}
+		xcb_free_pixmap(conn, pixmap);
+		return fired;
+	}
+
+	// Evaluates every watch with new content whose interval has passed, returns the poll timeout until the next one is due
+	int evaluateDueWatches(xcb_connection_t* conn) {
+		auto now = std::chrono::steady_clock::now();
+		std::vector<std::shared_ptr<PixelWatch>> due;
+		int timeout = -1;
+		watchMutex.lock();
+		for (auto& entry : pixelWatches) {
+			auto& watch = entry.second;
+			if (!watch->dirty) {
+				continue;
+			}
+			if (watch->nextEvaluation <= now) {
+				watch->dirty = false;
+				watch->nextEvaluation = now + watch->interval;
+				due.push_back(watch);
+			} else {
+				int wait = (int)std::chrono::duration_cast<std::chrono::milliseconds>(watch->nextEvaluation - now).count() + 1;
+				timeout = (timeout == -1 ? wait : std::min(timeout, wait));
+			}
+		}
+		watchMutex.unlock();
+
+		for (auto& watch : due) {
+			auto fired = evaluateWatch(conn, *watch);
+			if (fired.empty()) {
+				continue;
+			}
+			std::lock_guard<std::mutex> lock(watchMutex);
+			if (watch->removed) {
+				continue;
+			}
+			// Don't wait for js, the predicate state is kept natively
+			watch->callback.NonBlockingCall([fired](Napi::Env env, Napi::Function callback) {
+				auto indices = Napi::Array::New(env, fired.size());
+				for (size_t i = 0; i < fired.size(); i++) { indices.Set(i, fired[i]); }
+				callback.Call({ indices });
+			});
+		}
+		return (due.empty() ? timeout : 0);
+	}
+
+	void WatchThread() {
+		xcb_connection_t* conn = watchConnection;
+		int fd = xcb_get_file_descriptor(conn);
+		while (!watchThreadStop) {
+			bool handled = false;
+			while (xcb_generic_event_t* event = xcb_poll_for_event(conn)) {
+				handleWatchEvent(conn, event);
+				free(event);
+				handled = true;
+			}
+			if (xcb_connection_has_error(conn)) {
+				std::cout << "native: pixel watch connection failed" << std::endl;
+				break;
+			}
+			int timeout = evaluateDueWatches(conn);
+			xcb_flush(conn);
+			// Events that came in while waiting on replies are already read from the socket, poll wouldn't see them
+			while (xcb_generic_event_t* event = xcb_poll_for_queued_event(conn)) {
+				handleWatchEvent(conn, event);
+				free(event);
+				handled = true;
+			}
+			if (handled) {
+				continue;
+			}
+			pollfd pfd = { fd, POLLIN, 0 };
+			poll(&pfd, 1, timeout);
+		}
+		std::cout << "native: pixel watch thread exiting" << std::endl;
+	}
+
+	void connectWatchThread(Napi::Env env) {
+		// The thread exits by itself when the connection breaks, start over in that case
+		if (watchConnection != NULL && xcb_connection_has_error(watchConnection)) {
+			watchThread.join();
+			xcb_disconnect(watchConnection);
+			watchConnection = NULL;
+		}
+		if (watchConnection != NULL) {
+			return;
+		}
+		// The root window is the same for every connection
+		ensureConnection();
+		xcb_connection_t* conn = xcb_connect(NULL, NULL);
+		if (xcb_connection_has_error(conn)) {
+			xcb_disconnect(conn);
+			throw Napi::Error::New(env, "Cannot initiate xcb connection for pixel watches");
+		}
+		damageExtension = xcb_get_extension_data(conn, &xcb_damage_id);
+		if (!damageExtension || !damageExtension->present) {
+			xcb_disconnect(conn);
+			throw Napi::Error::New(env, "The X server has no damage extension");
+		}
+		// Damage and composite requests are only valid after the version handshake
+		xcb_damage_query_version_cookie_t damageCookie = xcb_damage_query_version(conn, XCB_DAMAGE_MAJOR_VERSION, XCB_DAMAGE_MINOR_VERSION);
+		xcb_composite_query_version_cookie_t compositeCookie = xcb_composite_query_version(conn, XCB_COMPOSITE_MAJOR_VERSION, XCB_COMPOSITE_MINOR_VERSION);
+		free(xcb_damage_query_version_reply(conn, damageCookie, NULL));
+		free(xcb_composite_query_version_reply(conn, compositeCookie, NULL));
+
+		watchWakeWindow = xcb_generate_id(conn);
+		xcb_create_window(conn, XCB_COPY_FROM_PARENT, watchWakeWindow, rootWindow, -1, -1, 1, 1, 0, XCB_WINDOW_CLASS_INPUT_ONLY, XCB_COPY_FROM_PARENT, 0, NULL);
+		xcb_flush(conn);
+		watchConnection = conn;
+		// Watches from before a connection failure lost their damage objects
+		std::lock_guard<std::mutex> lock(watchMutex);
+		for (auto& entry : pixelWatches) {
+			auto& watch = entry.second;
+			watch->damage = xcb_generate_id(conn);
+			xcb_composite_redirect_window(conn, watch->window, XCB_COMPOSITE_REDIRECT_AUTOMATIC);
+			xcb_damage_create(conn, watch->damage, watch->window, XCB_DAMAGE_REPORT_LEVEL_BOUNDING_BOX);
+			watch->dirty = true;
+		}
+		xcb_flush(conn);
+		watchThreadStop = false;
+		watchThread = std::thread(WatchThread);
+	}
+
+	// Only with watchThreadMutex held
+	void stopWatchThreadIfIdle() {
+		{
+			std::lock_guard<std::mutex> lock(watchMutex);
+			if (!pixelWatches.empty() || watchConnection == NULL) {
+				return;
+			}
+		}
+		watchThreadStop = true;
+		wakeWatchThread();
+		watchThread.join();
+		// Redirects and damage objects of this connection go away with it
+		xcb_disconnect(watchConnection);
+		watchConnection = NULL;
+		watchWakeWindow = XCB_NONE;
+	}
+
+	// Only with both mutexes held
+	void releaseWatch(PixelWatch& watch, bool abort) {
+		watch.removed = true;
+		if (abort) {
+			watch.callback.Abort();
+		} else {
+			watch.callback.Release();
+		}
+		xcb_damage_destroy(watchConnection, watch.damage);
+		xcb_flush(watchConnection);
+	}
+
+	int addPixelWatch(xcb_window_t window, std::vector<PixelPredicate> predicates, int interval, Napi::Function callback) {
+		auto env = callback.Env();
+		std::lock_guard<std::mutex> threadlock(watchThreadMutex);
+		connectWatchThread(env);
+
+		auto watch = std::make_shared<PixelWatch>(std::move(predicates));
+		watch->window = window;
+		watch->interval = std::chrono::milliseconds(interval);
+		watch->owner = env.GetInstanceData<PluginInstance>();
+		watch->callback = Napi::ThreadSafeFunction::New(env, callback, "pixelwatch", 0, 1);
+		watch->damage = xcb_generate_id(watchConnection);
+		// Window contents are only kept while redirected, same as for window captures
+		xcb_composite_redirect_window(watchConnection, window, XCB_COMPOSITE_REDIRECT_AUTOMATIC);
+		xcb_damage_create(watchConnection, watch->damage, window, XCB_DAMAGE_REPORT_LEVEL_BOUNDING_BOX);
+
+		std::lock_guard<std::mutex> lock(watchMutex);
+		watch->id = nextWatchId++;
+		pixelWatches[watch->id] = watch;
+		// Evaluates the first frame right away
+		wakeWatchThread();
+		return watch->id;
+	}
+
+	void removePixelWatch(int id) {
+		std::lock_guard<std::mutex> threadlock(watchThreadMutex);
+		{
+			std::lock_guard<std::mutex> lock(watchMutex);
+			auto watch = pixelWatches.find(id);
+			if (watch == pixelWatches.end()) {
+				return;
+			}
+			releaseWatch(*watch->second, false);
+			pixelWatches.erase(watch);
+		}
+		stopWatchThreadIfIdle();
+	}
+
+	void removePixelWatches(PluginInstance* owner) {
+		std::lock_guard<std::mutex> threadlock(watchThreadMutex);
+		{
+			std::lock_guard<std::mutex> lock(watchMutex);
+			for (auto it = pixelWatches.begin(); it != pixelWatches.end();) {
+				if (it->second->owner == owner) {
+					releaseWatch(*it->second, true);
+					it = pixelWatches.erase(it);
+				} else {
+					it++;
+				}
+			}
+		}
+		stopWatchThreadIfIdle();
+	}
+}
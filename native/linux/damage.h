@@ -0,0 +1,18 @@
+#pragma once
+#include <vector>
+#include <xcb/xcb.h>
+#include "../os.h"
+
+namespace priv_os_x11 {
+	/**
+	 * Pixel watches, evaluated on their own thread and connection whenever XDamage reports new content in the
+	 * watched area of the window. The thread runs while there are watches
+	 */
+	int addPixelWatch(xcb_window_t window, std::vector<PixelPredicate> predicates, int interval, Napi::Function callback);
+	void removePixelWatch(int id);
+
+	/**
+	 * Drops the watches of an environment that is being torn down, their callbacks can't be called anymore
+	 */
+	void removePixelWatches(PluginInstance* owner);
+}
@@ -0,0 +1,321 @@
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "x11.h"
+#include "glframes.h"
+#include "glcapture.h"
+#include "../imagescale.h"
+#include "../scratch.h"
+
+namespace priv_os_x11 {
+	// A client that hasn't swapped for this long is minimized or hanging, the composite pixmap is good enough then
+	constexpr uint64_t stallMs = 1000;
+	// Frames are published one swap after they were read, a slot this many swaps old is still current
+	constexpr uint64_t maxSlotAge = 2;
+
+	struct WantedRect {
+		glframes::Rect rect;
+		uint64_t time;
+	};
+
+	struct GlRing {
+		// Unmapped when the last capture using it is done
+		std::shared_ptr<glframes::Header> header;
+		uint64_t lastFrameCount = 0;
+		uint64_t lastFrameChange = 0;
+		// Everything captures asked for recently, the hook reads back all of it
+		std::vector<WantedRect> wanted;
+	};
+
+	std::mutex ringMutex; // Locks rings and the request area of every ring, never held while waiting on anything
+	std::map<pid_t, GlRing> rings;
+
+	std::shared_ptr<glframes::Header> openRing(pid_t pid) {
+		char name[64];
+		glframes::ShmName(name, sizeof(name), pid);
+		int fd = shm_open(name, O_RDWR, 0);
+		if (fd == -1) {
+			return nullptr;
+		}
+		struct stat info;
+		void* mem = MAP_FAILED;
+		if (fstat(fd, &info) == 0 && (size_t)info.st_size >= glframes::totalBytes) {
+			mem = mmap(NULL, glframes::totalBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		}
+		close(fd);
+		if (mem == MAP_FAILED) {
+			return nullptr;
+		}
+		std::shared_ptr<glframes::Header> header(reinterpret_cast<glframes::Header*>(mem), [](glframes::Header* header) {
+			munmap(header, glframes::totalBytes);
+		});
+		if (header->magic != glframes::magic || header->version != glframes::version) {
+			return nullptr;
+		}
+		return header;
+	}
+
+	GlRing* getRing(pid_t pid) {
+		auto known = rings.find(pid);
+		if (known != rings.end()) {
+			uint64_t now = glframes::MonotonicMs();
+			uint64_t frames = known->second.header->frameCount.load();
+			if (frames != known->second.lastFrameCount) {
+				known->second.lastFrameCount = frames;
+				known->second.lastFrameChange = now;
+				return &known->second;
+			}
+			if (now - known->second.lastFrameChange < stallMs) {
+				return &known->second;
+			}
+			// Keep the mapping of a paused client, drop it once the hook has gone away so a new process with the
+			// same pid gets its own ring
+			char name[64];
+			glframes::ShmName(name, sizeof(name), pid);
+			int fd = shm_open(name, O_RDONLY, 0);
+			if (fd != -1) {
+				close(fd);
+				return nullptr;
+			}
+			rings.erase(known);
+		}
+		auto header = openRing(pid);
+		if (!header) {
+			return nullptr;
+		}
+		GlRing& ring = rings[pid];
+		ring.header = header;
+		ring.lastFrameCount = header->frameCount.load();
+		ring.lastFrameChange = glframes::MonotonicMs();
+		return &ring;
+	}
+
+	// Writes the request unless the hook already has it
+	void writeRequest(glframes::Header* header, const std::vector<glframes::Rect>& requests) {
+		uint32_t serial = header->requestSerial.load();
+		bool same = (header->requestCount == (int32_t)requests.size());
+		for (size_t i = 0; same && i < requests.size(); i++) {
+			same = (header->requests[i] == requests[i]);
+		}
+		if (!same) {
+			// Odd while writing, the hook skips the request until it is even again
+			header->requestSerial.store(serial + 1);
+			header->requestCount = requests.size();
+			std::copy(requests.begin(), requests.end(), header->requests);
+			header->requestSerial.store(serial + 2, std::memory_order_release);
+		}
+		header->requestTime.store(glframes::MonotonicMs());
+	}
+
+	// Adds the rects to what the ring asks the hook for and drops whatever nobody asked for in a while
+	void updateRequest(GlRing& ring, const std::vector<glframes::Rect>& rects, int width, int height) {
+		uint64_t now = glframes::MonotonicMs();
+		glframes::Rect drawable = { 0, 0, width, height };
+		auto& wanted = ring.wanted;
+		wanted.erase(std::remove_if(wanted.begin(), wanted.end(), [&](const WantedRect& entry) {
+			return now - entry.time > glframes::requestTimeoutMs || !drawable.Contains(entry.rect);
+		}), wanted.end());
+		for (auto& rect : rects) {
+			auto covering = std::find_if(wanted.begin(), wanted.end(), [&](const WantedRect& entry) {return entry.rect.Contains(rect); });
+			if (covering != wanted.end()) {
+				covering->time = now;
+				continue;
+			}
+			wanted.erase(std::remove_if(wanted.begin(), wanted.end(), [&](const WantedRect& entry) {return rect.Contains(entry.rect); }), wanted.end());
+			wanted.push_back({ rect, now });
+		}
+		// Newest first for whatever fits in a slot, then a stable order so an unchanged set doesn't look new to the hook
+		std::stable_sort(wanted.begin(), wanted.end(), [](const WantedRect& a, const WantedRect& b) {return a.time > b.time; });
+		size_t bytes = 0, count = 0;
+		while (count < wanted.size() && count < glframes::maxRects && bytes + wanted[count].rect.Bytes() <= glframes::slotBytes) {
+			bytes += wanted[count++].rect.Bytes();
+		}
+		wanted.resize(count);
+		std::sort(wanted.begin(), wanted.end(), [](const WantedRect& a, const WantedRect& b) {
+			auto& l = a.rect, &r = b.rect;
+			return std::tie(l.y, l.x, l.height, l.width) < std::tie(r.y, r.x, r.height, r.width);
+		});
+		std::vector<glframes::Rect> requests;
+		for (auto& entry : wanted) {
+			requests.push_back(entry.rect);
+		}
+		writeRequest(ring.header.get(), requests);
+	}
+
+	// Copies the rects out of the newest slot into pixels, packed back to back. Fails if the slot is too old, doesn't
+	// cover every rect or was overwritten while copying
+	bool readLatestSlot(glframes::Header* header, const std::vector<glframes::Rect>& rects, uint8_t* pixels) {
+		int slotIndex = header->latestSlot.load(std::memory_order_acquire);
+		if (slotIndex < 0 || slotIndex >= glframes::slotCount) {
+			return false;
+		}
+		glframes::Slot& slot = header->slots[slotIndex];
+		uint32_t seq = slot.seq.load(std::memory_order_acquire);
+		if (seq % 2 != 0 || slot.frame + maxSlotAge < header->frameCount.load()) {
+			return false;
+		}
+		int count = std::min(std::max(slot.rectCount, 0), glframes::maxRects);
+		glframes::Rect slotRects[glframes::maxRects];
+		size_t slotOffsets[glframes::maxRects];
+		size_t offset = 0;
+		for (int i = 0; i < count; i++) {
+			slotRects[i] = slot.rects[i];
+			// Garbage while the hook is rewriting the slot, the seq check below would reject it anyway
+			if (slotRects[i].width <= 0 || slotRects[i].height <= 0) {
+				return false;
+			}
+			slotOffsets[i] = offset;
+			offset += slotRects[i].Bytes();
+		}
+		if (offset > glframes::slotBytes) {
+			return false;
+		}
+		const uint8_t* data = glframes::SlotData(header, slotIndex);
+		uint8_t* out = pixels;
+		for (auto& rect : rects) {
+			int source = -1;
+			for (int i = 0; i < count && source == -1; i++) {
+				if (slotRects[i].Contains(rect)) {
+					source = i;
+				}
+			}
+			if (source == -1) {
+				return false;
+			}
+			auto& from = slotRects[source];
+			size_t stride = (size_t)rect.width * 4;
+			for (int y = 0; y < rect.height; y++) {
+				const uint8_t* row = data + slotOffsets[source] + ((size_t)(rect.y - from.y + y) * from.width + (rect.x - from.x)) * 4;
+				memcpy(out, row, stride);
+				out += stride;
+			}
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return slot.seq.load(std::memory_order_relaxed) == seq;
+	}
+
+	// Copies x,y,w,h out of a top first rgba image of srcw x srch placed at srcx,srcy, pixels outside of it are black
+	void copyClipped(const uint8_t* src, int srcx, int srcy, int srcw, int srch, uint8_t* dst, int x, int y, int w, int h) {
+		for (int row = 0; row < h; row++) {
+			uint8_t* out = dst + (size_t)row * w * 4;
+			int sy = y + row - srcy;
+			for (int col = 0; col < w; col++) {
+				int sx = x + col - srcx;
+				if (sx >= 0 && sy >= 0 && sx < srcw && sy < srch) {
+					const uint8_t* in = src + ((size_t)sy * srcw + sx) * 4;
+					out[col * 4 + 0] = in[0];
+					out[col * 4 + 1] = in[1];
+					out[col * 4 + 2] = in[2];
+				} else {
+					out[col * 4 + 0] = 0;
+					out[col * 4 + 1] = 0;
+					out[col * 4 + 2] = 0;
+				}
+				// Back buffer alpha is whatever the client left in it
+				out[col * 4 + 3] = 0xFF;
+			}
+		}
+	}
+
+	bool captureGlFrame(pid_t pid, xcb_window_t window, std::vector<CaptureRect>& rects) {
+		if (pid <= 0 || rects.empty() || rects.size() > glframes::maxRects) {
+			return false;
+		}
+		std::shared_ptr<glframes::Header> header;
+		{
+			std::lock_guard<std::mutex> lock(ringMutex);
+			GlRing* ring = getRing(pid);
+			if (!ring) {
+				return false;
+			}
+			header = ring->header;
+		}
+		xcb_window_t drawable = header->drawable.load();
+		int width = header->width.load();
+		int height = header->height.load();
+		if (drawable == XCB_NONE || width <= 0 || height <= 0) {
+			return false;
+		}
+
+		// The client might draw to a child of the window we know about
+		int dx = 0, dy = 0;
+		if (drawable != window) {
+			xcb_translate_coordinates_cookie_t cookie = xcb_translate_coordinates(connection, window, drawable, 0, 0);
+			xcb_translate_coordinates_reply_t* reply = xcb_translate_coordinates_reply(connection, cookie, NULL);
+			if (!reply) {
+				return false;
+			}
+			dx = reply->dst_x;
+			dy = reply->dst_y;
+			free(reply);
+		}
+
+		// Only the part of every rect that lies on the drawable is read back
+		std::vector<glframes::Rect> requests;
+		std::vector<int> requestIndex(rects.size(), -1);
+		for (size_t i = 0; i < rects.size(); i++) {
+			auto& rect = rects[i].rect;
+			int x1 = std::max(rect.x + dx, 0), y1 = std::max(rect.y + dy, 0);
+			int x2 = std::min(rect.x + dx + rect.width, width), y2 = std::min(rect.y + dy + rect.height, height);
+			if (x1 < x2 && y1 < y2) {
+				requestIndex[i] = requests.size();
+				requests.push_back({ x1, y1, x2 - x1, y2 - y1 });
+			}
+		}
+		std::vector<size_t> offsets;
+		size_t total = 0;
+		for (auto& request : requests) {
+			offsets.push_back(total);
+			total += request.Bytes();
+		}
+		if (requests.empty() || total > glframes::slotBytes) {
+			return false;
+		}
+		{
+			std::lock_guard<std::mutex> lock(ringMutex);
+			auto ring = rings.find(pid);
+			if (ring == rings.end() || ring->second.header != header) {
+				return false;
+			}
+			updateRequest(ring->second, requests, width, height);
+		}
+
+		// The first capture of new rects misses, later ones get the frames the hook reads for them from now on
+		ScratchScope scratch;
+		uint8_t* pixels = scratch.Alloc<uint8_t>(total);
+		if (!readLatestSlot(header.get(), requests, pixels)) {
+			return false;
+		}
+
+		for (size_t i = 0; i < rects.size(); i++) {
+			CaptureRect& target = rects[i];
+			auto& rect = target.rect;
+			int index = requestIndex[i];
+			const uint8_t* src = (index == -1 ? nullptr : pixels + offsets[index]);
+			int srcx = (index == -1 ? 0 : requests[index].x - dx), srcy = (index == -1 ? 0 : requests[index].y - dy);
+			int srcw = (index == -1 ? 0 : requests[index].width), srch = (index == -1 ? 0 : requests[index].height);
+			if (target.scale != 1) {
+				if ((size_t)DownscaledSize(rect.width, target.scale) * DownscaledSize(rect.height, target.scale) * 4 > target.size) {
+					continue;
+				}
+				ScratchScope rectScratch;
+				uint8_t* full = rectScratch.Alloc<uint8_t>((size_t)rect.width * rect.height * 4);
+				copyClipped(src, srcx, srcy, srcw, srch, full, rect.x, rect.y, rect.width, rect.height);
+				DownscaleBox(full, rect.width * 4, rect.width, rect.height, target.scale, reinterpret_cast<byte*>(target.data), DownscaledSize(rect.width, target.scale) * 4, false);
+			} else {
+				if ((size_t)rect.width * rect.height * 4 > target.size) {
+					continue;
+				}
+				copyClipped(src, srcx, srcy, srcw, srch, reinterpret_cast<uint8_t*>(target.data), rect.x, rect.y, rect.width, rect.height);
+			}
+		}
+		return true;
+	}
+}
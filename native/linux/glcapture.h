@@ -0,0 +1,16 @@
+#pragma once
+#include <vector>
+#include <sys/types.h>
+#include <xcb/xcb.h>
+#include "../os.h"
+
+namespace priv_os_x11 {
+	/**
+	 * Reads the rects straight from the back buffer of a client that runs with the glXSwapBuffers hook preloaded,
+	 * see glframes.h. Rects are relative to window like in the other capture modes. Never waits for the client, the
+	 * rects are requested for the coming swaps and served from the newest published frame. Returns false without
+	 * touching the rects if that frame doesn't cover them yet or the client has no hook, the caller should fall back
+	 * to another mode
+	 */
+	bool captureGlFrame(pid_t pid, xcb_window_t window, std::vector<CaptureRect>& rects);
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <time.h>
+
+/**
+ * Shared memory layout between the glXSwapBuffers hook (glhook/glhook.cc, preloaded into the game client) and the
+ * addon. The addon writes the rects it wants, the hook reads them back at every swap while they are being asked for
+ * and publishes them in a small ring of slots. The addon never waits on the hook, captures are served from the newest
+ * slot if it still covers them. Only used by plain c++ on both sides, nothing in here may depend on node
+ */
+namespace glframes {
+	constexpr uint32_t magic = 0x316c4741;
+	constexpr uint32_t version = 2;
+	constexpr int maxRects = 16;
+	constexpr int slotCount = 3;
+	constexpr size_t slotBytes = 16 * 1024 * 1024;
+	// The hook stops reading back once the addon hasn't asked for frames for this long
+	constexpr uint64_t requestTimeoutMs = 2000;
+
+	// Drawable coordinates with the origin at the top left, unlike gl
+	struct Rect {
+		int32_t x;
+		int32_t y;
+		int32_t width;
+		int32_t height;
+		bool operator==(const Rect& other) const { return x == other.x && y == other.y && width == other.width && height == other.height; }
+		bool Contains(const Rect& other) const { return other.x >= x && other.y >= y && other.x + other.width <= x + width && other.y + other.height <= y + height; }
+		size_t Bytes() const { return (size_t)width * height * 4; }
+	};
+
+	struct Slot {
+		// Odd while the hook is writing the slot
+		std::atomic<uint32_t> seq;
+		// Request the pixels were read back for
+		uint32_t requestSerial;
+		uint64_t frame;
+		// The rects are packed back to back in this order, rgba with the top row first
+		int32_t rectCount;
+		Rect rects[maxRects];
+	};
+
+	struct Header {
+		uint32_t magic;
+		uint32_t version;
+		// Last swapped drawable and its size, written by the hook
+		std::atomic<uint32_t> drawable;
+		std::atomic<int32_t> width;
+		std::atomic<int32_t> height;
+		// Swaps since the hook loaded
+		std::atomic<uint64_t> frameCount;
+		// Written by the addon, the rects first and the serial after them. The rects are everything any capture asked
+		// for recently, so captures of different sizes don't keep replacing each other
+		std::atomic<uint32_t> requestSerial;
+		std::atomic<uint64_t> requestTime;
+		int32_t requestCount;
+		Rect requests[maxRects];
+		// Newest complete slot, -1 before the first one
+		std::atomic<int32_t> latestSlot;
+		Slot slots[slotCount];
+	};
+
+	constexpr size_t headerBytes = (sizeof(Header) + 4095) / 4096 * 4096;
+	constexpr size_t totalBytes = headerBytes + slotCount * slotBytes;
+
+	inline uint8_t* SlotData(Header* header, int slot) {
+		return reinterpret_cast<uint8_t*>(header) + headerBytes + slot * slotBytes;
+	}
+
+	// Posix shm object of a client process
+	inline void ShmName(char* buffer, size_t length, int pid) {
+		snprintf(buffer, length, "/alt1gl-%d", pid);
+	}
+
+	inline uint64_t MonotonicMs() {
+		timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+	}
+}
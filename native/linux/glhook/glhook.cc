@@ -0,0 +1,290 @@
+#include <cstring>
+#include <cstdlib>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <GL/gl.h>
+#include <GL/glx.h>
+#include <GL/glext.h>
+#include "../glframes.h"
+
+// LD_PRELOAD shim for the game client: LD_PRELOAD=/path/to/alt1glhook.so <client>
+// Reads back the rects the addon asks for right before every swap, see glframes.h for the shared memory protocol.
+// Readback goes through two pixel buffer objects, the pixels read at one swap are published at the next one so the
+// render thread never waits on the gpu
+
+typedef void (*SwapBuffersProc)(Display*, GLXDrawable);
+typedef __GLXextFuncPtr (*GetProcAddressProc)(const GLubyte*);
+
+namespace {
+	SwapBuffersProc realSwapBuffers = NULL;
+	GetProcAddressProc realGetProcAddress = NULL;
+	GetProcAddressProc realGetProcAddressARB = NULL;
+
+	PFNGLGENBUFFERSPROC genBuffers = NULL;
+	PFNGLBINDBUFFERPROC bindBuffer = NULL;
+	PFNGLBUFFERDATAPROC bufferData = NULL;
+	PFNGLMAPBUFFERRANGEPROC mapBufferRange = NULL;
+	PFNGLUNMAPBUFFERPROC unmapBuffer = NULL;
+	PFNGLBINDFRAMEBUFFERPROC bindFramebuffer = NULL;
+	// Optional, without sync objects the map call waits for the readback itself
+	PFNGLFENCESYNCPROC fenceSync = NULL;
+	PFNGLCLIENTWAITSYNCPROC clientWaitSync = NULL;
+	PFNGLDELETESYNCPROC deleteSync = NULL;
+
+	glframes::Header* ring = NULL;
+	bool disabled = false;
+	char ringName[64];
+
+	struct Readback {
+		GLuint pbo = 0;
+		size_t capacity = 0;
+		GLsync fence = NULL;
+		bool active = false;
+		uint32_t serial = 0;
+		int count = 0;
+		glframes::Rect rects[glframes::maxRects];
+	};
+	Readback readbacks[2];
+	int currentReadback = 0;
+
+	void resolveReal() {
+		if (!realSwapBuffers) {
+			realSwapBuffers = (SwapBuffersProc)dlsym(RTLD_NEXT, "glXSwapBuffers");
+			realGetProcAddress = (GetProcAddressProc)dlsym(RTLD_NEXT, "glXGetProcAddress");
+			realGetProcAddressARB = (GetProcAddressProc)dlsym(RTLD_NEXT, "glXGetProcAddressARB");
+		}
+	}
+
+	// Either lookup entry point can be missing from the real library, use whichever exists
+	__GLXextFuncPtr getProcAddress(const GLubyte* name) {
+		GetProcAddressProc get = (realGetProcAddressARB ? realGetProcAddressARB : realGetProcAddress);
+		return (get ? get(name) : NULL);
+	}
+
+	__GLXextFuncPtr loadProc(const char* name) {
+		return getProcAddress((const GLubyte*)name);
+	}
+
+	void unlinkRing() {
+		shm_unlink(ringName);
+	}
+
+	bool openRing() {
+		genBuffers = (PFNGLGENBUFFERSPROC)loadProc("glGenBuffers");
+		bindBuffer = (PFNGLBINDBUFFERPROC)loadProc("glBindBuffer");
+		bufferData = (PFNGLBUFFERDATAPROC)loadProc("glBufferData");
+		mapBufferRange = (PFNGLMAPBUFFERRANGEPROC)loadProc("glMapBufferRange");
+		unmapBuffer = (PFNGLUNMAPBUFFERPROC)loadProc("glUnmapBuffer");
+		bindFramebuffer = (PFNGLBINDFRAMEBUFFERPROC)loadProc("glBindFramebuffer");
+		fenceSync = (PFNGLFENCESYNCPROC)loadProc("glFenceSync");
+		clientWaitSync = (PFNGLCLIENTWAITSYNCPROC)loadProc("glClientWaitSync");
+		deleteSync = (PFNGLDELETESYNCPROC)loadProc("glDeleteSync");
+		if (!genBuffers || !bindBuffer || !bufferData || !mapBufferRange || !unmapBuffer || !bindFramebuffer) {
+			fprintf(stderr, "alt1glhook: pixel buffer objects are not available, capture disabled\n");
+			return false;
+		}
+
+		glframes::ShmName(ringName, sizeof(ringName), getpid());
+		int fd = shm_open(ringName, O_CREAT | O_RDWR | O_TRUNC, 0600);
+		if (fd == -1) {
+			return false;
+		}
+		if (ftruncate(fd, glframes::totalBytes) != 0) {
+			close(fd);
+			shm_unlink(ringName);
+			return false;
+		}
+		void* mem = mmap(NULL, glframes::totalBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (mem == MAP_FAILED) {
+			shm_unlink(ringName);
+			return false;
+		}
+		// Fresh pages are zero, which is a valid empty state for everything except these
+		ring = reinterpret_cast<glframes::Header*>(mem);
+		ring->latestSlot = -1;
+		ring->version = glframes::version;
+		std::atomic_thread_fence(std::memory_order_release);
+		ring->magic = glframes::magic;
+		atexit(unlinkRing);
+		return true;
+	}
+
+	// Copies a finished readback into the next slot, flipping the rows to top first
+	void publish(Readback& readback) {
+		if (readback.fence) {
+			GLenum status = clientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 2000000);
+			deleteSync(readback.fence);
+			readback.fence = NULL;
+			if (status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED) {
+				return;
+			}
+		}
+		size_t total = 0;
+		for (int i = 0; i < readback.count; i++) {
+			total += (size_t)readback.rects[i].width * readback.rects[i].height * 4;
+		}
+		bindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+		const uint8_t* src = (const uint8_t*)mapBufferRange(GL_PIXEL_PACK_BUFFER, 0, total, GL_MAP_READ_BIT);
+		if (!src) {
+			return;
+		}
+		int slotIndex = (ring->latestSlot.load() + 1) % glframes::slotCount;
+		glframes::Slot& slot = ring->slots[slotIndex];
+		uint8_t* dst = glframes::SlotData(ring, slotIndex);
+		slot.seq.fetch_add(1, std::memory_order_acq_rel);
+		size_t offset = 0;
+		for (int i = 0; i < readback.count; i++) {
+			auto& rect = readback.rects[i];
+			size_t stride = (size_t)rect.width * 4;
+			for (int y = 0; y < rect.height; y++) {
+				memcpy(dst + offset + y * stride, src + offset + (rect.height - 1 - y) * stride, stride);
+			}
+			offset += stride * rect.height;
+		}
+		slot.rectCount = readback.count;
+		memcpy(slot.rects, readback.rects, sizeof(glframes::Rect) * readback.count);
+		slot.requestSerial = readback.serial;
+		slot.frame = ring->frameCount.load();
+		slot.seq.fetch_add(1, std::memory_order_release);
+		ring->latestSlot = slotIndex;
+		unmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+
+	// Starts reading the requested rects of the back buffer into a pixel buffer object
+	void startReadback(Readback& readback, int width, int height) {
+		uint32_t serial = ring->requestSerial.load(std::memory_order_acquire);
+		// The addon is writing a new request
+		if (serial % 2 != 0) {
+			return;
+		}
+		readback.count = ring->requestCount;
+		if (readback.count <= 0 || readback.count > glframes::maxRects) {
+			return;
+		}
+		memcpy(readback.rects, ring->requests, sizeof(glframes::Rect) * readback.count);
+		// The request changed while we copied it
+		if (ring->requestSerial.load(std::memory_order_acquire) != serial) {
+			return;
+		}
+		size_t total = 0;
+		for (int i = 0; i < readback.count; i++) {
+			auto& rect = readback.rects[i];
+			if (rect.x < 0 || rect.y < 0 || rect.width <= 0 || rect.height <= 0 || rect.x + rect.width > width || rect.y + rect.height > height) {
+				return;
+			}
+			total += (size_t)rect.width * rect.height * 4;
+		}
+		if (total > glframes::slotBytes) {
+			return;
+		}
+
+		GLint packBuffer, readFramebuffer, readBuffer, alignment, rowLength, skipRows, skipPixels;
+		glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &packBuffer);
+		glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+		glGetIntegerv(GL_READ_BUFFER, &readBuffer);
+		glGetIntegerv(GL_PACK_ALIGNMENT, &alignment);
+		glGetIntegerv(GL_PACK_ROW_LENGTH, &rowLength);
+		glGetIntegerv(GL_PACK_SKIP_ROWS, &skipRows);
+		glGetIntegerv(GL_PACK_SKIP_PIXELS, &skipPixels);
+
+		if (readback.pbo == 0) {
+			genBuffers(1, &readback.pbo);
+		}
+		bindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+		if (readback.capacity < total) {
+			bufferData(GL_PIXEL_PACK_BUFFER, total, NULL, GL_STREAM_READ);
+			readback.capacity = total;
+		}
+		bindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+		glReadBuffer(GL_BACK);
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+		glPixelStorei(GL_PACK_SKIP_ROWS, 0);
+		glPixelStorei(GL_PACK_SKIP_PIXELS, 0);
+		size_t offset = 0;
+		for (int i = 0; i < readback.count; i++) {
+			auto& rect = readback.rects[i];
+			glReadPixels(rect.x, height - rect.y - rect.height, rect.width, rect.height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)offset);
+			offset += (size_t)rect.width * rect.height * 4;
+		}
+		if (fenceSync) {
+			readback.fence = fenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		}
+		readback.serial = serial;
+		readback.active = true;
+
+		glPixelStorei(GL_PACK_ALIGNMENT, alignment);
+		glPixelStorei(GL_PACK_ROW_LENGTH, rowLength);
+		glPixelStorei(GL_PACK_SKIP_ROWS, skipRows);
+		glPixelStorei(GL_PACK_SKIP_PIXELS, skipPixels);
+		glReadBuffer(readBuffer);
+		bindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+		bindBuffer(GL_PIXEL_PACK_BUFFER, packBuffer);
+	}
+
+	void beforeSwap(Display* dpy, GLXDrawable drawable) {
+		if (disabled) {
+			return;
+		}
+		if (!ring && !openRing()) {
+			disabled = true;
+			return;
+		}
+		unsigned int width = 0, height = 0;
+		glXQueryDrawable(dpy, drawable, GLX_WIDTH, &width);
+		glXQueryDrawable(dpy, drawable, GLX_HEIGHT, &height);
+		ring->drawable = (uint32_t)drawable;
+		ring->width = width;
+		ring->height = height;
+		ring->frameCount.fetch_add(1);
+
+		// Publish what was read at the previous swap, by now the gpu is done with it
+		Readback& previous = readbacks[currentReadback ^ 1];
+		if (previous.active) {
+			GLint packBuffer;
+			glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &packBuffer);
+			publish(previous);
+			bindBuffer(GL_PIXEL_PACK_BUFFER, packBuffer);
+			previous.active = false;
+		}
+		// Nothing is read back while nobody is asking for frames
+		if (glframes::MonotonicMs() - ring->requestTime.load() > glframes::requestTimeoutMs) {
+			return;
+		}
+		startReadback(readbacks[currentReadback], width, height);
+		if (readbacks[currentReadback].active) {
+			currentReadback ^= 1;
+		}
+	}
+}
+
+extern "C" {
+	__attribute__((visibility("default"))) void glXSwapBuffers(Display* dpy, GLXDrawable drawable) {
+		resolveReal();
+		if (!realSwapBuffers) {
+			return;
+		}
+		beforeSwap(dpy, drawable);
+		realSwapBuffers(dpy, drawable);
+	}
+
+	// Clients that look the swap function up at runtime have to get the hooked one as well
+	__attribute__((visibility("default"))) __GLXextFuncPtr glXGetProcAddressARB(const GLubyte* name) {
+		resolveReal();
+		if (strcmp((const char*)name, "glXSwapBuffers") == 0) {
+			return (__GLXextFuncPtr)glXSwapBuffers;
+		}
+		return getProcAddress(name);
+	}
+
+	__attribute__((visibility("default"))) __GLXextFuncPtr glXGetProcAddress(const GLubyte* name) {
+		resolveReal();
+		if (strcmp((const char*)name, "glXSwapBuffers") == 0) {
+			return (__GLXextFuncPtr)glXSwapBuffers;
+		}
+		return getProcAddress(name);
+	}
+}
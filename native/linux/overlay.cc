@@ -0,0 +1,615 @@
+#include <iostream>
+#include <map>
+#include <tuple>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <xcb/shm.h>
+#include <xcb/shape.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include <fontconfig/fontconfig.h>
+#include "overlay.h"
+
+namespace priv_os_x11 {
+	// Rasterizes overlay text with freetype, fonts are looked up by name through fontconfig.
+	// Only used from the overlay thread
+	class FreeTypeTextRenderer : public OverlayTextRenderer {
+		struct Glyph {
+			int left;
+			int top;
+			int advance;
+			int width;
+			int height;
+			std::vector<byte> coverage;
+		};
+		FT_Library library = nullptr;
+		std::map<std::string, FT_Face> faces;
+		std::map<std::tuple<FT_Face, int, uint32_t>, Glyph> glyphs;
+
+		FT_Face GetFace(const std::string& fontname, int pixelsize);
+		const Glyph& GetGlyph(FT_Face face, int pixelsize, uint32_t codepoint);
+		std::vector<uint32_t> DecodeUtf8(const std::string& str);
+		// Bounds of the text without shadow, also returns the baseline offset from the top
+		JSRectangle Layout(const OverlayPrimitive& text, int* ascent);
+	public:
+		FreeTypeTextRenderer() {
+			if (FT_Init_FreeType(&library) != 0) {
+				std::cout << "native: couldn't initialize freetype; overlay text will not be drawn" << std::endl;
+				library = nullptr;
+			}
+		}
+		~FreeTypeTextRenderer() {
+			for (auto& face : faces) { FT_Done_Face(face.second); }
+			if (library) { FT_Done_FreeType(library); }
+		}
+		JSRectangle Measure(const OverlayPrimitive& text) override;
+		void Draw(OverlaySurface& surface, const OverlayPrimitive& text, const JSRectangle& clip) override;
+	};
+
+	FT_Face FreeTypeTextRenderer::GetFace(const std::string& fontname, int pixelsize) {
+		std::string name = (fontname.empty() ? "sans-serif" : fontname);
+		FT_Face face = nullptr;
+		auto existing = faces.find(name);
+		if (existing != faces.end()) {
+			face = existing->second;
+		} else {
+			FcPattern* pattern = FcNameParse(reinterpret_cast<const FcChar8*>(name.c_str()));
+			FcConfigSubstitute(NULL, pattern, FcMatchPattern);
+			FcDefaultSubstitute(pattern);
+			FcResult result;
+			FcPattern* match = FcFontMatch(NULL, pattern, &result);
+			FcChar8* file = nullptr;
+			int index = 0;
+			if (match && FcPatternGetString(match, FC_FILE, 0, &file) == FcResultMatch) {
+				FcPatternGetInteger(match, FC_INDEX, 0, &index);
+				if (FT_New_Face(library, reinterpret_cast<const char*>(file), index, &face) != 0) {
+					face = nullptr;
+				}
+			}
+			if (match) { FcPatternDestroy(match); }
+			FcPatternDestroy(pattern);
+			// Also cache failures so we don't hit fontconfig for every frame
+			faces[name] = face;
+		}
+		if (face) { FT_Set_Pixel_Sizes(face, 0, pixelsize); }
+		return face;
+	}
+
+	const FreeTypeTextRenderer::Glyph& FreeTypeTextRenderer::GetGlyph(FT_Face face, int pixelsize, uint32_t codepoint) {
+		auto key = std::make_tuple(face, pixelsize, codepoint);
+		auto existing = glyphs.find(key);
+		if (existing != glyphs.end()) {
+			return existing->second;
+		}
+		Glyph glyph = { 0, 0, 0, 0, 0, {} };
+		if (FT_Load_Char(face, codepoint, FT_LOAD_RENDER) == 0) {
+			FT_GlyphSlot slot = face->glyph;
+			glyph.left = slot->bitmap_left;
+			glyph.top = slot->bitmap_top;
+			glyph.advance = slot->advance.x >> 6;
+			glyph.width = slot->bitmap.width;
+			glyph.height = slot->bitmap.rows;
+			glyph.coverage.resize((size_t)glyph.width * glyph.height);
+			for (int y = 0; y < glyph.height; y++) {
+				memcpy(glyph.coverage.data() + (size_t)y * glyph.width, slot->bitmap.buffer + (ptrdiff_t)y * slot->bitmap.pitch, glyph.width);
+			}
+		}
+		return glyphs.emplace(key, std::move(glyph)).first->second;
+	}
+
+	std::vector<uint32_t> FreeTypeTextRenderer::DecodeUtf8(const std::string& str) {
+		std::vector<uint32_t> out;
+		for (size_t i = 0; i < str.size();) {
+			byte c = str[i];
+			int len = (c < 0x80 ? 1 : (c >> 5) == 0x6 ? 2 : (c >> 4) == 0xe ? 3 : (c >> 3) == 0x1e ? 4 : 1);
+			uint32_t codepoint = (len == 1 ? c : c & (0x7f >> len));
+			for (int j = 1; j < len && i + j < str.size(); j++) {
+				codepoint = (codepoint << 6) | (str[i + j] & 0x3f);
+			}
+			out.push_back(codepoint);
+			i += len;
+		}
+		return out;
+	}
+
+	JSRectangle FreeTypeTextRenderer::Layout(const OverlayPrimitive& text, int* ascent) {
+		// Sizes are in pt like the css font in the js overlay, assume 96 dpi
+		int pixelsize = std::max(1, text.size * 96 / 72);
+		FT_Face face = (library ? GetFace(text.font, pixelsize) : nullptr);
+		if (!face) {
+			*ascent = 0;
+			return JSRectangle(text.x, text.y, 0, 0);
+		}
+		int width = 0;
+		for (uint32_t codepoint : DecodeUtf8(text.text)) {
+			width += GetGlyph(face, pixelsize, codepoint).advance;
+		}
+		*ascent = face->size->metrics.ascender >> 6;
+		int height = (face->size->metrics.ascender - face->size->metrics.descender) >> 6;
+		// Same anchoring as textAlign/textBaseline in the js overlay
+		if (text.center) {
+			return JSRectangle(text.x - width / 2, text.y - height / 2, width, height);
+		}
+		return JSRectangle(text.x, text.y, width, height);
+	}
+
+	JSRectangle FreeTypeTextRenderer::Measure(const OverlayPrimitive& text) {
+		int ascent;
+		auto rect = Layout(text, &ascent);
+		// Glyphs can overhang their advance a little, pad to be safe
+		int pad = 2 + (text.shadow ? 1 : 0);
+		return JSRectangle(rect.x - 2, rect.y - 2, rect.width + 2 + pad, rect.height + 2 + pad);
+	}
+
+	void FreeTypeTextRenderer::Draw(OverlaySurface& surface, const OverlayPrimitive& text, const JSRectangle& clip) {
+		int ascent;
+		auto rect = Layout(text, &ascent);
+		int pixelsize = std::max(1, text.size * 96 / 72);
+		FT_Face face = (library ? GetFace(text.font, pixelsize) : nullptr);
+		if (!face) { return; }
+		auto codepoints = DecodeUtf8(text.text);
+		auto area = OverlayIntersect(clip, JSRectangle(0, 0, surface.width, surface.height));
+		for (int pass = (text.shadow ? 0 : 1); pass < 2; pass++) {
+			// Shadow pass draws black one pixel down and to the right
+			uint32_t color = (pass == 0 ? 0 : text.color);
+			int penx = rect.x + (pass == 0 ? 1 : 0);
+			int baseline = rect.y + ascent + (pass == 0 ? 1 : 0);
+			for (uint32_t codepoint : codepoints) {
+				auto& glyph = GetGlyph(face, pixelsize, codepoint);
+				int glyphx = penx + glyph.left;
+				int glyphy = baseline - glyph.top;
+				auto glyphrect = OverlayIntersect(JSRectangle(glyphx, glyphy, glyph.width, glyph.height), area);
+				for (int y = glyphrect.y; y < glyphrect.y + glyphrect.height; y++) {
+					uint32_t* row = surface.pixels + (size_t)y * surface.stride;
+					const byte* src = glyph.coverage.data() + (size_t)(y - glyphy) * glyph.width;
+					for (int x = glyphrect.x; x < glyphrect.x + glyphrect.width; x++) {
+						byte coverage = src[x - glyphx];
+						if (coverage) { OverlayBlendPixel(row + x, OverlayPremultiply(color, coverage)); }
+					}
+				}
+				penx += glyph.advance;
+			}
+		}
+	}
+
+	struct NativeOverlay {
+		xcb_window_t client;
+		// Child of the root that contains the client, the window manager frame if there is one
+		xcb_window_t toplevel = XCB_NONE;
+		xcb_window_t window = XCB_NONE;
+		xcb_gcontext_t gc = XCB_NONE;
+		JSRectangle bounds = JSRectangle(0, 0, 0, 0);
+		bool mapped = false;
+		// Whether the client and all its parents are mapped, the overlay hides with it when it is minimized
+		bool clientViewable = true;
+		bool boundsChanged = true;
+		bool mapChanged = false;
+		// Something was stacked on top of the overlay or the client was raised past it
+		bool restack = false;
+
+		int shmId = -1;
+		uint32_t* shm = nullptr;
+		xcb_shm_seg_t shmSeg = 0;
+		JSRectangle shmSize = JSRectangle(0, 0, 0, 0);
+
+		OverlayScene scene;
+		int64_t nextupdate = 0;
+
+		// Locked by overlayMutex, handed over to the overlay thread. Everything else is only used by the overlay thread
+		std::vector<std::pair<int, std::vector<OverlayCommand>>> pendingCommands;
+		std::vector<int> pendingClosedFrames;
+
+		NativeOverlay(xcb_window_t client, OverlayTextRenderer* text) :client(client), scene(text) {}
+	};
+
+	std::thread overlayThread;
+	std::atomic<bool> overlayThreadStop(false);
+	std::mutex overlayMutex; // Locks overlays and the pending fields of each overlay
+	// Only the overlay thread removes entries, it can keep using an overlay after releasing the lock
+	std::map<xcb_window_t, std::unique_ptr<NativeOverlay>> overlays;
+	int overlayWakeFd = -1;
+
+	// Everything below is only used from the overlay thread
+	xcb_connection_t* overlayConnection = NULL;
+	xcb_screen_t* overlayScreen = NULL;
+	xcb_visualid_t argbVisual = 0;
+	xcb_colormap_t argbColormap = XCB_NONE;
+
+	int64_t OverlayNow() {
+		return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	void WakeOverlayThread() {
+		uint64_t one = 1;
+		if (write(overlayWakeFd, &one, sizeof(one)) < 0) {
+			std::cout << "native: failed to wake overlay thread" << std::endl;
+		}
+	}
+
+	bool InitOverlayConnection() {
+		overlayConnection = xcb_connect(NULL, NULL);
+		if (xcb_connection_has_error(overlayConnection)) {
+			std::cout << "native: couldn't open overlay connection; native overlays will not work" << std::endl;
+			return false;
+		}
+		overlayScreen = xcb_setup_roots_iterator(xcb_get_setup(overlayConnection)).data;
+		// Overlays need a 32 bit visual to be transparent
+		for (auto depth = xcb_screen_allowed_depths_iterator(overlayScreen); depth.rem && !argbVisual; xcb_depth_next(&depth)) {
+			if (depth.data->depth != 32) { continue; }
+			for (auto visual = xcb_depth_visuals_iterator(depth.data); visual.rem; xcb_visualtype_next(&visual)) {
+				if (visual.data->_class == XCB_VISUAL_CLASS_TRUE_COLOR) {
+					argbVisual = visual.data->visual_id;
+					break;
+				}
+			}
+		}
+		if (!argbVisual) {
+			std::cout << "native: no 32 bit visual available; native overlays will not work" << std::endl;
+			return false;
+		}
+		argbColormap = xcb_generate_id(overlayConnection);
+		xcb_create_colormap(overlayConnection, XCB_COLORMAP_ALLOC_NONE, argbColormap, overlayScreen->root, argbVisual);
+		return true;
+	}
+
+	// Same as OSWindow::GetClientBounds, but on the overlay connection
+	JSRectangle QueryClientBounds(xcb_window_t client) {
+		auto gcookie = xcb_get_geometry(overlayConnection, client);
+		auto tcookie = xcb_translate_coordinates(overlayConnection, client, overlayScreen->root, 0, 0);
+		std::unique_ptr<xcb_get_geometry_reply_t, decltype(&free)> geometry { xcb_get_geometry_reply(overlayConnection, gcookie, NULL), &free };
+		std::unique_ptr<xcb_translate_coordinates_reply_t, decltype(&free)> translation { xcb_translate_coordinates_reply(overlayConnection, tcookie, NULL), &free };
+		if (!geometry || !translation) {
+			return JSRectangle(0, 0, 0, 0);
+		}
+		return JSRectangle(translation->dst_x, translation->dst_y, geometry->width, geometry->height);
+	}
+
+	void CreateOverlayWindow(NativeOverlay& overlay) {
+		overlay.window = xcb_generate_id(overlayConnection);
+		// Value order has to match the bit order of the mask
+		const uint32_t values[] = { 0, 0, 1, XCB_EVENT_MASK_EXPOSURE, argbColormap };
+		xcb_create_window(overlayConnection, 32, overlay.window, overlayScreen->root, 0, 0, 1, 1, 0, XCB_WINDOW_CLASS_INPUT_OUTPUT, argbVisual,
+			XCB_CW_BACK_PIXEL | XCB_CW_BORDER_PIXEL | XCB_CW_OVERRIDE_REDIRECT | XCB_CW_EVENT_MASK | XCB_CW_COLORMAP, values);
+		// Empty input shape, all clicks go through to the client
+		xcb_shape_rectangles(overlayConnection, XCB_SHAPE_SO_SET, XCB_SHAPE_SK_INPUT, XCB_CLIP_ORDERING_YX_BANDED, overlay.window, 0, 0, 0, NULL);
+		overlay.gc = xcb_generate_id(overlayConnection);
+		xcb_create_gc(overlayConnection, overlay.gc, overlay.window, 0, NULL);
+
+		// Follow the client around
+		const uint32_t clientValues[] = { XCB_EVENT_MASK_STRUCTURE_NOTIFY };
+		xcb_change_window_attributes(overlayConnection, overlay.client, XCB_CW_EVENT_MASK, clientValues);
+		overlay.mapChanged = true;
+	}
+
+	bool QueryViewable(xcb_window_t window) {
+		std::unique_ptr<xcb_get_window_attributes_reply_t, decltype(&free)> attributes { xcb_get_window_attributes_reply(overlayConnection, xcb_get_window_attributes(overlayConnection, window), NULL), &free };
+		return attributes && attributes->map_state == XCB_MAP_STATE_VIEWABLE;
+	}
+
+	// Restacks of top level windows come in through the root, the overlay is a top level window itself
+	void SelectRootRestacks() {
+		const uint32_t rootValues[] = { XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY };
+		xcb_change_window_attributes(overlayConnection, overlayScreen->root, XCB_CW_EVENT_MASK, rootValues);
+	}
+
+	xcb_window_t QueryToplevel(xcb_window_t window) {
+		while (true) {
+			std::unique_ptr<xcb_query_tree_reply_t, decltype(&free)> tree { xcb_query_tree_reply(overlayConnection, xcb_query_tree(overlayConnection, window), NULL), &free };
+			if (!tree) { return XCB_NONE; }
+			if (tree->parent == tree->root || tree->parent == XCB_NONE) { return window; }
+			window = tree->parent;
+		}
+	}
+
+	void FreeOverlayShm(NativeOverlay& overlay) {
+		if (overlay.shm) {
+			xcb_shm_detach(overlayConnection, overlay.shmSeg);
+			shmdt(overlay.shm);
+			overlay.shm = nullptr;
+		}
+	}
+
+	bool ResizeOverlay(NativeOverlay& overlay) {
+		auto bounds = QueryClientBounds(overlay.client);
+		overlay.boundsChanged = false;
+		// The window manager may have reparented the client since we last looked
+		overlay.toplevel = QueryToplevel(overlay.client);
+		if (bounds.width <= 0 || bounds.height <= 0) {
+			return false;
+		}
+		if (bounds.x != overlay.bounds.x || bounds.y != overlay.bounds.y || bounds.width != overlay.bounds.width || bounds.height != overlay.bounds.height) {
+			const uint32_t values[] = { (uint32_t)bounds.x, (uint32_t)bounds.y, (uint32_t)bounds.width, (uint32_t)bounds.height };
+			xcb_configure_window(overlayConnection, overlay.window, XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y | XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT, values);
+		}
+		if (bounds.width != overlay.shmSize.width || bounds.height != overlay.shmSize.height) {
+			FreeOverlayShm(overlay);
+			overlay.shmId = shmget(IPC_PRIVATE, (size_t)bounds.width * bounds.height * 4, IPC_CREAT | 0600);
+			if (overlay.shmId == -1) {
+				return false;
+			}
+			void* mem = shmat(overlay.shmId, NULL, 0);
+			if (mem == (void*)-1) {
+				shmctl(overlay.shmId, IPC_RMID, NULL);
+				return false;
+			}
+			overlay.shm = reinterpret_cast<uint32_t*>(mem);
+			overlay.shmSeg = xcb_generate_id(overlayConnection);
+			xcb_shm_attach(overlayConnection, overlay.shmSeg, overlay.shmId, 0);
+			// Make sure the server attached before marking the segment for removal
+			free(xcb_get_input_focus_reply(overlayConnection, xcb_get_input_focus(overlayConnection), NULL));
+			shmctl(overlay.shmId, IPC_RMID, NULL);
+			overlay.shmSize = JSRectangle(0, 0, bounds.width, bounds.height);
+			overlay.scene.DamageAll(bounds.width, bounds.height);
+		}
+		overlay.bounds = bounds;
+		return true;
+	}
+
+	void DestroyOverlay(NativeOverlay& overlay) {
+		FreeOverlayShm(overlay);
+		if (overlay.window != XCB_NONE) {
+			xcb_free_gc(overlayConnection, overlay.gc);
+			xcb_destroy_window(overlayConnection, overlay.window);
+		}
+	}
+
+	// Redraws and sends only the damaged parts of the overlay
+	void PresentOverlay(NativeOverlay& overlay) {
+		auto damage = overlay.scene.TakeDamage();
+		if (!overlay.shm) {
+			return;
+		}
+		bool visible = overlay.clientViewable && !overlay.scene.IsEmpty();
+		if (visible && overlay.mapped && overlay.restack) {
+			const uint32_t stack[] = { XCB_STACK_MODE_ABOVE };
+			xcb_configure_window(overlayConnection, overlay.window, XCB_CONFIG_WINDOW_STACK_MODE, stack);
+		}
+		overlay.restack = false;
+		if (visible != overlay.mapped) {
+			if (visible) {
+				const uint32_t stack[] = { XCB_STACK_MODE_ABOVE };
+				xcb_map_window(overlayConnection, overlay.window);
+				xcb_configure_window(overlayConnection, overlay.window, XCB_CONFIG_WINDOW_STACK_MODE, stack);
+				// Everything needs to be drawn again after being unmapped
+				overlay.scene.DamageAll(overlay.shmSize.width, overlay.shmSize.height);
+				damage = overlay.scene.TakeDamage();
+			} else {
+				xcb_unmap_window(overlayConnection, overlay.window);
+			}
+			overlay.mapped = visible;
+		}
+		if (!overlay.mapped || damage.IsEmpty()) {
+			return;
+		}
+		OverlaySurface surface;
+		surface.pixels = overlay.shm;
+		surface.width = overlay.shmSize.width;
+		surface.height = overlay.shmSize.height;
+		surface.stride = overlay.shmSize.width;
+		for (auto& rect : damage.ToRects()) {
+			auto clip = OverlayIntersect(rect, overlay.shmSize);
+			if (clip.width == 0) { continue; }
+			overlay.scene.Render(surface, clip);
+			xcb_shm_put_image(overlayConnection, overlay.window, overlay.gc, surface.width, surface.height, clip.x, clip.y, clip.width, clip.height,
+				clip.x, clip.y, 32, XCB_IMAGE_FORMAT_Z_PIXMAP, 0, overlay.shmSeg, 0);
+		}
+		// The server reads straight from our memory, don't touch it again before it's done
+		free(xcb_get_input_focus_reply(overlayConnection, xcb_get_input_focus(overlayConnection), NULL));
+	}
+
+	void HandleOverlayEvent(xcb_generic_event_t* event) {
+		// Freed after releasing the lock
+		std::unique_ptr<NativeOverlay> destroyed;
+		std::unique_lock<std::mutex> lock(overlayMutex);
+		switch (event->response_type & ~0x80) {
+			case XCB_EXPOSE: {
+				auto expose = (xcb_expose_event_t*)event;
+				for (auto& entry : overlays) {
+					if (entry.second->window == expose->window) {
+						entry.second->scene.DamageAll(entry.second->shmSize.width, entry.second->shmSize.height);
+					}
+				}
+				break;
+			}
+			case XCB_CONFIGURE_NOTIFY: {
+				auto configure = (xcb_configure_notify_event_t*)event;
+				// Our own restacks report the window that used to be on top, re-raising for those would make two
+				// overlays fight over the top spot
+				for (auto& entry : overlays) {
+					if (entry.second->window == configure->window) { return; }
+				}
+				for (auto& entry : overlays) {
+					auto& overlay = *entry.second;
+					if (configure->window == overlay.client || configure->window == overlay.toplevel) {
+						// Moving the frame moves the client without a configure of its own
+						overlay.boundsChanged = true;
+						overlay.restack = true;
+					} else if (configure->above_sibling == overlay.window) {
+						overlay.restack = true;
+					}
+				}
+				break;
+			}
+			case XCB_UNMAP_NOTIFY:
+			case XCB_MAP_NOTIFY: {
+				// Same layout for both, minimizing unmaps either the client or its frame depending on the window manager
+				auto window = ((xcb_map_notify_event_t*)event)->window;
+				for (auto& entry : overlays) {
+					auto& overlay = *entry.second;
+					if (window == overlay.client || window == overlay.toplevel) {
+						overlay.mapChanged = true;
+						overlay.boundsChanged = true;
+						overlay.restack = true;
+					}
+				}
+				break;
+			}
+			case XCB_DESTROY_NOTIFY: {
+				auto destroy = (xcb_destroy_notify_event_t*)event;
+				auto overlay = overlays.find(destroy->window);
+				if (overlay != overlays.end()) {
+					destroyed = std::move(overlay->second);
+					overlays.erase(overlay);
+				}
+				break;
+			}
+		}
+		lock.unlock();
+		if (destroyed) {
+			DestroyOverlay(*destroyed);
+		}
+	}
+
+	void OverlayThread() {
+		FreeTypeTextRenderer textRenderer;
+		bool ok = InitOverlayConnection();
+		if (ok) { SelectRootRestacks(); }
+
+		// Handed over from the js thread, taken under the lock and applied without it
+		struct OverlayWork {
+			NativeOverlay* overlay;
+			std::vector<std::pair<int, std::vector<OverlayCommand>>> commands;
+			std::vector<int> closedFrames;
+		};
+		std::vector<OverlayWork> work;
+		while (!overlayThreadStop) {
+			int64_t now = OverlayNow();
+			int64_t nextupdate = INT64_MAX;
+			work.clear();
+			{
+				std::lock_guard<std::mutex> lock(overlayMutex);
+				for (auto& entry : overlays) {
+					auto& overlay = *entry.second;
+					if (!ok) {
+						overlay.pendingCommands.clear();
+						overlay.pendingClosedFrames.clear();
+						continue;
+					}
+					work.push_back({ &overlay, std::move(overlay.pendingCommands), std::move(overlay.pendingClosedFrames) });
+					overlay.pendingCommands.clear();
+					overlay.pendingClosedFrames.clear();
+				}
+			}
+			// The x round trips below would otherwise block the js thread when it sends the next frame
+			for (auto& item : work) {
+				auto& overlay = *item.overlay;
+				if (overlay.window == XCB_NONE) {
+					CreateOverlayWindow(overlay);
+					// Freetype only lives on this thread, so the scene gets its text renderer here
+					overlay.scene.SetTextRenderer(&textRenderer);
+				}
+				for (auto& frame : item.commands) {
+					overlay.scene.ApplyCommands(frame.first, frame.second, now);
+				}
+				for (int frameid : item.closedFrames) {
+					overlay.scene.CloseFrame(frameid);
+				}
+				if (overlay.mapChanged) {
+					overlay.clientViewable = QueryViewable(overlay.client);
+					overlay.mapChanged = false;
+				}
+				if (overlay.boundsChanged) {
+					ResizeOverlay(overlay);
+				}
+				overlay.nextupdate = overlay.scene.Update(now);
+				PresentOverlay(overlay);
+				nextupdate = std::min(nextupdate, overlay.nextupdate);
+			}
+			if (ok) {
+				xcb_flush(overlayConnection);
+			}
+
+			// Sleep until new commands arrive, an x event comes in or a primitive expires
+			pollfd fds[2];
+			fds[0].fd = overlayWakeFd;
+			fds[0].events = POLLIN;
+			fds[1].fd = (ok ? xcb_get_file_descriptor(overlayConnection) : -1);
+			fds[1].events = POLLIN;
+			int timeout = (nextupdate == INT64_MAX ? -1 : (int)std::max<int64_t>(0, std::min<int64_t>(nextupdate - now, INT32_MAX)));
+			poll(fds, 2, timeout);
+			if (fds[0].revents & POLLIN) {
+				uint64_t count;
+				if (read(overlayWakeFd, &count, sizeof(count)) < 0) {
+					std::cout << "native: failed to read overlay wakeup" << std::endl;
+				}
+			}
+			if (ok) {
+				while (xcb_generic_event_t* event = xcb_poll_for_event(overlayConnection)) {
+					HandleOverlayEvent(event);
+					free(event);
+				}
+				if (xcb_connection_has_error(overlayConnection)) {
+					std::cout << "native: overlay connection lost" << std::endl;
+					ok = false;
+				}
+			}
+		}
+
+		std::map<xcb_window_t, std::unique_ptr<NativeOverlay>> remaining;
+		{
+			std::lock_guard<std::mutex> lock(overlayMutex);
+			remaining.swap(overlays);
+		}
+		for (auto& entry : remaining) {
+			DestroyOverlay(*entry.second);
+		}
+		if (overlayConnection) {
+			xcb_flush(overlayConnection);
+			xcb_disconnect(overlayConnection);
+			overlayConnection = NULL;
+		}
+		argbVisual = 0;
+		std::cout << "native: overlay thread exiting" << std::endl;
+	}
+
+	// Expects overlayMutex to be held
+	NativeOverlay& GetOverlay(xcb_window_t client) {
+		if (!overlayThread.joinable()) {
+			overlayWakeFd = eventfd(0, EFD_CLOEXEC);
+			overlayThreadStop = false;
+			overlayThread = std::thread(OverlayThread);
+		}
+		auto& overlay = overlays[client];
+		if (!overlay) {
+			overlay = std::make_unique<NativeOverlay>(client, nullptr);
+		}
+		return *overlay;
+	}
+
+	void overlayCommands(xcb_window_t client, int frameid, std::vector<OverlayCommand>&& commands) {
+		{
+			std::lock_guard<std::mutex> lock(overlayMutex);
+			GetOverlay(client).pendingCommands.push_back({ frameid, std::move(commands) });
+		}
+		WakeOverlayThread();
+	}
+
+	void overlayCloseFrame(xcb_window_t client, int frameid) {
+		{
+			std::lock_guard<std::mutex> lock(overlayMutex);
+			auto overlay = overlays.find(client);
+			if (overlay == overlays.end()) { return; }
+			overlay->second->pendingClosedFrames.push_back(frameid);
+		}
+		WakeOverlayThread();
+	}
+
+	void stopOverlayThread() {
+		if (!overlayThread.joinable()) {
+			return;
+		}
+		overlayThreadStop = true;
+		WakeOverlayThread();
+		overlayThread.join();
+		close(overlayWakeFd);
+		overlayWakeFd = -1;
+	}
+}
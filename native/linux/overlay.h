@@ -0,0 +1,22 @@
+#pragma once
+#include <vector>
+#include <xcb/xcb.h>
+#include "../overlay.h"
+
+namespace priv_os_x11 {
+	/**
+	 * Queue overlay commands for the native overlay of 'client', the overlay window and the overlay thread
+	 * are created on first use. All drawing and presenting happens on the overlay thread.
+	 */
+	void overlayCommands(xcb_window_t client, int frameid, std::vector<OverlayCommand>&& commands);
+
+	/**
+	 * Drop all groups drawn by an app frame
+	 */
+	void overlayCloseFrame(xcb_window_t client, int frameid);
+
+	/**
+	 * Destroy all overlays and stop the overlay thread
+	 */
+	void stopOverlayThread();
+}
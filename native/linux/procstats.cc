@@ -0,0 +1,135 @@
+#include <map>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <condition_variable>
+#include <unistd.h>
+#include <proc/readproc.h>
+#include "procstats.h"
+
+namespace priv_os_x11 {
+	constexpr auto sampleInterval = std::chrono::seconds(1);
+	// Processes that weren't queried for this long are no longer sampled
+	constexpr auto watchTimeout = std::chrono::seconds(30);
+
+	struct ProcessSample {
+		OSProcessStats stats;
+		// utime + stime in clock ticks at the last sample
+		unsigned long long ticks = 0;
+		std::chrono::steady_clock::time_point sampleTime;
+		std::chrono::steady_clock::time_point lastQuery;
+		bool hasSample = false;
+	};
+
+	std::mutex samplerMutex; // Locks everything below
+	std::condition_variable samplerWake;
+	std::map<pid_t, ProcessSample> watchedProcesses;
+	std::thread samplerThread;
+	bool samplerThreadExists = false;
+	bool samplerThreadStop = false;
+
+	// Reads /proc for every pid in 'pids' and updates their samples, processes that are gone are removed.
+	// Expects samplerMutex to be held
+	void SampleProcesses(std::vector<pid_t> pids) {
+		static const long tickrate = sysconf(_SC_CLK_TCK);
+		static const long pagesize = sysconf(_SC_PAGESIZE);
+		if (pids.empty()) {
+			return;
+		}
+		auto now = std::chrono::steady_clock::now();
+		std::vector<pid_t> found;
+		// PROC_PID takes a 0 terminated list
+		pids.push_back(0);
+		// Only stat is needed, it has the cpu times, rss and thread count. status would allocate group names per process
+		PROCTAB* tab = openproc(PROC_FILLSTAT | PROC_PID, pids.data());
+		if (tab) {
+			while (proc_t* proc = readproc(tab, NULL)) {
+				auto entry = watchedProcesses.find(proc->tgid);
+				if (entry != watchedProcesses.end()) {
+					auto& sample = entry->second;
+					unsigned long long ticks = proc->utime + proc->stime;
+					if (sample.hasSample) {
+						double seconds = std::chrono::duration<double>(now - sample.sampleTime).count();
+						if (seconds > 0) {
+							sample.stats.cpu = (double)(ticks - sample.ticks) / tickrate / seconds;
+							sample.stats.cpuValid = true;
+						}
+					}
+					sample.ticks = ticks;
+					sample.sampleTime = now;
+					sample.hasSample = true;
+					sample.stats.pid = proc->tgid;
+					sample.stats.rss = (uint64_t)proc->rss * pagesize;
+					sample.stats.threads = proc->nlwp;
+					found.push_back(proc->tgid);
+				}
+				freeproc(proc);
+			}
+			closeproc(tab);
+		}
+		for (size_t i = 0; i + 1 < pids.size(); i++) {
+			if (std::find(found.begin(), found.end(), pids[i]) == found.end()) {
+				watchedProcesses.erase(pids[i]);
+			}
+		}
+	}
+
+	void SamplerThread() {
+		std::unique_lock<std::mutex> lock(samplerMutex);
+		while (!samplerThreadStop) {
+			samplerWake.wait_for(lock, sampleInterval);
+			if (samplerThreadStop) {
+				break;
+			}
+			auto now = std::chrono::steady_clock::now();
+			std::vector<pid_t> pids;
+			for (auto it = watchedProcesses.begin(); it != watchedProcesses.end();) {
+				if (now - it->second.lastQuery > watchTimeout) {
+					it = watchedProcesses.erase(it);
+				} else {
+					pids.push_back(it->first);
+					it++;
+				}
+			}
+			SampleProcesses(pids);
+			if (watchedProcesses.empty()) {
+				break;
+			}
+		}
+		samplerThreadExists = false;
+	}
+
+	OSProcessStats getProcessStats(pid_t pid) {
+		std::lock_guard<std::mutex> lock(samplerMutex);
+		auto entry = watchedProcesses.find(pid);
+		if (entry == watchedProcesses.end()) {
+			watchedProcesses[pid] = ProcessSample();
+			SampleProcesses({ pid });
+			entry = watchedProcesses.find(pid);
+			if (entry == watchedProcesses.end()) {
+				return OSProcessStats();
+			}
+		}
+		entry->second.lastQuery = std::chrono::steady_clock::now();
+
+		if (!samplerThreadExists) {
+			// The previous thread ran out of processes and exited on its own
+			if (samplerThread.joinable()) { samplerThread.join(); }
+			samplerThreadStop = false;
+			samplerThreadExists = true;
+			samplerThread = std::thread(SamplerThread);
+		}
+		return entry->second.stats;
+	}
+
+	void stopProcessSampler() {
+		std::unique_lock<std::mutex> lock(samplerMutex);
+		samplerThreadStop = true;
+		watchedProcesses.clear();
+		samplerWake.notify_all();
+		lock.unlock();
+		if (samplerThread.joinable()) { samplerThread.join(); }
+	}
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include <sys/types.h>
+#include "../os.h"
+
+namespace priv_os_x11 {
+	/**
+	 * Latest sample for 'pid', the process is watched by the sampler thread from now on and dropped again
+	 * once nobody asked for it for a while. The first call samples synchronously, cpu usage becomes
+	 * available after the next sample interval. Returns stats with pid 0 if the process doesn't exist
+	 */
+	OSProcessStats getProcessStats(pid_t pid);
+
+	/**
+	 * Stop the sampler thread and forget all watched processes
+	 */
+	void stopProcessSampler();
+}
@@ -0,0 +1,184 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <xcb/randr.h>
+#include "x11.h"
+#include "randr.h"
+
+namespace priv_os_x11 {
+	std::mutex monitorMutex; // Locks the cached topology
+	std::vector<OSMonitor> cachedMonitors;
+	bool monitorsValid = false;
+	// Set while the window thread receives RandR events, without them the cache expires after untrackedLifetime
+	std::atomic<bool> monitorsTracked(false);
+	std::chrono::steady_clock::time_point monitorsQueried;
+	// Short enough that a monitor change shows up right away, long enough that coordinate conversions in a burst
+	// don't each cost a round trip
+	constexpr auto untrackedLifetime = std::chrono::seconds(1);
+
+	const xcb_query_extension_reply_t* randrExtension() {
+		const xcb_query_extension_reply_t* ext = xcb_get_extension_data(connection, &xcb_randr_id);
+		return (ext && ext->present ? ext : NULL);
+	}
+
+	bool randrHasMonitors() {
+		xcb_randr_query_version_cookie_t cookie = xcb_randr_query_version(connection, 1, 5);
+		std::unique_ptr<xcb_randr_query_version_reply_t, decltype(&free)> reply { xcb_randr_query_version_reply(connection, cookie, NULL), &free };
+		return reply && (reply->major_version > 1 || reply->minor_version >= 5);
+	}
+
+	void queryMonitors(std::vector<OSMonitor>& out) {
+		xcb_randr_get_monitors_cookie_t cookie = xcb_randr_get_monitors(connection, rootWindow, 1);
+		std::unique_ptr<xcb_randr_get_monitors_reply_t, decltype(&free)> reply { xcb_randr_get_monitors_reply(connection, cookie, NULL), &free };
+		if (!reply) {
+			return;
+		}
+		// Names are atoms, request them all before waiting on any
+		std::vector<xcb_get_atom_name_cookie_t> names;
+		for (auto it = xcb_randr_get_monitors_monitors_iterator(reply.get()); it.rem; xcb_randr_monitor_info_next(&it)) {
+			xcb_randr_monitor_info_t* info = it.data;
+			OSMonitor monitor;
+			monitor.bounds = JSRectangle(info->x, info->y, info->width, info->height);
+			monitor.mmWidth = info->width_in_millimeters;
+			monitor.mmHeight = info->height_in_millimeters;
+			monitor.primary = info->primary;
+			out.push_back(monitor);
+			names.push_back(xcb_get_atom_name(connection, info->name));
+		}
+		for (size_t i = 0; i < names.size(); i++) {
+			std::unique_ptr<xcb_get_atom_name_reply_t, decltype(&free)> name { xcb_get_atom_name_reply(connection, names[i], NULL), &free };
+			if (name) {
+				out[i].name = std::string(xcb_get_atom_name_name(name.get()), xcb_get_atom_name_name_length(name.get()));
+			}
+		}
+	}
+
+	// Pre-1.5 servers have no monitor objects, every enabled crtc is a monitor
+	void queryCrtcs(std::vector<OSMonitor>& out) {
+		xcb_randr_get_screen_resources_current_cookie_t cookie = xcb_randr_get_screen_resources_current(connection, rootWindow);
+		std::unique_ptr<xcb_randr_get_screen_resources_current_reply_t, decltype(&free)> resources { xcb_randr_get_screen_resources_current_reply(connection, cookie, NULL), &free };
+		if (!resources) {
+			return;
+		}
+		xcb_randr_crtc_t* crtcs = xcb_randr_get_screen_resources_current_crtcs(resources.get());
+		int count = xcb_randr_get_screen_resources_current_crtcs_length(resources.get());
+		std::vector<xcb_randr_get_crtc_info_cookie_t> cookies;
+		for (int i = 0; i < count; i++) {
+			cookies.push_back(xcb_randr_get_crtc_info(connection, crtcs[i], resources->config_timestamp));
+		}
+		for (int i = 0; i < count; i++) {
+			std::unique_ptr<xcb_randr_get_crtc_info_reply_t, decltype(&free)> crtc { xcb_randr_get_crtc_info_reply(connection, cookies[i], NULL), &free };
+			if (!crtc || crtc->mode == XCB_NONE) {
+				continue;
+			}
+			OSMonitor monitor;
+			monitor.bounds = JSRectangle(crtc->x, crtc->y, crtc->width, crtc->height);
+			monitor.name = "crtc-" + std::to_string(crtcs[i]);
+			out.push_back(monitor);
+		}
+	}
+
+	double queryDisplayScale() {
+		xcb_get_property_cookie_t cookie = xcb_get_property(connection, 0, rootWindow, XCB_ATOM_RESOURCE_MANAGER, XCB_ATOM_STRING, 0, 16384);
+		std::unique_ptr<xcb_get_property_reply_t, decltype(&free)> reply { xcb_get_property_reply(connection, cookie, NULL), &free };
+		if (!reply) {
+			return 1;
+		}
+		std::string resources((const char*)xcb_get_property_value(reply.get()), xcb_get_property_value_length(reply.get()));
+		size_t pos = 0;
+		while (pos < resources.size()) {
+			size_t end = resources.find('\n', pos);
+			if (end == std::string::npos) { end = resources.size(); }
+			if (resources.compare(pos, 8, "Xft.dpi:") == 0) {
+				double dpi = std::atof(resources.c_str() + pos + 8);
+				return (dpi > 0 ? dpi / 96 : 1);
+			}
+			pos = end + 1;
+		}
+		return 1;
+	}
+
+	std::vector<OSMonitor> queryTopology() {
+		std::vector<OSMonitor> monitors;
+		if (randrExtension()) {
+			if (randrHasMonitors()) {
+				queryMonitors(monitors);
+			}
+			if (monitors.empty()) {
+				queryCrtcs(monitors);
+			}
+		}
+		// No RandR at all, the root window is the only monitor
+		if (monitors.empty()) {
+			xcb_screen_t* screen = xcb_setup_roots_iterator(xcb_get_setup(connection)).data;
+			OSMonitor monitor;
+			monitor.bounds = JSRectangle(0, 0, screen->width_in_pixels, screen->height_in_pixels);
+			monitor.mmWidth = screen->width_in_millimeters;
+			monitor.mmHeight = screen->height_in_millimeters;
+			monitor.primary = true;
+			monitors.push_back(monitor);
+		}
+		// X has a single dpi setting for the whole desktop
+		double scale = queryDisplayScale();
+		for (auto& monitor : monitors) {
+			monitor.scale = scale;
+		}
+		return monitors;
+	}
+
+	std::vector<OSMonitor> getMonitors() {
+		ensureConnection();
+		std::lock_guard<std::mutex> lock(monitorMutex);
+		auto now = std::chrono::steady_clock::now();
+		if (!monitorsValid || (!monitorsTracked && now - monitorsQueried > untrackedLifetime)) {
+			cachedMonitors = queryTopology();
+			monitorsValid = true;
+			monitorsQueried = now;
+		}
+		return cachedMonitors;
+	}
+
+	double getDisplayScale() {
+		auto monitors = getMonitors();
+		return (monitors.empty() ? 1 : monitors[0].scale);
+	}
+
+	void startMonitorTracking() {
+		if (randrExtension()) {
+			xcb_randr_select_input(connection, rootWindow, XCB_RANDR_NOTIFY_MASK_SCREEN_CHANGE | XCB_RANDR_NOTIFY_MASK_CRTC_CHANGE | XCB_RANDR_NOTIFY_MASK_OUTPUT_CHANGE);
+		}
+		invalidateMonitors();
+		monitorsTracked = true;
+	}
+
+	void stopMonitorTracking() {
+		monitorsTracked = false;
+		if (randrExtension()) {
+			xcb_randr_select_input(connection, rootWindow, 0);
+		}
+		invalidateMonitors();
+	}
+
+	bool handleMonitorEvent(const xcb_generic_event_t* event) {
+		const xcb_query_extension_reply_t* ext = randrExtension();
+		if (!ext) {
+			return false;
+		}
+		int type = (event->response_type & ~0x80) - ext->first_event;
+		if (type != XCB_RANDR_SCREEN_CHANGE_NOTIFY && type != XCB_RANDR_NOTIFY) {
+			return false;
+		}
+		invalidateMonitors();
+		return true;
+	}
+
+	void invalidateMonitors() {
+		std::lock_guard<std::mutex> lock(monitorMutex);
+		monitorsValid = false;
+		cachedMonitors.clear();
+	}
+}
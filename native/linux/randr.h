@@ -0,0 +1,34 @@
+#pragma once
+#include <vector>
+#include <xcb/xcb.h>
+#include "../os.h"
+
+namespace priv_os_x11 {
+	/**
+	 * Monitor topology from RandR, monitors (RandR 1.5) when available and active crtcs otherwise.
+	 * Cached until the next RandR event while monitor tracking is on, for a second otherwise
+	 */
+	std::vector<OSMonitor> getMonitors();
+
+	/**
+	 * Ratio of screen pixels to device independent pixels, from the Xft.dpi resource like chromium does
+	 */
+	double getDisplayScale();
+
+	/**
+	 * Select RandR change events on the root window, the caller has to pass every event it receives to
+	 * handleMonitorEvent for as long as tracking is on
+	 */
+	void startMonitorTracking();
+	void stopMonitorTracking();
+
+	/**
+	 * Drops the cached topology if the event is a RandR change notification, returns whether it was one
+	 */
+	bool handleMonitorEvent(const xcb_generic_event_t* event);
+
+	/**
+	 * Drops the cached topology and scale, for changes that come in as plain property events (RESOURCE_MANAGER)
+	 */
+	void invalidateMonitors();
+}
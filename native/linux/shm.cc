@@ -5,39 +5,84 @@
 #include <sys/ipc.h>
 #include <sys/shm.h>
 #include <xcb/shm.h>
+#include <vector>
+#include <algorithm>
 #include "shm.h"
+#include "../imagescale.h"
+#include "../scratch.h"
 
 namespace priv_os_x11 {
-	XShmCapture::XShmCapture(xcb_connection_t* c, xcb_drawable_t d) : connection(c), drawable(d), geometry(NULL, &free) {
-		xcb_get_geometry_cookie_t cookie = xcb_get_geometry_unchecked(c, d);
-		geometry = std::unique_ptr<xcb_get_geometry_reply_t, decltype(&free)> { xcb_get_geometry_reply(c, cookie, NULL), &free };
-		if (!geometry) {
-			throw new std::runtime_error("Unable to get image size");
+	// Segment of the calling thread, kept between captures so every frame lands in pages that are already mapped.
+	// It is marked for removal as soon as it exists, linux still lets the x server attach it and it can't outlive us
+	struct StagingSegment {
+		int id = -1;
+		char* data = nullptr;
+		size_t size = 0;
+		~StagingSegment() {
+			if (data) {
+				shmdt(data);
+			}
 		}
+	};
+	thread_local StagingSegment staging;
 
-		this->shmId = shmget(IPC_PRIVATE, geometry->width * geometry->height * 4, IPC_CREAT | 0600);
-		if (this->shmId == -1) {
+	static void reserveStaging(size_t size) {
+		if (staging.data && staging.size >= size) {
+			return;
+		}
+		if (staging.data) {
+			shmdt(staging.data);
+			staging.data = nullptr;
+		}
+		// Grow in steps so a slowly growing window doesn't get a new segment every frame
+		size_t step = 4 * 1024 * 1024;
+		size = (std::max<size_t>(size, 1) + step - 1) / step * step;
+		staging.id = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+		if (staging.id == -1) {
 			throw new std::runtime_error("Fail to allocate SHM");
 		}
-		this->shm = reinterpret_cast<char*>(shmat(this->shmId, NULL, SHM_RDONLY));
-		if (this->shm == (char *) -1) {
+		char* data = reinterpret_cast<char*>(shmat(staging.id, NULL, SHM_RDONLY));
+		shmctl(staging.id, IPC_RMID, NULL);
+		if (data == (char *) -1) {
 			throw new std::runtime_error("Cannot attach to SHM");
 		}
+		staging.data = data;
+		staging.size = size;
+	}
 
-		this->shmSeg = reinterpret_cast<xcb_shm_seg_t>(xcb_generate_id(c));
-		xcb_shm_attach(c, this->shmSeg, this->shmId, 0);
+	XShmCapture::XShmCapture(xcb_connection_t* c, xcb_drawable_t d) : connection(c), drawable(d) {
+		xcb_get_geometry_cookie_t cookie = xcb_get_geometry_unchecked(c, d);
+		std::unique_ptr<xcb_get_geometry_reply_t, decltype(&free)> geometry { xcb_get_geometry_reply(c, cookie, NULL), &free };
+		if (!geometry) {
+			throw new std::runtime_error("Unable to get image size");
+		}
+		this->width = geometry->width;
+		this->height = geometry->height;
+		grab(0, 0);
+	}
+
+	XShmCapture::XShmCapture(xcb_connection_t* c, xcb_drawable_t d, int x, int y, int w, int h) : connection(c), drawable(d), width(w), height(h) {
+		grab(x, y);
+	}
+
+	void XShmCapture::grab(int x, int y) {
+		reserveStaging((size_t)width * height * 4);
+		this->shmId = staging.id;
+		this->shm = staging.data;
+
+		this->shmSeg = reinterpret_cast<xcb_shm_seg_t>(xcb_generate_id(connection));
+		xcb_shm_attach(connection, this->shmSeg, this->shmId, 0);
 		
-		xcb_shm_get_image_cookie_t imageCookie = xcb_shm_get_image(c, d, 0, 0, geometry->width, geometry->height, 0xFFFFFF, XCB_IMAGE_FORMAT_Z_PIXMAP, this->shmSeg, 0);
-		std::unique_ptr<xcb_shm_get_image_reply_t, decltype(&free)> getImageReply { xcb_shm_get_image_reply(c, imageCookie, NULL), &free };
+		xcb_shm_get_image_cookie_t imageCookie = xcb_shm_get_image(connection, drawable, x, y, width, height, 0xFFFFFF, XCB_IMAGE_FORMAT_Z_PIXMAP, this->shmSeg, 0);
+		std::unique_ptr<xcb_shm_get_image_reply_t, decltype(&free)> getImageReply { xcb_shm_get_image_reply(connection, imageCookie, NULL), &free };
 		if (!getImageReply) {
+			xcb_shm_detach(connection, this->shmSeg);
 			throw new std::runtime_error("Fail to fetch image");
 		}
 	}
 
 	XShmCapture::~XShmCapture() {
-		shmdt(this->shm);
 		xcb_shm_detach(this->connection, this->shmSeg);
-		shmctl(this->shmId, IPC_RMID, NULL);
 	}
 
 	void XShmCapture::copy(char* target, size_t maxLength, int x, int y, int w, int h) {
@@ -49,8 +94,8 @@ namespace priv_os_x11 {
 		size_t targetPos = 0;
 		for (int row = y; row < y + h; row++) {
 			for (int col = x; col < x + w; col++) {
-				if (col >= 0 && row >= 0 && col < this->geometry->width && row < this->geometry->height) {
-					int pos = ((row * this->geometry->width) + col) * 4;
+				if (col >= 0 && row >= 0 && col < this->width && row < this->height) {
+					int pos = ((row * this->width) + col) * 4;
 					target[targetPos++] = this->shm[pos + 2];
 					target[targetPos++] = this->shm[pos + 1];
 					target[targetPos++] = this->shm[pos];
@@ -65,4 +110,24 @@ namespace priv_os_x11 {
 		}
 		assert(targetPos <= expectedSize);
 	}
+
+	void XShmCapture::copyScaled(char* target, size_t maxLength, int x, int y, int w, int h, int scale) {
+		size_t expectedSize = (size_t)DownscaledSize(w, scale) * DownscaledSize(h, scale) * 4;
+		if (expectedSize > maxLength) {
+			throw new std::invalid_argument("Insufficient buffer size");
+		}
+
+		int stride = this->width * 4;
+		if (x >= 0 && y >= 0 && x + w <= this->width && y + h <= this->height) {
+			// Straight from the shm segment, the filter also does the bgrx to rgba swap
+			DownscaleBox(reinterpret_cast<byte*>(this->shm) + (size_t)y * stride + x * 4, stride, w, h, scale, reinterpret_cast<byte*>(target), DownscaledSize(w, scale) * 4, true);
+		} else {
+			// Partially outside of the window, go through a full size copy so the black border is handled by copy()
+			ScratchScope scratch;
+			size_t size = (size_t)w * h * 4;
+			byte* full = scratch.Alloc<byte>(size);
+			copy(reinterpret_cast<char*>(full), size, x, y, w, h);
+			DownscaleBox(full, w * 4, w, h, scale, reinterpret_cast<byte*>(target), DownscaledSize(w, scale) * 4, false);
+		}
+	}
 }
@@ -7,15 +7,21 @@ namespace priv_os_x11 {
 		xcb_connection_t* connection;
 	public:
 		XShmCapture(xcb_connection_t* c, xcb_drawable_t d);
+		// Only grab part of the drawable, copy coordinates are relative to the top left of the area
+		XShmCapture(xcb_connection_t* c, xcb_drawable_t d, int x, int y, int w, int h);
 		~XShmCapture();
 
 		void copy(char* target, size_t maxLength, int x, int y, int w, int h);
+		// Copy with a box filter downscale by 'scale' in the same pass, target holds the downscaled size
+		void copyScaled(char* target, size_t maxLength, int x, int y, int w, int h, int scale);
 	
 	private:
 		xcb_drawable_t drawable;
 		int shmId;
 		char* shm;
 		xcb_shm_seg_t shmSeg;
-		std::unique_ptr<xcb_get_geometry_reply_t, decltype(&free)> geometry;
+		int width;
+		int height;
+		void grab(int x, int y);
 	};
 }
@@ -38,6 +38,19 @@ namespace priv_os_x11 {
 		}
 	}
 
+	void closeConnection() {
+		std::lock_guard<std::mutex> lock(conn_mtx);
+		if (connection == NULL) {
+			return;
+		}
+		xcb_ewmh_connection_wipe(&ewmhConnection);
+		xcb_disconnect(connection);
+		connection = NULL;
+
+		std::lock_guard<std::shared_mutex> atomlock(atoms_mtx);
+		atoms.clear();
+	}
+
 	xcb_atom_t getAtom(const char* name) { // FIXME: Unused?
 		std::string nameStr = std::string(name);
 
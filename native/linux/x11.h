@@ -14,5 +14,10 @@ namespace priv_os_x11 {
 	 */
 	void ensureConnection();
 
+	/**
+	 * Disconnect from X11, only to be called once nothing is using the connection anymore
+	 */
+	void closeConnection();
+
 	xcb_atom_t getAtom(const char* name);
 }
@@ -0,0 +1,64 @@
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <xcb/xinput.h>
+#include "x11.h"
+#include "xinput.h"
+
+namespace priv_os_x11 {
+	// Major opcode of XInput, raw events are generic events tagged with it
+	std::atomic<uint8_t> xinputOpcode(0);
+
+	void selectRawEvents(uint32_t events) {
+		struct {
+			xcb_input_event_mask_t head;
+			uint32_t mask;
+		} mask;
+		mask.head.deviceid = XCB_INPUT_DEVICE_ALL_MASTER;
+		mask.head.mask_len = 1;
+		mask.mask = events;
+		xcb_input_xi_select_events(connection, rootWindow, 1, &mask.head);
+		xcb_flush(connection);
+	}
+
+	bool startRawInput() {
+		const xcb_query_extension_reply_t* ext = xcb_get_extension_data(connection, &xcb_input_id);
+		if (!ext || !ext->present) {
+			return false;
+		}
+		// Raw events on the root window are delivered regardless of grabs from 2.1 on, 2.2 is what every current server has
+		xcb_input_xi_query_version_cookie_t cookie = xcb_input_xi_query_version(connection, 2, 2);
+		std::unique_ptr<xcb_input_xi_query_version_reply_t, decltype(&free)> reply { xcb_input_xi_query_version_reply(connection, cookie, NULL), &free };
+		if (!reply || reply->major_version < 2 || (reply->major_version == 2 && reply->minor_version < 2)) {
+			return false;
+		}
+		xinputOpcode = ext->major_opcode;
+		selectRawEvents(XCB_INPUT_XI_EVENT_MASK_RAW_BUTTON_PRESS | XCB_INPUT_XI_EVENT_MASK_RAW_BUTTON_RELEASE);
+		std::cout << "native: using XInput " << reply->major_version << "." << reply->minor_version << " raw events for mouse buttons" << std::endl;
+		return true;
+	}
+
+	void stopRawInput() {
+		if (xinputOpcode.exchange(0) != 0) {
+			selectRawEvents(0);
+		}
+	}
+
+	bool handleRawInputEvent(const xcb_generic_event_t* event, uint32_t& button, bool& pressed) {
+		if ((event->response_type & ~0x80) != XCB_GE_GENERIC) {
+			return false;
+		}
+		const xcb_ge_generic_event_t* generic = reinterpret_cast<const xcb_ge_generic_event_t*>(event);
+		if (xinputOpcode == 0 || generic->extension != xinputOpcode) {
+			return false;
+		}
+		if (generic->event_type != XCB_INPUT_RAW_BUTTON_PRESS && generic->event_type != XCB_INPUT_RAW_BUTTON_RELEASE) {
+			return false;
+		}
+		const xcb_input_raw_button_press_event_t* raw = reinterpret_cast<const xcb_input_raw_button_press_event_t*>(event);
+		button = raw->detail;
+		pressed = generic->event_type == XCB_INPUT_RAW_BUTTON_PRESS;
+		return true;
+	}
+}
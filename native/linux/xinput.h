@@ -0,0 +1,16 @@
+#pragma once
+#include <xcb/xcb.h>
+
+namespace priv_os_x11 {
+	/**
+	 * Select XInput 2 raw button events on the root window, they arrive on the main connection and have to be passed
+	 * to handleRawInputEvent. Returns false if the server has no XInput 2.2, XRecord has to be used instead then
+	 */
+	bool startRawInput();
+	void stopRawInput();
+
+	/**
+	 * Returns whether the event is a raw button event, button is 1 based like core button events
+	 */
+	bool handleRawInputEvent(const xcb_generic_event_t* event, uint32_t& button, bool& pressed);
+}
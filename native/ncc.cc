@@ -0,0 +1,371 @@
+#include <algorithm>
+#include <cmath>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define NCC_SSE2
+#endif
+#include "ncc.h"
+#include "imagescale.h"
+#include "scratch.h"
+
+//coarse needles smaller than this per side correlate with almost anything
+constexpr int minCoarseNeedle = 6;
+//an inexact match can correlate a bit worse once both sides are box filtered
+constexpr double coarseSlack = 0.1;
+
+//integer luma, the same weights are used for haystack and needle
+static inline int Luma(const byte* px) {
+	return (px[0] * 77 + px[1] * 150 + px[2] * 29) >> 8;
+}
+
+void IntegralImage::Build(const JSImageView& img) {
+	width = img.width;
+	height = img.height;
+	size_t tablesize = ((size_t)width + 1) * (height + 1);
+	size_t graysize = (size_t)width * height;
+	//one block for all three, counted in 64 bit units
+	storage.resize(tablesize + (tablesize + 1) / 2 + (graysize + 1) / 2);
+	sqsum = storage.data();
+	sum = reinterpret_cast<uint32_t*>(sqsum + tablesize);
+	gray = reinterpret_cast<float*>(sqsum + tablesize + (tablesize + 1) / 2);
+	Fill(img);
+}
+
+void IntegralImage::Build(const JSImageView& img, ScratchScope& scratch) {
+	width = img.width;
+	height = img.height;
+	size_t tablesize = ((size_t)width + 1) * (height + 1);
+	storage.clear();
+	sqsum = scratch.Alloc<uint64_t>(tablesize);
+	sum = scratch.Alloc<uint32_t>(tablesize);
+	gray = scratch.Alloc<float>((size_t)width * height);
+	Fill(img);
+}
+
+//writes every value of the tables, the memory can come in uninitialized
+void IntegralImage::Fill(const JSImageView& img) {
+	size_t stride = (size_t)width + 1;
+	std::fill(sum, sum + stride, 0);
+	std::fill(sqsum, sqsum + stride, 0);
+	for (int y = 0; y < height; y++) {
+		const byte* src = img.Pixel(0, y);
+		float* grayrow = gray + (size_t)y * width;
+		uint32_t* sumrow = sum + (y + 1) * stride;
+		uint64_t* sqrow = sqsum + (y + 1) * stride;
+		sumrow[0] = 0;
+		sqrow[0] = 0;
+		//running sums of this row only
+		uint32_t rowsum = 0;
+		uint64_t rowsq = 0;
+		for (int x = 0; x < width; x++) {
+			int v = Luma(src + x * 4);
+			grayrow[x] = (float)v;
+			rowsum += v;
+			rowsq += v * v;
+			sumrow[x + 1] = rowsum;
+			sqrow[x + 1] = rowsq;
+		}
+		//add the table row above, this part has no dependency between columns
+		const uint32_t* sumabove = sumrow - stride;
+		const uint64_t* sqabove = sqrow - stride;
+		size_t x = 0;
+#ifdef NCC_SSE2
+		for (; x + 4 <= stride; x += 4) {
+			__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sumrow + x));
+			__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sumabove + x));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(sumrow + x), _mm_add_epi32(a, b));
+		}
+#endif
+		for (; x < stride; x++) { sumrow[x] += sumabove[x]; }
+		x = 0;
+#ifdef NCC_SSE2
+		for (; x + 2 <= stride; x += 2) {
+			__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sqrow + x));
+			__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sqabove + x));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(sqrow + x), _mm_add_epi64(a, b));
+		}
+#endif
+		for (; x < stride; x++) { sqrow[x] += sqabove[x]; }
+	}
+}
+
+uint32_t IntegralImage::RectSum(int x, int y, int w, int h) const {
+	size_t stride = (size_t)width + 1;
+	const uint32_t* top = sum + y * stride;
+	const uint32_t* bottom = sum + (y + h) * stride;
+	return bottom[x + w] - bottom[x] - top[x + w] + top[x];
+}
+
+uint64_t IntegralImage::RectSquareSum(int x, int y, int w, int h) const {
+	size_t stride = (size_t)width + 1;
+	const uint64_t* top = sqsum + y * stride;
+	const uint64_t* bottom = sqsum + (y + h) * stride;
+	return bottom[x + w] - bottom[x] - top[x + w] + top[x];
+}
+
+NccNeedle::NccNeedle(const JSImageView& img) :width(img.width), height(img.height) {
+	size_t rows = (size_t)height + 1;
+	size_t count = (size_t)width * height;
+	storage.resize(2 * rows + (count + 1) / 2);
+	remainingSquares = storage.data();
+	rowPrefix = storage.data() + rows;
+	centered = reinterpret_cast<float*>(storage.data() + 2 * rows);
+	Fill(img);
+}
+
+NccNeedle::NccNeedle(const JSImageView& img, ScratchScope& scratch) :width(img.width), height(img.height) {
+	remainingSquares = scratch.Alloc<double>((size_t)height + 1);
+	rowPrefix = scratch.Alloc<double>((size_t)height + 1);
+	centered = scratch.Alloc<float>((size_t)width * height);
+	Fill(img);
+}
+
+void NccNeedle::Fill(const JSImageView& img) {
+	size_t count = (size_t)width * height;
+	double total = 0;
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			int v = Luma(img.Pixel(x, y));
+			centered[(size_t)y * width + x] = (float)v;
+			total += v;
+		}
+	}
+	float mean = (float)(count == 0 ? 0 : total / count);
+	for (size_t i = 0; i < count; i++) { centered[i] -= mean; }
+
+	remainingSquares[height] = 0;
+	rowPrefix[0] = 0;
+	for (int y = 0; y < height; y++) {
+		double rowsum = 0;
+		for (int x = 0; x < width; x++) { rowsum += centered[(size_t)y * width + x]; }
+		rowPrefix[y + 1] = rowPrefix[y] + rowsum;
+	}
+	for (int y = height - 1; y >= 0; y--) {
+		double rowsq = 0;
+		for (int x = 0; x < width; x++) {
+			double v = centered[(size_t)y * width + x];
+			rowsq += v * v;
+		}
+		remainingSquares[y] = remainingSquares[y + 1] + rowsq;
+	}
+}
+
+static float DotRow(const float* a, const float* b, int len) {
+	int i = 0;
+	float total = 0;
+#ifdef NCC_SSE2
+	__m128 acc = _mm_setzero_ps();
+	for (; i + 4 <= len; i += 4) {
+		acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+	}
+	float lanes[4];
+	_mm_storeu_ps(lanes, acc);
+	total = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+	for (; i < len; i++) { total += a[i] * b[i]; }
+	return total;
+}
+
+double NccScoreAt(const IntegralImage& haystack, const NccNeedle& needle, int x, int y, double threshold) {
+	int w = needle.width;
+	int h = needle.height;
+	double n = (double)w * h;
+	double s = haystack.RectSum(x, y, w, h);
+	double mean = s / n;
+	double variance = (double)haystack.RectSquareSum(x, y, w, h) - s * mean;
+	double denominator = std::sqrt(std::max(variance, 0.0) * needle.remainingSquares[0]);
+	//flat area, nothing to correlate with
+	if (denominator < 1e-6) { return -1; }
+	bool prune = threshold > -1;
+	double dot = 0;
+	for (int row = 0; row < h; row++) {
+		dot += DotRow(haystack.Row(y + row) + x, needle.centered + (size_t)row * w, w);
+		if (!prune || row + 1 == h) { continue; }
+		//cauchy-schwarz bound on what the remaining rows can still add
+		int remrows = h - row - 1;
+		double rems = haystack.RectSum(x, y + row + 1, w, remrows);
+		double remsq = (double)haystack.RectSquareSum(x, y + row + 1, w, remrows);
+		double remvariance = remsq - 2 * mean * rems + (double)remrows * w * mean * mean;
+		double partial = dot - mean * needle.rowPrefix[row + 1];
+		double bound = std::sqrt(std::max(remvariance, 0.0) * needle.remainingSquares[row + 1]);
+		if (partial + bound < threshold * denominator) {
+			return (partial + bound) / denominator;
+		}
+	}
+	//the needle values sum to zero so the haystack mean drops out of the numerator
+	return dot / denominator;
+}
+
+//range of top left corners where a w*h needle fits in the haystack and the search area, false if there are none
+static bool SearchBounds(const IntegralImage& haystack, int w, int h, const NccOptions& opts, int& x1, int& y1, int& x2, int& y2) {
+	if (w == 0 || h == 0 || w > haystack.Width() || h > haystack.Height()) { return false; }
+	x1 = 0, y1 = 0;
+	x2 = haystack.Width() - w, y2 = haystack.Height() - h;
+	if (opts.area.width > 0 && opts.area.height > 0) {
+		x1 = std::max(x1, opts.area.x);
+		y1 = std::max(y1, opts.area.y);
+		x2 = std::min(x2, opts.area.x + opts.area.width - 1);
+		y2 = std::min(y2, opts.area.y + opts.area.height - 1);
+	}
+	return x1 <= x2 && y1 <= y2;
+}
+
+//greedy non-maximum suppression, a correlation peak is surrounded by slightly lower scores
+template<typename T, typename RECT>
+static std::vector<T> SuppressNonMaximum(std::vector<T>& candidates, size_t count, RECT getrect) {
+	std::stable_sort(candidates.begin(), candidates.end(), [](const T& a, const T& b) { return a.score > b.score; });
+	std::vector<T> matches;
+	for (auto& cand : candidates) {
+		if (matches.size() >= count) { break; }
+		JSRectangle rect = getrect(cand);
+		bool suppressed = false;
+		for (auto& match : matches) {
+			JSRectangle other = getrect(match);
+			int spacingx = std::max(std::min(rect.width, other.width) / 2, 1);
+			int spacingy = std::max(std::min(rect.height, other.height) / 2, 1);
+			if (std::abs(other.x - rect.x) < spacingx && std::abs(other.y - rect.y) < spacingy) {
+				suppressed = true;
+				break;
+			}
+		}
+		if (!suppressed) { matches.push_back(cand); }
+	}
+	return matches;
+}
+
+std::vector<NccMatch> MatchNcc(const IntegralImage& haystack, const NccNeedle& needle, const NccOptions& opts) {
+	int x1, y1, x2, y2;
+	if (!SearchBounds(haystack, needle.width, needle.height, opts, x1, y1, x2, y2)) { return {}; }
+	std::vector<NccMatch> candidates;
+	for (int y = y1; y <= y2; y++) {
+		for (int x = x1; x <= x2; x++) {
+			double score = NccScoreAt(haystack, needle, x, y, opts.threshold);
+			if (score >= opts.threshold) {
+				candidates.push_back({ x, y, score });
+			}
+		}
+	}
+	return SuppressNonMaximum(candidates, opts.count, [&](const NccMatch& m) { return JSRectangle(m.x, m.y, needle.width, needle.height); });
+}
+
+ScaledNeedleSet::ScaledNeedleSet(const JSImageView& img, const std::vector<double>& scalelist) {
+	for (double scale : scalelist) {
+		int w = std::max((int)std::lround(img.width * scale), 1);
+		int h = std::max((int)std::lround(img.height * scale), 1);
+		if (w == img.width && h == img.height) {
+			needles.emplace_back(img);
+		} else {
+			auto scaled = ResizeBilinear(img, w, h);
+			needles.emplace_back(scaled.View());
+		}
+		scales.push_back(scale);
+	}
+}
+
+int ScaledNeedleSet::IndexOf(double scale) const {
+	for (size_t i = 0; i < scales.size(); i++) {
+		if (scales[i] == scale) { return (int)i; }
+	}
+	return -1;
+}
+
+std::vector<ScaledNccMatch> MatchNccScaled(const IntegralImage& haystack, const ScaledNeedleSet& needles, const NccOptions& opts, int preferred) {
+	auto getrect = [](const ScaledNccMatch& m) { return m.rect; };
+	std::vector<ScaledNccMatch> candidates;
+	if (preferred >= 0 && (size_t)preferred < needles.Count()) {
+		auto& needle = needles.Needle(preferred);
+		for (auto& match : MatchNcc(haystack, needle, opts)) {
+			candidates.push_back({ JSRectangle(match.x, match.y, needle.Width(), needle.Height()), match.score, (size_t)preferred });
+		}
+		if (!candidates.empty()) { return candidates; }
+	}
+
+	struct ScaleBounds { int x1, y1, x2, y2; bool valid; };
+	std::vector<ScaleBounds> bounds(needles.Count());
+	int miny = INT32_MAX, maxy = -1;
+	for (size_t i = 0; i < needles.Count(); i++) {
+		auto& b = bounds[i];
+		b.valid = (int)i != preferred && needles.Needle(i).HasContrast() && SearchBounds(haystack, needles.Needle(i).Width(), needles.Needle(i).Height(), opts, b.x1, b.y1, b.x2, b.y2);
+		if (b.valid) {
+			miny = std::min(miny, b.y1);
+			maxy = std::max(maxy, b.y2);
+		}
+	}
+	//single pass over the haystack, all scales are tried at each location while its rows are still in cache
+	for (int y = miny; y <= maxy; y++) {
+		for (size_t i = 0; i < needles.Count(); i++) {
+			auto& b = bounds[i];
+			if (!b.valid || y < b.y1 || y > b.y2) { continue; }
+			auto& needle = needles.Needle(i);
+			for (int x = b.x1; x <= b.x2; x++) {
+				double score = NccScoreAt(haystack, needle, x, y, opts.threshold);
+				if (score >= opts.threshold) {
+					candidates.push_back({ JSRectangle(x, y, needle.Width(), needle.Height()), score, i });
+				}
+			}
+		}
+	}
+	return SuppressNonMaximum(candidates, opts.count, getrect);
+}
+
+static inline int FloorDiv(int a, int b) {
+	return (a >= 0 ? a / b : -((-a + b - 1) / b));
+}
+
+std::vector<NccMatch> MatchNccPyramid(ImagePyramid& haystack, const JSImageView& needleimg, const NccOptions& opts) {
+	ScratchScope scratch;
+	NccNeedle needle(needleimg, scratch);
+	bool hasarea = opts.area.width > 0 && opts.area.height > 0;
+	//DownscaleBox goes up to 1/8
+	size_t level = 0;
+	while (level + 1 < haystack.LevelCount() && level < 3) {
+		int next = 2 << level;
+		if (needleimg.width / next - 1 < minCoarseNeedle || needleimg.height / next - 1 < minCoarseNeedle) { break; }
+		level++;
+	}
+	if (level == 0) { return MatchNcc(haystack.Integral(0), needle, opts); }
+
+	int factor = 1 << level;
+	auto& coarsehaystack = haystack.Integral(level);
+	auto& full = haystack.Integral(0);
+	std::vector<NccMatch> candidates;
+	//one coarse needle per alignment of the needle to the pixel blocks of the level, so a match averages exactly
+	//the same pixels on both sides. Partial blocks at the needle edges are left out
+	for (int phasey = 0; phasey < factor; phasey++) {
+		for (int phasex = 0; phasex < factor; phasex++) {
+			int cropx = (factor - phasex) % factor;
+			int cropy = (factor - phasey) % factor;
+			ScratchScope phasescratch;
+			int smallwidth = (needleimg.width - cropx) / factor, smallheight = (needleimg.height - cropy) / factor;
+			JSImageView small(phasescratch.Alloc<byte>((size_t)smallwidth * smallheight * 4), smallwidth, smallheight);
+			DownscaleBox(needleimg.Pixel(cropx, cropy), needleimg.stride, smallwidth * factor, smallheight * factor, factor, small.data, small.stride, false);
+			NccNeedle coarse(small, phasescratch);
+			if (!coarse.HasContrast()) { return MatchNcc(full, needle, opts); }
+			NccOptions coarseopts;
+			coarseopts.threshold = opts.threshold - coarseSlack;
+			coarseopts.count = opts.count * 4;
+			if (hasarea) {
+				coarseopts.area = JSRectangle(FloorDiv(opts.area.x + cropx, factor) - 1, FloorDiv(opts.area.y + cropy, factor) - 1, opts.area.width / factor + 3, opts.area.height / factor + 3);
+			}
+			for (auto& peak : MatchNcc(coarsehaystack, coarse, coarseopts)) {
+				//block column peak.x starts at needle column cropx, refine a pixel around that
+				int x1 = peak.x * factor - cropx - 1, y1 = peak.y * factor - cropy - 1;
+				int x2 = x1 + 2, y2 = y1 + 2;
+				if (hasarea) {
+					x1 = std::max(x1, opts.area.x);
+					y1 = std::max(y1, opts.area.y);
+					x2 = std::min(x2, opts.area.x + opts.area.width - 1);
+					y2 = std::min(y2, opts.area.y + opts.area.height - 1);
+				}
+				//an empty area would mean the whole image
+				if (x1 > x2 || y1 > y2) { continue; }
+				NccOptions fineopts;
+				fineopts.threshold = opts.threshold;
+				fineopts.count = 1;
+				fineopts.area = JSRectangle(x1, y1, x2 - x1 + 1, y2 - y1 + 1);
+				for (auto& match : MatchNcc(full, needle, fineopts)) { candidates.push_back(match); }
+			}
+		}
+	}
+	return SuppressNonMaximum(candidates, opts.count, [&](const NccMatch& m) { return JSRectangle(m.x, m.y, needle.Width(), needle.Height()); });
+}
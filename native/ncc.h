@@ -0,0 +1,125 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "util.h"
+
+class ImagePyramid;
+class ScratchScope;
+
+/**
+ * Normalized cross-correlation matching on luma. Unlike exact pixel matching this still finds needles that are
+ * drawn over translucent backgrounds or with a slight color shift. The window mean and variance of every candidate
+ * location come from summed-area tables that are computed once per capture, only the correlation itself is per needle.
+ */
+
+/**
+ * Luma of an image plus its summed-area and squared summed-area tables
+ */
+class IntegralImage {
+	//luma as float so the correlation loop can use it directly
+	float* gray = nullptr;
+	//(width+1)*(height+1) tables with a zero first row and column. The sums wrap on very large images, the
+	//difference of four corners is still exact as long as a single window sum fits in 32 bits
+	uint32_t* sum = nullptr;
+	uint64_t* sqsum = nullptr;
+	//backs the tables unless they were built in scratch memory
+	std::vector<uint64_t> storage;
+	int width = 0;
+	int height = 0;
+	void Fill(const JSImageView& img);
+public:
+	IntegralImage() = default;
+	IntegralImage(const IntegralImage&) = delete;
+	IntegralImage& operator=(const IntegralImage&) = delete;
+	//tables owned by this object, for captures that are kept and searched by later calls
+	void Build(const JSImageView& img);
+	//tables in scratch memory for a single search, the object is unusable once the scope ends
+	void Build(const JSImageView& img, ScratchScope& scratch);
+	int Width() const { return width; }
+	int Height() const { return height; }
+	const float* Row(int y) const { return gray + (size_t)y * width; }
+	uint32_t RectSum(int x, int y, int w, int h) const;
+	uint64_t RectSquareSum(int x, int y, int w, int h) const;
+};
+
+struct NccOptions {
+	//lowest score in [-1,1] that counts as a match
+	double threshold = 0.9;
+	//most matches to return, best first
+	size_t count = 16;
+	//only locations with their top left corner inside this rect are tried, the whole image when empty
+	JSRectangle area = JSRectangle(0, 0, 0, 0);
+};
+
+struct NccMatch {
+	int x;
+	int y;
+	double score;
+};
+
+/**
+ * Needle prepared for correlation, luma with its mean removed
+ */
+class NccNeedle {
+	float* centered;
+	//sum of squares of the centered values per row, suffix summed so pruning can bound the remaining rows
+	double* remainingSquares;
+	//sum of the centered values of rows [0,y), needed to center the haystack side of partial sums
+	double* rowPrefix;
+	//backs the arrays above unless the needle was built in scratch memory
+	std::vector<double> storage;
+	int width = 0;
+	int height = 0;
+	void Fill(const JSImageView& img);
+	friend std::vector<NccMatch> MatchNcc(const IntegralImage& haystack, const NccNeedle& needle, const NccOptions& opts);
+	friend double NccScoreAt(const IntegralImage& haystack, const NccNeedle& needle, int x, int y, double threshold);
+public:
+	//kept needles own their arrays, moving keeps them valid
+	explicit NccNeedle(const JSImageView& img);
+	//needle for a single search, unusable once the scope ends
+	NccNeedle(const JSImageView& img, ScratchScope& scratch);
+	NccNeedle(NccNeedle&&) = default;
+	NccNeedle(const NccNeedle&) = delete;
+	NccNeedle& operator=(const NccNeedle&) = delete;
+	int Width() const { return width; }
+	int Height() const { return height; }
+	//false if every pixel has the same luma, the score is undefined for flat needles
+	bool HasContrast() const { return remainingSquares[0] > 1e-6; }
+};
+
+/**
+ * A needle pre-rendered at a set of scale factors, for interface elements drawn at the game's interface scaling
+ */
+class ScaledNeedleSet {
+	std::vector<double> scales;
+	std::vector<NccNeedle> needles;
+public:
+	ScaledNeedleSet(const JSImageView& img, const std::vector<double>& scales);
+	size_t Count() const { return needles.size(); }
+	double Scale(size_t index) const { return scales[index]; }
+	const NccNeedle& Needle(size_t index) const { return needles[index]; }
+	//index of the given scale factor or -1
+	int IndexOf(double scale) const;
+};
+
+struct ScaledNccMatch {
+	//location and size of the scaled needle
+	JSRectangle rect;
+	double score;
+	size_t scaleIndex;
+};
+
+// Score of the needle with its top left corner at x,y. Returns a value below threshold as soon as the
+// remaining rows can no longer lift the score above it, with a threshold of -1 the exact score is returned
+double NccScoreAt(const IntegralImage& haystack, const NccNeedle& needle, int x, int y, double threshold);
+// Best scoring locations at or above the threshold. Matches are at least half a needle apart, of two
+// overlapping candidates only the better one is returned
+std::vector<NccMatch> MatchNcc(const IntegralImage& haystack, const NccNeedle& needle, const NccOptions& opts);
+// Best matches over all scales of the needle set in one pass over the haystack. When a preferred scale is
+// given it is searched on its own first, and the other scales are only tried if it has no match
+std::vector<ScaledNccMatch> MatchNccScaled(const IntegralImage& haystack, const ScaledNeedleSet& needles, const NccOptions& opts, int preferred);
+// Same matches as MatchNcc on pyramid level 0, found coarse-to-fine. The needle is box filtered down to the coarsest
+// level where it keeps some detail and searched there with a lower threshold, then every coarse peak is refined at
+// full size within a pixel. Small needles are searched at full size directly
+std::vector<NccMatch> MatchNccPyramid(ImagePyramid& haystack, const JSImageView& needle, const NccOptions& opts);
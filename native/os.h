@@ -7,6 +7,9 @@
 #pragma once
 
 #include "util.h"
+#include "region.h"
+#include "overlay.h"
+#include "pixelwatch.h"
 #ifdef OS_WIN
 #include "os_win.h"
 #elif OS_LINUX
@@ -26,7 +29,9 @@ struct CaptureRect {
 	JSRectangle rect;
 	void* data;
 	size_t size;
-	CaptureRect(void* data, size_t size, JSRectangle rect) :rect(rect), data(data), size(size) {}
+	//output is box filtered down by this factor (1, 2, 4 or 8), data holds DownscaledSize(w/h, scale) pixels
+	int scale;
+	CaptureRect(void* data, size_t size, JSRectangle rect, int scale = 1) :rect(rect), data(data), size(size), scale(scale) {}
 };
 
 
@@ -53,6 +58,17 @@ public:
 	bool operator<(const OSWindow& other) const;
 };
 
+/**
+ * Called once for every node environment that loads the addon, shared native state is kept alive
+ * until the last attached instance is detached again
+ */
+void OSAttachInstance(PluginInstance* inst);
+
+/**
+ * Called when the environment owning 'inst' is torn down, drops all listeners registered from that environment
+ */
+void OSDetachInstance(PluginInstance* inst);
+
 /**
  * Reparent the 'wnd' to any other window 'parent', parent can belong to any process.
  * This makes 'wnd' always show up in front of 'parent'
@@ -76,21 +92,99 @@ void OSCaptureMulti(OSWindow wnd, CaptureMode mode, vector<CaptureRect> rects, N
 
 /**
  * Get the currently active window on the desktop
+ * This is a memory read while any window listener is active, the "focus" event keeps the cached value up to date
  */
 OSWindow OSGetActiveWindow();
 
+struct OSProcessStats {
+	//0 if there is no (living) process for the window
+	int pid = 0;
+	//cpu time used over the last sample interval, 1 means one fully used core
+	double cpu = 0;
+	//false until the process was sampled twice
+	bool cpuValid = false;
+	//resident memory in bytes
+	uint64_t rss = 0;
+	int threads = 0;
+};
+
+/**
+ * Resource usage of the process that owns 'wnd', sampled in the background about once per second for as long as it keeps being requested
+ */
+OSProcessStats OSGetProcessStats(OSWindow wnd);
+
+enum class WindowQueryType { RsHandles, Bounds, ClientBounds, Title, ActiveWindow };
+
+struct WindowQuery {
+	WindowQueryType type;
+	OSWindow window;
+	//result, which field is set depends on the type
+	JSRectangle rect = JSRectangle(0, 0, 0, 0);
+	string title;
+	vector<OSWindow> windows;
+	WindowQuery(WindowQueryType type, OSWindow window = OSWindow()) :type(type), window(window) {}
+};
+
+/**
+ * Answers a batch of window queries, only called from the window query thread. Platforms with a display connection use a
+ * separate connection for this thread and send the requests of the whole batch before waiting on any reply
+ */
+void OSRunWindowQueries(vector<WindowQuery>& batch);
+
+/**
+ * Called on the window query thread before it exits, releases whatever OSRunWindowQueries kept around
+ */
+void OSEndWindowQueries();
+
+struct OSMonitor {
+	//desktop area of the monitor in screen pixels
+	JSRectangle bounds;
+	//physical size, 0 when unknown
+	int mmWidth = 0;
+	int mmHeight = 0;
+	bool primary = false;
+	string name;
+	//ratio of screen pixels to the device independent pixels used by electron
+	double scale = 1;
+};
+
+/**
+ * The monitors that make up the desktop. The topology is cached while the window thread runs and refreshed on display configuration changes
+ */
+vector<OSMonitor> OSGetMonitors();
+
+struct OSCursorImage {
+	//changes every time the cursor shape changes
+	uint32_t serial = 0;
+	int hotX = 0;
+	int hotY = 0;
+	int width = 0;
+	int height = 0;
+	//straight (not premultiplied) rgba
+	std::vector<byte> pixels;
+};
+
+/**
+ * Image and hotspot of the current mouse cursor. Returns false if the cursor still has knownSerial (0 for none) or
+ * can't be read. Implemented only on X11 Linux, cursor changes are reported through the "cursor" window event
+ */
+bool OSGetCursorImage(uint32_t knownSerial, OSCursorImage& out);
+
 /**
  * Returns true when the left/main mouse button is down, even in another process and regardless of message pump state
  */
 bool OSGetMouseState();
 
 
-enum class WindowEventType { Move, Close, Show, Click };
+enum class WindowEventType { Move, Close, Show, Click, Focus, Title, Cursor };
 const std::map<std::string, WindowEventType> windowEventTypes = {
 	{"move",WindowEventType::Move},
 	{"close",WindowEventType::Close},
 	{"show",WindowEventType::Show},
-	{"click",WindowEventType::Click}
+	{"click",WindowEventType::Click},
+	{"focus",WindowEventType::Focus},
+	{"title",WindowEventType::Title},
+	{"cursor",WindowEventType::Cursor}
 };
 
 /**
@@ -104,8 +198,28 @@ void OSNewWindowListener(OSWindow wnd, WindowEventType type, Napi::Function cb);
  */
 void OSRemoveWindowListener(OSWindow wnd, WindowEventType type, Napi::Function cb);
 
+/**
+ * Evaluates the predicates against the client area of wnd every time new content arrives, at most once per interval ms.
+ * cb is called with the indices of the predicates that fired. Returns an id for OSRemovePixelWatch.
+ * Implemented only on X11 Linux, where XDamage reports new content
+ */
+int OSAddPixelWatch(OSWindow wnd, std::vector<PixelPredicate> predicates, int interval, Napi::Function cb);
+void OSRemovePixelWatch(int id);
+
 /**
  * Defines which region of a window can be clicked
  * Implemented only on X11 Linux as a replacement for electron's setIgnoreMouseEvents()
+ * Only the difference with the previously applied region is sent, setting the same region again is free
+ */
+void OSSetWindowShape(OSWindow wnd, const ShapeRegion& region);
+
+/**
+ * Draw overlay commands on top of 'wnd' with a native renderer instead of a browser window
+ * Implemented only on X11 Linux, commands are rasterized and presented on a separate native thread
+ */
+void OSOverlayCommands(OSWindow wnd, int frameid, vector<OverlayCommand> commands);
+
+/**
+ * Remove everything that was drawn by 'frameid' from the native overlay of 'wnd'
  */
-void OSSetWindowShape(OSWindow wnd, vector<JSRectangle> rects);
+void OSOverlayCloseFrame(OSWindow wnd, int frameid);
@@ -130,6 +130,14 @@ std::string OSGetProcessName(int pid) {
 	return std::string(namebuf);
 }
 
+void OSAttachInstance(PluginInstance* inst) {
+
+}
+
+void OSDetachInstance(PluginInstance* inst) {
+
+}
+
 void OSNewWindowListener(OSWindow wnd, WindowEventType type, Napi::Function cb) {
 
 }
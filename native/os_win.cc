@@ -2,7 +2,11 @@
 #include "os.h"
 #include <TlHelp32.h>
 #include <memory>
+#include <mutex>
+#include <algorithm>
 #include "../libs/Alt1Native.h"
+#include "imagescale.h"
+#include "scratch.h"
 
 /*
 * Currently using the Ansi version of windows api's as v8 expects utf8, this will work for ascii but will garble anything outside ascii
@@ -37,11 +41,15 @@ bool OSWindow::IsValid() {
 	return IsWindow(this->handle);
 }
 string OSWindow::GetTitle() {
-	int len = GetWindowTextLengthA(this->handle);
+	int len = GetWindowTextLengthW(this->handle);
 	if (len == 0) { return string(""); }
-	vector<char> buf(len + 1);
-	GetWindowTextA(this->handle, &buf[0], len + 1);
-	return string(&buf[0]);
+	vector<wchar_t> buf(len + 1);
+	len = GetWindowTextW(this->handle, &buf[0], len + 1);
+	//same utf-8 output as the x11 _NET_WM_NAME title
+	int size = WideCharToMultiByte(CP_UTF8, 0, &buf[0], len, NULL, 0, NULL, NULL);
+	string title(size, '\0');
+	WideCharToMultiByte(CP_UTF8, 0, &buf[0], len, &title[0], size, NULL, NULL);
+	return title;
 }
 OSWindow OSWindow::FromJsValue(const Napi::Value jsval) {
 	auto handle = jsval.As<Napi::BigInt>();
@@ -90,6 +98,31 @@ OSWindow OSFindMainWindow(unsigned long process_id)
 	return OSWindow(data.window_handle);
 }
 
+// The win32 calls are cheap, there is nothing to pipeline
+void OSRunWindowQueries(vector<WindowQuery>& batch) {
+	for (auto& query : batch) {
+		switch (query.type) {
+			case WindowQueryType::RsHandles:
+				query.windows = OSGetRsHandles();
+				break;
+			case WindowQueryType::Bounds:
+				query.rect = query.window.GetBounds();
+				break;
+			case WindowQueryType::ClientBounds:
+				query.rect = query.window.GetClientBounds();
+				break;
+			case WindowQueryType::Title:
+				query.title = query.window.GetTitle();
+				break;
+			case WindowQueryType::ActiveWindow:
+				query.window = OSGetActiveWindow();
+				break;
+		}
+	}
+}
+
+void OSEndWindowQueries() {}
+
 void OSSetWindowParent(OSWindow wnd, OSWindow parent) {
 	//show behind parent, then show parent behind self (no way to show in front in winapi)
 	if (parent.handle != 0) {
@@ -200,6 +233,28 @@ void OSCaptureOpenGLMulti(OSWindow wnd, vector<CaptureRect> rects, Napi::Env env
 }
 
 void OSCaptureMulti(OSWindow wnd, CaptureMode mode, vector<CaptureRect> rects, Napi::Env env) {
+	//gdi and the opengl hook can only write full size images, capture scaled rects into a temporary buffer first
+	ScratchScope scratch;
+	vector<byte*> fullsize(rects.size(), nullptr);
+	vector<CaptureRect> scaled;
+	for (size_t i = 0; i < rects.size(); i++) {
+		if (rects[i].scale != 1) {
+			scaled.push_back(rects[i]);
+			size_t size = (size_t)rects[i].rect.width * rects[i].rect.height * 4;
+			fullsize[i] = scratch.Alloc<byte>(size);
+			rects[i] = CaptureRect(fullsize[i], size, rects[i].rect);
+		}
+	}
+	if (!scaled.empty()) {
+		OSCaptureMulti(wnd, mode, rects, env);
+		for (size_t i = 0, j = 0; i < rects.size(); i++) {
+			if (!fullsize[i]) { continue; }
+			auto& target = scaled[j++];
+			DownscaleBox(fullsize[i], target.rect.width * 4, target.rect.width, target.rect.height, target.scale, (byte*)target.data, DownscaledSize(target.rect.width, target.scale) * 4, false);
+		}
+		return;
+	}
+
 	switch (mode) {
 	case CaptureMode::Desktop: {
 		//TODO double check and document desktop 0 special case
@@ -230,15 +285,17 @@ enum class WindowsEventGroup { System, Object };
 struct WindowsEventHook {
 	HWND hwnd;
 	WindowsEventGroup group;
+	//out of context hooks are delivered to the thread that installed them, each environment needs its own
+	DWORD threadId;
 	HWINEVENTHOOK eventhandle;
-	WindowsEventHook(HWND hwnd, WindowsEventGroup group) :hwnd(hwnd), group(group) {
+	WindowsEventHook(HWND hwnd, WindowsEventGroup group) :hwnd(hwnd), group(group), threadId(GetCurrentThreadId()) {
 		DWORD pid = 0;
 		if (hwnd) {
 			GetWindowThreadProcessId(hwnd, &pid);
 		}
 		switch (group) {
 		case WindowsEventGroup::Object:
-			eventhandle = SetWinEventHook(0x8000, 0x800B, 0, HookProc, pid, 0, WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+			eventhandle = SetWinEventHook(0x8000, 0x800C, 0, HookProc, pid, 0, WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
 			break;
 		case WindowsEventGroup::System:
 			eventhandle = SetWinEventHook(0x0000, 0x0030, 0, HookProc, pid, 0, WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
@@ -256,6 +313,8 @@ struct WindowsEventHook {
 struct TrackedEvent {
 	OSWindow wnd;
 	WindowEventType type;
+	PluginInstance* owner;
+	DWORD threadId;
 	int lastCalledId = 0;//used to determine if this callback was called already
 	std::shared_ptr<Napi::FunctionReference> callback;
 	std::vector<std::shared_ptr<WindowsEventHook>> hooks;
@@ -268,6 +327,8 @@ struct TrackedEvent {
 		this->hooks = other.hooks;
 		this->type = other.type;
 		this->wnd = other.wnd;
+		this->owner = other.owner;
+		this->threadId = other.threadId;
 		callback = std::move(other.callback);
 		return *this;
 	}
@@ -278,11 +339,24 @@ struct TrackedEvent {
 
 
 std::vector<TrackedEvent> windowHandlers;
+std::mutex windowHandlersMutex;//shared between the threads of all environments that loaded the addon
+
+void OSAttachInstance(PluginInstance* inst) {}
+
+void OSDetachInstance(PluginInstance* inst) {
+	std::lock_guard<std::mutex> lock(windowHandlersMutex);
+	windowHandlers.erase(
+		std::remove_if(windowHandlers.begin(), windowHandlers.end(), [inst](const TrackedEvent& h) {return h.owner == inst; }),
+		windowHandlers.end()
+	);
+}
 
+//expects windowHandlersMutex to be held
 std::shared_ptr<WindowsEventHook> WindowsEventHook::GetHook(HWND hwnd, WindowsEventGroup group) {
+	auto thread = GetCurrentThreadId();
 	for (auto& handler : windowHandlers) {
 		for (auto& hook : handler.hooks) {
-			if (hook->hwnd == hwnd && hook->group == group) {
+			if (hook->hwnd == hwnd && hook->group == group && hook->threadId == thread) {
 				return hook;
 			}
 		}
@@ -291,11 +365,13 @@ std::shared_ptr<WindowsEventHook> WindowsEventHook::GetHook(HWND hwnd, WindowsEv
 }
 
 void OSNewWindowListener(OSWindow wnd, WindowEventType type, Napi::Function cb) {
+	std::lock_guard<std::mutex> lock(windowHandlersMutex);
 	auto ev = TrackedEvent(wnd, type, cb);
 	windowHandlers.push_back(std::move(ev));
 }
 
 void OSRemoveWindowListener(OSWindow wnd, WindowEventType type, Napi::Function cb) {
+	std::lock_guard<std::mutex> lock(windowHandlersMutex);
 	for (auto it = windowHandlers.begin(); it != windowHandlers.end(); it++) {
 		if (it->type == type && it->wnd == wnd && (*it->callback) == Napi::Persistent(cb)) {
 			windowHandlers.erase(it);
@@ -312,12 +388,16 @@ void iterateHandlers(COND cond, F tracker) {
 	constexpr size_t max_callbacks = 64;
 	std::shared_ptr<Napi::FunctionReference> callbacks[max_callbacks];
 	size_t count = 0;
+	auto thread = GetCurrentThreadId();
+	windowHandlersMutex.lock();
 	for (auto it = windowHandlers.begin(); it != windowHandlers.end(); it++) {
-		if (cond(*it) && count < max_callbacks) {
+		//only call handlers that belong to the environment running on this thread
+		if (it->threadId == thread && cond(*it) && count < max_callbacks) {
 			callbacks[count] = it->callback;
 			count += 1;
 		}
 	}
+	windowHandlersMutex.unlock();
 	for (size_t i = 0; i < count; i += 1) {
 		tracker(callbacks[i]);
 	}
@@ -339,6 +419,17 @@ void HookProc(HWINEVENTHOOK hWinEventHook, DWORD event, HWND hwnd, LONG idObject
 					catch (...) {}
 				});
 			break;
+		case EVENT_SYSTEM_FOREGROUND: {
+			iterateHandlers(
+				[hwnd](const TrackedEvent& h) {return (h.wnd.handle == 0 || hwnd == h.wnd.handle) && h.type == WindowEventType::Focus; },
+				[hwnd](const std::shared_ptr<Napi::FunctionReference>& h) {
+					auto env = h->Env();
+					Napi::HandleScope scope(env);
+					try { h->MakeCallback(env.Global(), { Napi::BigInt::New(env,(uint64_t)hwnd) }); }
+					catch (...) {}
+				});
+			break;
+		}
 		case EVENT_SYSTEM_CAPTURESTART: {
 			auto windowhwnd = GetAncestor(hwnd, GA_ROOT);
 			iterateHandlers(
@@ -366,6 +457,19 @@ void HookProc(HWINEVENTHOOK hWinEventHook, DWORD event, HWND hwnd, LONG idObject
 				});
 			break;
 		}
+		case EVENT_OBJECT_NAMECHANGE: {
+			if (idObject != OBJID_WINDOW) { break; }
+			OSWindow wnd(hwnd);
+			iterateHandlers(
+				[hwnd](const TrackedEvent& h) {return hwnd == h.wnd.handle && h.type == WindowEventType::Title; },
+				[&wnd](const std::shared_ptr<Napi::FunctionReference>& h) {
+					auto env = h->Env();
+					Napi::HandleScope scope(env);
+					try { h->MakeCallback(env.Global(), { Napi::String::New(env, wnd.GetTitle()) }); }
+					catch (...) {}
+				});
+			break;
+		}
 		case EVENT_OBJECT_CREATE: {
 			if (IsRsWindow(hwnd)) {
 				iterateHandlers(
@@ -385,6 +489,8 @@ void HookProc(HWINEVENTHOOK hWinEventHook, DWORD event, HWND hwnd, LONG idObject
 TrackedEvent::TrackedEvent(OSWindow wnd, WindowEventType type, Napi::Function cb) {
 	this->wnd = wnd;
 	this->type = type;
+	this->owner = cb.Env().GetInstanceData<PluginInstance>();
+	this->threadId = GetCurrentThreadId();
 	this->callback = std::make_shared<Napi::FunctionReference>(Napi::Persistent(cb));
 	DWORD pid;
 	//TODO error handling
@@ -411,6 +517,17 @@ TrackedEvent::TrackedEvent(OSWindow wnd, WindowEventType type, Napi::Function cb
 			WindowsEventHook::GetHook(wnd.handle,WindowsEventGroup::Object),
 		};
 		break;
+	case WindowEventType::Title:
+		this->hooks = {
+			WindowsEventHook::GetHook(wnd.handle,WindowsEventGroup::Object)
+		};
+		break;
+	case WindowEventType::Focus:
+		//foreground changes are reported by the process that gains focus, so always listen globally
+		this->hooks = {
+			WindowsEventHook::GetHook(0,WindowsEventGroup::System)
+		};
+		break;
 	default:
 		assert(false);
 	}
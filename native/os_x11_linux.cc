@@ -10,40 +10,138 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <map>
 #include "os.h"
 #include "linux/x11.h"
 #include "linux/shm.h"
+#include "linux/overlay.h"
+#include "linux/procstats.h"
+#include "linux/randr.h"
+#include "linux/cursor.h"
+#include "linux/damage.h"
+#include "linux/xinput.h"
+#include "linux/glcapture.h"
 
 using namespace priv_os_x11;
 
 struct TrackedEvent {
 	xcb_window_t window;
 	WindowEventType type;
+	PluginInstance* owner;
+	std::shared_ptr<std::atomic<bool>> closing;
 	Napi::ThreadSafeFunction callback;
 	Napi::FunctionReference callbackRef;
 	TrackedEvent(xcb_window_t window, WindowEventType type, Napi::Function callback) :
 		window(window),
 		type(type),
+		owner(callback.Env().GetInstanceData<PluginInstance>()),
+		closing(owner->closing),
 		callback(Napi::ThreadSafeFunction::New(callback.Env(), callback, "event", 0, 1, [](Napi::Env) {})),
 		callbackRef(Napi::Persistent(callback)) {}
 };
 
 std::thread windowThread;
 std::thread recordThread;
-bool windowThreadExists = false;
+std::atomic<bool> windowThreadExists(false);
+std::atomic<bool> windowThreadStop(false);
 std::vector<TrackedEvent> trackedEvents;
 size_t rsDepth = 0;
+size_t attachedInstances = 0;
+
+// Input-only window owned by our connection, used to wake up the window thread with a client message
+xcb_window_t wakeWindow = XCB_NONE;
+// XRecord context of the record thread, disabling it from the main connection ends the record stream
+std::atomic<uint32_t> recordContext(0);
+
+// Active window as last reported by _NET_ACTIVE_WINDOW, only valid while activeWindowCached is set by the window thread
+std::atomic<xcb_window_t> activeWindow(XCB_NONE);
+std::atomic<bool> activeWindowCached(false);
 
 //whether the left mouse button on the physical is down regardless of window focus or message pump status
-bool isLeftMouseDown = false;
+std::atomic<bool> isLeftMouseDown(false);
 
 std::mutex eventMutex; // Locks the trackedEvents vector
 std::mutex windowThreadMutex; // Locks windowThread. Should NEVER be locked from inside the window thread
 std::mutex rsDepthMutex; // Locks the rsDepth variable
+std::mutex instanceMutex; // Locks attachedInstances
+std::mutex shapeMutex; // Locks appliedShapes
+std::mutex titleMutex; // Locks titleCache
+std::mutex pidMutex; // Locks windowPids
+
+// Last input shape we applied to each window, new shapes are sent as a diff against this. Only used while the window
+// thread is running, entries are dropped when the window is unmapped or destroyed or someone else changes its shape
+struct AppliedShape {
+	ShapeRegion region;
+	// ShapeNotify events our own requests are still going to cause
+	int pendingNotifies = 0;
+};
+std::map<xcb_window_t, AppliedShape> appliedShapes;
+
+// Utf-8 titles of windows we receive property events for, entries are dropped when the title changes or the window is destroyed.
+// Only used while the window thread is running, nobody would process the invalidating events otherwise
+std::map<xcb_window_t, std::string> titleCache;
+
+// _NET_WM_PID of windows we were asked about, a window can't change owner but its id is reused once it is destroyed.
+// Only used while the window thread is running, like titleCache, so every entry is dropped on its DestroyNotify
+std::map<xcb_window_t, pid_t> windowPids;
+
+// Events we select on windows that are tracked or have a cached title
+constexpr uint32_t trackedWindowMask = XCB_EVENT_MASK_STRUCTURE_NOTIFY | XCB_EVENT_MASK_PROPERTY_CHANGE;
+// Titles are read up to 4kb, the old WM_NAME read cut them off at 400 bytes
+constexpr uint32_t titleMaxLongs = 1024;
 
 void WindowThread();
 void RecordThread();
+void HandleButtonPress(uint32_t button, int16_t x, int16_t y);
+void HandleButtonRelease(uint32_t button);
+void HandleRawButton(uint32_t button, bool pressed);
 void StartWindowThread();
+void StopWindowThreadIfIdle();
+void JoinWindowThreads();
+
+void OSAttachInstance(PluginInstance* inst) {
+	std::lock_guard<std::mutex> lock(instanceMutex);
+	attachedInstances++;
+}
+
+void OSDetachInstance(PluginInstance* inst) {
+	// Drop every listener that was registered from the environment that is going away
+	eventMutex.lock();
+	trackedEvents.erase(
+		std::remove_if(
+			trackedEvents.begin(),
+			trackedEvents.end(),
+			[inst](TrackedEvent& e) {
+				if (e.owner == inst) {
+					e.callback.Abort();
+					return true;
+				}
+				return false;
+			}
+		),
+		trackedEvents.end()
+	);
+	eventMutex.unlock();
+	StopWindowThreadIfIdle();
+	removePixelWatches(inst);
+
+	// The x connection is shared by all environments, close it once the last one is gone
+	std::lock_guard<std::mutex> lock(instanceMutex);
+	attachedInstances--;
+	if (attachedInstances == 0) {
+		stopOverlayThread();
+		stopProcessSampler();
+		std::lock_guard<std::mutex> threadlock(windowThreadMutex);
+		JoinWindowThreads();
+		if (connection != NULL && wakeWindow != XCB_NONE) {
+			xcb_destroy_window(connection, wakeWindow);
+			wakeWindow = XCB_NONE;
+		}
+		closeConnection();
+	}
+}
 
 JSRectangle OSWindow::GetBounds() {
 	return GetClientBounds();
@@ -86,18 +184,71 @@ bool OSWindow::IsValid() {
 	return !!reply;
 }
 
-std::string OSWindow::GetTitle() {
-	ensureConnection();
-	xcb_get_property_cookie_t cookie = xcb_get_property_unchecked(connection, 0, this->handle, XCB_ATOM_WM_NAME, XCB_ATOM_STRING, 0, 100);
-	std::unique_ptr<xcb_get_property_reply_t, decltype(&free)> reply { xcb_get_property_reply(connection, cookie, NULL), &free };
-	if (!reply) {
-		return std::string();
+struct TitleCookies {
+	xcb_get_property_cookie_t net;
+	xcb_get_property_cookie_t plain;
+};
+
+// Requests _NET_WM_NAME and WM_NAME for clients that don't set it, both are sent before waiting on either
+TitleCookies SendTitleRequest(xcb_connection_t* conn, xcb_window_t window) {
+	TitleCookies cookies;
+	cookies.net = xcb_get_property_unchecked(conn, 0, window, ewmhConnection._NET_WM_NAME, ewmhConnection.UTF8_STRING, 0, titleMaxLongs);
+	cookies.plain = xcb_get_property_unchecked(conn, 0, window, XCB_ATOM_WM_NAME, XCB_GET_PROPERTY_TYPE_ANY, 0, titleMaxLongs);
+	return cookies;
+}
+
+std::string ReceiveTitle(xcb_connection_t* conn, TitleCookies cookies) {
+	std::unique_ptr<xcb_get_property_reply_t, decltype(&free)> netreply { xcb_get_property_reply(conn, cookies.net, NULL), &free };
+	if (netreply && netreply->type == ewmhConnection.UTF8_STRING && xcb_get_property_value_length(netreply.get()) != 0) {
+		xcb_discard_reply(conn, cookies.plain.sequence);
+		return std::string(reinterpret_cast<char*>(xcb_get_property_value(netreply.get())), xcb_get_property_value_length(netreply.get()));
 	}
 
-	char* title = reinterpret_cast<char*>(xcb_get_property_value(reply.get()));
+	std::unique_ptr<xcb_get_property_reply_t, decltype(&free)> reply { xcb_get_property_reply(conn, cookies.plain, NULL), &free };
+	if (!reply || reply->format != 8) {
+		return std::string();
+	}
+	const char* title = reinterpret_cast<char*>(xcb_get_property_value(reply.get()));
 	int length = xcb_get_property_value_length(reply.get());
+	if (reply->type != XCB_ATOM_STRING) {
+		// UTF8_STRING, or COMPOUND_TEXT which is ascii compatible for the titles we care about
+		return std::string(title, length);
+	}
+	// STRING is latin-1
+	std::string utf8;
+	utf8.reserve(length);
+	for (int i = 0; i < length; i++) {
+		unsigned char c = title[i];
+		if (c < 0x80) {
+			utf8.push_back(c);
+		} else {
+			utf8.push_back(0xc0 | (c >> 6));
+			utf8.push_back(0x80 | (c & 0x3f));
+		}
+	}
+	return utf8;
+}
 
-	return std::string(title, length);
+std::string ReadWindowTitle(xcb_window_t window) {
+	return ReceiveTitle(connection, SendTitleRequest(connection, window));
+}
+
+std::string OSWindow::GetTitle() {
+	ensureConnection();
+	// The lock is held over the read, the window thread can't drop the entry for a change we haven't seen yet before it exists
+	std::lock_guard<std::mutex> lock(titleMutex);
+	if (!windowThreadExists) {
+		return ReadWindowTitle(this->handle);
+	}
+	auto cached = titleCache.find(this->handle);
+	if (cached != titleCache.end()) {
+		return cached->second;
+	}
+	// Select property events before reading so no change can slip in between
+	xcb_change_window_attributes(connection, this->handle, XCB_CW_EVENT_MASK, &trackedWindowMask);
+	std::string title = ReadWindowTitle(this->handle);
+	titleCache[this->handle] = title;
+	return title;
 }
 
 Napi::Value OSWindow::ToJS(Napi::Env env) {
@@ -122,35 +273,48 @@ OSWindow OSWindow::FromJsValue(const Napi::Value jsval) {
 	return OSWindow(handleint);
 }
 
-bool IsRsWindow(const xcb_window_t window) {
-	ensureConnection();
-	constexpr uint32_t long_length = 64; // Any length higher than 2x+3 of the longest string we may match is fine
-	// Check window class (WM_CLASS property); this is set by the application controlling the window
-	// Also check WM_TRANSIENT_FOR is not set, this will be set on things like popups
-	xcb_get_property_cookie_t cookieProp = xcb_get_property(connection, 0, window, XCB_ATOM_WM_CLASS, XCB_ATOM_STRING, 0, long_length);
-	xcb_get_property_cookie_t cookieTransient = xcb_get_property(connection, 0, window, XCB_ATOM_WM_TRANSIENT_FOR, XCB_ATOM_WINDOW, 0, long_length);
-	xcb_get_property_reply_t* replyProp = xcb_get_property_reply(connection, cookieProp, NULL);
-	if (replyProp != NULL) {
-		auto len = xcb_get_property_value_length(replyProp);
-		// if len == long_length then that means we didn't read the whole property, so discard.
-		if (len > 0 && (uint32_t)len < long_length) {
-			char buffer[long_length] = { 0 };
-			memcpy(buffer, xcb_get_property_value(replyProp), len);
-			// first is instance name, then class name - both null terminated. we want class name.
-			const char* classname = buffer + strlen(buffer) + 1;
-			if (strcmp(classname, "RuneScape") == 0 || strcmp(classname, "steam_app_1343400") == 0 || strcmp(classname, "rs2client.exe") == 0) {
-				auto replyTransient = xcb_get_property_reply(connection, cookieTransient, NULL);
-				if (replyTransient && xcb_get_property_value_length(replyTransient) == 0) {
-					free(replyProp);
-					return true;
-				}
-			}
-		}
+struct RsWindowCookies {
+	xcb_get_property_cookie_t windowClass;
+	xcb_get_property_cookie_t transient;
+};
+
+constexpr uint32_t rsClassMaxLongs = 64; // Any length higher than 2x+3 of the longest string we may match is fine
+
+// Check window class (WM_CLASS property); this is set by the application controlling the window
+// Also check WM_TRANSIENT_FOR is not set, this will be set on things like popups
+RsWindowCookies SendRsWindowCheck(xcb_connection_t* conn, xcb_window_t window) {
+	RsWindowCookies cookies;
+	cookies.windowClass = xcb_get_property(conn, 0, window, XCB_ATOM_WM_CLASS, XCB_ATOM_STRING, 0, rsClassMaxLongs);
+	cookies.transient = xcb_get_property(conn, 0, window, XCB_ATOM_WM_TRANSIENT_FOR, XCB_ATOM_WINDOW, 0, rsClassMaxLongs);
+	return cookies;
+}
+
+bool ReceiveRsWindowCheck(xcb_connection_t* conn, RsWindowCookies cookies) {
+	std::unique_ptr<xcb_get_property_reply_t, decltype(&free)> replyProp { xcb_get_property_reply(conn, cookies.windowClass, NULL), &free };
+	std::unique_ptr<xcb_get_property_reply_t, decltype(&free)> replyTransient { xcb_get_property_reply(conn, cookies.transient, NULL), &free };
+	if (!replyProp) {
+		return false;
+	}
+	auto len = xcb_get_property_value_length(replyProp.get());
+	// if len == rsClassMaxLongs then that means we didn't read the whole property, so discard.
+	if (len <= 0 || (uint32_t)len >= rsClassMaxLongs) {
+		return false;
+	}
+	char buffer[rsClassMaxLongs] = { 0 };
+	memcpy(buffer, xcb_get_property_value(replyProp.get()), len);
+	// first is instance name, then class name - both null terminated. we want class name.
+	const char* classname = buffer + strlen(buffer) + 1;
+	if (strcmp(classname, "RuneScape") == 0 || strcmp(classname, "steam_app_1343400") == 0 || strcmp(classname, "rs2client.exe") == 0) {
+		return replyTransient && xcb_get_property_value_length(replyTransient.get()) == 0;
 	}
-	free(replyProp);
 	return false;
 }
 
+bool IsRsWindow(const xcb_window_t window) {
+	ensureConnection();
+	return ReceiveRsWindowCheck(connection, SendRsWindowCheck(connection, window));
+}
+
 void GetRsHandlesRecursively(const xcb_window_t window, std::vector<OSWindow>* out, unsigned int depth = 0) {
 	xcb_query_tree_cookie_t cookie = xcb_query_tree(connection, window);
 	xcb_query_tree_reply_t* reply = xcb_query_tree_reply(connection, cookie, NULL);
@@ -200,9 +364,73 @@ void OSSetWindowParent(OSWindow window, OSWindow parent) {
 	}
 }
 
+// Process that owns the window from _NET_WM_PID, 0 if the window doesn't say
+pid_t WindowPid(xcb_window_t window) {
+	ensureConnection();
+	std::lock_guard<std::mutex> lock(pidMutex);
+	bool cache = windowThreadExists && !windowThreadStop;
+	if (cache) {
+		auto known = windowPids.find(window);
+		if (known != windowPids.end()) {
+			return known->second;
+		}
+		// Select structure events before reading so the destroy of the window can't slip in between
+		xcb_change_window_attributes(connection, window, XCB_CW_EVENT_MASK, &trackedWindowMask);
+	}
+	uint32_t wmpid;
+	xcb_get_property_cookie_t cookie = xcb_ewmh_get_wm_pid(&ewmhConnection, window);
+	if (xcb_ewmh_get_wm_pid_reply(&ewmhConnection, cookie, &wmpid, NULL) == 0) {
+		return 0;
+	}
+	if (cache) { windowPids[window] = wmpid; }
+	return wmpid;
+}
+
+// Grabs the client area from the root window. The root spans every monitor, only the part of the monitors the
+// client is on is copied. Returns false if the client isn't on any monitor
+bool CaptureDesktop(OSWindow wnd, vector<CaptureRect>& rects) {
+	JSRectangle client = wnd.GetClientBounds();
+	int x1 = INT32_MAX, y1 = INT32_MAX, x2 = INT32_MIN, y2 = INT32_MIN;
+	for (auto& monitor : getMonitors()) {
+		auto& m = monitor.bounds;
+		int left = std::max(client.x, m.x), top = std::max(client.y, m.y);
+		int right = std::min(client.x + client.width, m.x + m.width), bottom = std::min(client.y + client.height, m.y + m.height);
+		if (left >= right || top >= bottom) {
+			continue;
+		}
+		x1 = std::min(x1, left);
+		y1 = std::min(y1, top);
+		x2 = std::max(x2, right);
+		y2 = std::max(y2, bottom);
+	}
+	if (x1 >= x2 || y1 >= y2) {
+		return false;
+	}
+
+	XShmCapture acquirer(connection, rootWindow, x1, y1, x2 - x1, y2 - y1);
+	// Rects are client relative, the grabbed area starts at x1,y1 on the desktop
+	int dx = client.x - x1;
+	int dy = client.y - y1;
+	for (CaptureRect &rect : rects) {
+		if (rect.scale != 1) {
+			acquirer.copyScaled(reinterpret_cast<char*>(rect.data), rect.size, rect.rect.x + dx, rect.rect.y + dy, rect.rect.width, rect.rect.height, rect.scale);
+		} else {
+			acquirer.copy(reinterpret_cast<char*>(rect.data), rect.size, rect.rect.x + dx, rect.rect.y + dy, rect.rect.width, rect.rect.height);
+		}
+	}
+	return true;
+}
+
 void OSCaptureMulti(OSWindow wnd, CaptureMode mode, vector<CaptureRect> rects, Napi::Env env) {
-	// Ignore capture mode, XComposite will always work
 	ensureConnection();
+	if (mode == CaptureMode::Desktop && CaptureDesktop(wnd, rects)) {
+		return;
+	}
+	// Only works when the client runs with the swap hook, see linux/glframes.h
+	if (mode == CaptureMode::OpenGL && captureGlFrame(WindowPid(wnd.handle), wnd.handle, rects)) {
+		return;
+	}
+	// Window mode and the OpenGL fallback use XComposite, it works regardless of what covers the window
 	xcb_composite_redirect_window(connection, wnd.handle, XCB_COMPOSITE_REDIRECT_AUTOMATIC);
 	xcb_pixmap_t pixId = xcb_generate_id(connection);
 	xcb_composite_name_window_pixmap(connection, wnd.handle, pixId);
@@ -217,93 +445,328 @@ void OSCaptureMulti(OSWindow wnd, CaptureMode mode, vector<CaptureRect> rects, N
 	XShmCapture acquirer(connection, pixId);
 
 	for (CaptureRect &rect : rects) {
-		acquirer.copy(reinterpret_cast<char*>(rect.data), rect.size, rect.rect.x, rect.rect.y, rect.rect.width, rect.rect.height);
+		if (rect.scale != 1) {
+			acquirer.copyScaled(reinterpret_cast<char*>(rect.data), rect.size, rect.rect.x, rect.rect.y, rect.rect.width, rect.rect.height, rect.scale);
+		} else {
+			acquirer.copy(reinterpret_cast<char*>(rect.data), rect.size, rect.rect.x, rect.rect.y, rect.rect.width, rect.rect.height);
+		}
 	}
 
 	free(reply);
 	xcb_free_pixmap(connection, pixId);
 }
 
-OSWindow OSGetActiveWindow() {
+xcb_window_t QueryActiveWindow() {
+	ensureConnection();
 	xcb_get_property_cookie_t cookie = xcb_ewmh_get_active_window(&ewmhConnection, 0);
 	xcb_window_t window;
 	if (xcb_ewmh_get_active_window_reply(&ewmhConnection, cookie, &window, NULL) == 0) {
-		return OSWindow(0);
+		return XCB_NONE;
 	}
+	return window;
+}
 
-	return OSWindow(window);
+OSWindow OSGetActiveWindow() {
+	if (activeWindowCached) {
+		return OSWindow(activeWindow);
+	}
+	return OSWindow(QueryActiveWindow());
 }
 
 
-// Only for use from the window thread
+// Only for use from the window and record threads
 struct CondPair {
 	std::condition_variable condvar;
 	std::mutex mutex;
-	bool done;
-	CondPair(): done(false) {}
-	CondPair(CondPair& other): done(other.done) {}
-	CondPair(CondPair&& other): done(other.done) {}
+	bool done = false;
+	// The callback never runs if its environment is torn down first, stop waiting on it in that case
+	std::shared_ptr<std::atomic<bool>> closing;
+	CondPair(std::shared_ptr<std::atomic<bool>> closing): closing(closing) {}
 };
-std::vector<CondPair> condvars;
 template<typename F, typename COND>
 void IterateEvents(COND cond, F callback) {
+	std::vector<std::shared_ptr<CondPair>> condvars;
 	eventMutex.lock();
 	for (auto it = trackedEvents.begin(); it != trackedEvents.end(); it++) {
 		if (cond(*it)) {
-			condvars.push_back(CondPair());
-			CondPair* pair = &*condvars.end();
-			it->callback.BlockingCall([callback, &pair](Napi::Env env, Napi::Function jsCallback) {
+			auto pair = std::make_shared<CondPair>(it->closing);
+			napi_status status = it->callback.BlockingCall([callback, pair](Napi::Env env, Napi::Function jsCallback) {
 				callback(env, jsCallback);
 				std::unique_lock<std::mutex> lock(pair->mutex);
 				pair->done = true;
 				pair->condvar.notify_all();
 			});
+			if (status == napi_ok) {
+				condvars.push_back(pair);
+			}
 		}
 	}
 	eventMutex.unlock();
-	for(auto it = condvars.begin(); it != condvars.end(); it++) {
-		std::unique_lock<std::mutex> lock(it->mutex);
-		while(!it->done) it->condvar.wait(lock);
+	// Once asked to stop the thread never waits on js again, so it can be joined from the js thread without deadlocking
+	for (auto& pair : condvars) {
+		std::unique_lock<std::mutex> lock(pair->mutex);
+		while (!pair->done && !pair->closing->load() && !windowThreadStop) {
+			pair->condvar.wait_for(lock, std::chrono::milliseconds(100));
+		}
 	}
-	condvars.clear();
 }
 
-void OSSetWindowShape(OSWindow window, std::vector<JSRectangle> rects) {
-	ensureConnection();
+void SendShapeRects(xcb_window_t window, xcb_shape_op_t op, const ShapeRegion& region) {
+	auto rects = region.ToRects();
 	std::vector<xcb_rectangle_t> xrects;
 	xrects.reserve(rects.size());
-	for (size_t i = 0; i < rects.size(); i += 1) {
-		xcb_rectangle_t rect;
-		rect.x = rects[i].x;
-		rect.y = rects[i].y;
-		rect.width = rects[i].width;
-		rect.height = rects[i].height;
-		xrects.push_back(rect);
-	}
-	uint8_t ordering = 0;
-	if (xrects.size() < 2) ordering = 3;
-	//TODO this 5k x 5k special case is weird, implement separate clear call again?
-	if (rects.size() == 1 && rects[1].width >= 5000 && rects[1].height >= 5000) {
-		xcb_shape_mask(connection, 0, XCB_SHAPE_SK_INPUT, window.handle, 0, 0, 0);
-	}
-	else {
-		xcb_shape_rectangles(connection, XCB_SHAPE_SO_SET, XCB_SHAPE_SK_INPUT, ordering, window.handle, 0, 0, xrects.size(), xrects.data());
+	for (auto& rect : rects) {
+		xcb_rectangle_t xrect;
+		xrect.x = rect.x;
+		xrect.y = rect.y;
+		xrect.width = rect.width;
+		xrect.height = rect.height;
+		xrects.push_back(xrect);
+	}
+	xcb_shape_rectangles(connection, op, XCB_SHAPE_SK_INPUT, XCB_CLIP_ORDERING_YX_BANDED, window, 0, 0, xrects.size(), xrects.data());
+}
+
+void OSSetWindowShape(OSWindow window, const ShapeRegion& region) {
+	ensureConnection();
+	std::lock_guard<std::mutex> lock(shapeMutex);
+	bool cache = windowThreadExists && !windowThreadStop;
+	auto applied = cache ? appliedShapes.find(window.handle) : appliedShapes.end();
+	int sent = 0;
+	if (applied == appliedShapes.end()) {
+		if (cache) {
+			// Select the events that invalidate the entry before the first shape, so its notify is counted as ours
+			xcb_change_window_attributes(connection, window.handle, XCB_CW_EVENT_MASK, &trackedWindowMask);
+			xcb_shape_select_input(connection, window.handle, 1);
+		}
+		SendShapeRects(window.handle, XCB_SHAPE_SO_SET, region);
+		sent = 1;
+	} else {
+		const ShapeRegion& previous = applied->second.region;
+		if (previous == region) {
+			return;
+		}
+		// Send only the difference, unless that takes more rects than just replacing the whole shape
+		auto added = region.Subtract(previous);
+		auto removed = previous.Subtract(region);
+		if (added.RectCount() + removed.RectCount() < region.RectCount()) {
+			if (!removed.IsEmpty()) { SendShapeRects(window.handle, XCB_SHAPE_SO_SUBTRACT, removed); sent++; }
+			if (!added.IsEmpty()) { SendShapeRects(window.handle, XCB_SHAPE_SO_UNION, added); sent++; }
+		} else {
+			SendShapeRects(window.handle, XCB_SHAPE_SO_SET, region);
+			sent = 1;
+		}
+	}
+	if (cache) {
+		auto& entry = appliedShapes[window.handle];
+		entry.region = region;
+		entry.pendingNotifies += sent;
 	}
 	xcb_flush(connection);
 }
 
+// Should only be called from the window thread.
+// Input shape changes of windows we applied a shape to, our own requests cause them too. Returns false for other events
+bool HandleShapeNotify(xcb_generic_event_t* event) {
+	const xcb_query_extension_reply_t* ext = xcb_get_extension_data(connection, &xcb_shape_id);
+	if (!ext || !ext->present || (event->response_type & ~0x80) != ext->first_event + XCB_SHAPE_NOTIFY) {
+		return false;
+	}
+	xcb_shape_notify_event_t* notify = (xcb_shape_notify_event_t*)event;
+	if (notify->shape_kind != XCB_SHAPE_SK_INPUT) {
+		return true;
+	}
+	std::lock_guard<std::mutex> lock(shapeMutex);
+	auto applied = appliedShapes.find(notify->affected_window);
+	if (applied != appliedShapes.end()) {
+		if (applied->second.pendingNotifies > 0) {
+			applied->second.pendingNotifies--;
+		} else {
+			// Changed by someone else, the next shape can't be a diff
+			appliedShapes.erase(applied);
+		}
+	}
+	return true;
+}
+
+void OSOverlayCommands(OSWindow window, int frameid, std::vector<OverlayCommand> commands) {
+	overlayCommands(window.handle, frameid, std::move(commands));
+}
+
+void OSOverlayCloseFrame(OSWindow window, int frameid) {
+	overlayCloseFrame(window.handle, frameid);
+}
+
+// Own connection of the window query thread, queries on the shared connection would wait behind captures and the window thread
+xcb_connection_t* queryConnection = NULL;
+
+struct BoundsCookies {
+	xcb_get_geometry_cookie_t geometry;
+	xcb_translate_coordinates_cookie_t translation;
+};
+
+// Breadth first version of GetRsHandlesRecursively, the tree queries and class checks of a whole level are sent at once
+std::vector<OSWindow> QueryRsHandlesPipelined(xcb_connection_t* conn) {
+	std::vector<OSWindow> out;
+	std::vector<xcb_window_t> level = { rootWindow };
+	while (!level.empty()) {
+		std::vector<xcb_query_tree_cookie_t> treeCookies;
+		for (xcb_window_t window : level) {
+			treeCookies.push_back(xcb_query_tree_unchecked(conn, window));
+		}
+		std::vector<xcb_window_t> children;
+		for (auto& cookie : treeCookies) {
+			std::unique_ptr<xcb_query_tree_reply_t, decltype(&free)> reply { xcb_query_tree_reply(conn, cookie, NULL), &free };
+			if (!reply) {
+				continue;
+			}
+			xcb_window_t* list = xcb_query_tree_children(reply.get());
+			children.insert(children.end(), list, list + xcb_query_tree_children_length(reply.get()));
+		}
+		std::vector<RsWindowCookies> checks;
+		checks.reserve(children.size());
+		for (xcb_window_t child : children) {
+			checks.push_back(SendRsWindowCheck(conn, child));
+		}
+		std::vector<OSWindow> found;
+		for (size_t i = 0; i < children.size(); i++) {
+			if (ReceiveRsWindowCheck(conn, checks[i])) {
+				found.push_back(OSWindow(children[i]));
+			}
+		}
+		// Only the deepest instances count, same as the recursive search
+		if (!found.empty()) {
+			out = std::move(found);
+		}
+		level = std::move(children);
+	}
+	return out;
+}
+
+void OSRunWindowQueries(vector<WindowQuery>& batch) {
+	// Atoms and the root window come from the shared connection, they are the same for every connection
+	ensureConnection();
+	if (queryConnection != NULL && xcb_connection_has_error(queryConnection)) {
+		xcb_disconnect(queryConnection);
+		queryConnection = NULL;
+	}
+	if (queryConnection == NULL) {
+		queryConnection = xcb_connect(NULL, NULL);
+		if (xcb_connection_has_error(queryConnection)) {
+			xcb_disconnect(queryConnection);
+			queryConnection = NULL;
+			throw std::runtime_error("Cannot initiate xcb connection for window queries");
+		}
+	}
+	xcb_connection_t* conn = queryConnection;
+
+	// Everything except the rs window search is a single round trip, all of it is sent before waiting on any reply
+	std::vector<BoundsCookies> bounds(batch.size());
+	std::vector<TitleCookies> titles(batch.size());
+	std::vector<xcb_get_property_cookie_t> active(batch.size());
+	bool rsHandles = false;
+	for (size_t i = 0; i < batch.size(); i++) {
+		auto& query = batch[i];
+		switch (query.type) {
+			case WindowQueryType::Bounds:
+			case WindowQueryType::ClientBounds:
+				bounds[i].geometry = xcb_get_geometry_unchecked(conn, query.window.handle);
+				bounds[i].translation = xcb_translate_coordinates_unchecked(conn, query.window.handle, rootWindow, 0, 0);
+				break;
+			case WindowQueryType::Title:
+				titles[i] = SendTitleRequest(conn, query.window.handle);
+				break;
+			case WindowQueryType::ActiveWindow:
+				active[i] = xcb_get_property_unchecked(conn, 0, rootWindow, ewmhConnection._NET_ACTIVE_WINDOW, XCB_ATOM_WINDOW, 0, 1);
+				break;
+			case WindowQueryType::RsHandles:
+				rsHandles = true;
+				break;
+		}
+	}
+	xcb_flush(conn);
+
+	// The search runs while the replies above are already on their way, its result is shared by every query in the batch
+	std::vector<OSWindow> handles;
+	if (rsHandles) {
+		handles = QueryRsHandlesPipelined(conn);
+	}
+
+	for (size_t i = 0; i < batch.size(); i++) {
+		auto& query = batch[i];
+		switch (query.type) {
+			case WindowQueryType::Bounds:
+			case WindowQueryType::ClientBounds: {
+				std::unique_ptr<xcb_get_geometry_reply_t, decltype(&free)> geometry { xcb_get_geometry_reply(conn, bounds[i].geometry, NULL), &free };
+				std::unique_ptr<xcb_translate_coordinates_reply_t, decltype(&free)> translation { xcb_translate_coordinates_reply(conn, bounds[i].translation, NULL), &free };
+				if (geometry && translation) {
+					query.rect = JSRectangle(translation->dst_x, translation->dst_y, geometry->width, geometry->height);
+				}
+				break;
+			}
+			case WindowQueryType::Title:
+				query.title = ReceiveTitle(conn, titles[i]);
+				break;
+			case WindowQueryType::ActiveWindow: {
+				std::unique_ptr<xcb_get_property_reply_t, decltype(&free)> reply { xcb_get_property_reply(conn, active[i], NULL), &free };
+				if (reply && xcb_get_property_value_length(reply.get()) == sizeof(xcb_window_t)) {
+					query.window = OSWindow(*reinterpret_cast<xcb_window_t*>(xcb_get_property_value(reply.get())));
+				}
+				break;
+			}
+			case WindowQueryType::RsHandles:
+				query.windows = handles;
+				break;
+		}
+	}
+	// Missing replies of a broken connection look like windows that don't exist, report the failure instead
+	if (xcb_connection_has_error(conn)) {
+		throw std::runtime_error("Lost the xcb connection during window queries");
+	}
+}
+
+void OSEndWindowQueries() {
+	if (queryConnection != NULL) {
+		xcb_disconnect(queryConnection);
+		queryConnection = NULL;
+	}
+}
+
+vector<OSMonitor> OSGetMonitors() {
+	return getMonitors();
+}
+
+bool OSGetCursorImage(uint32_t knownSerial, OSCursorImage& out) {
+	return getCursorImage(knownSerial, out);
+}
+
+int OSAddPixelWatch(OSWindow window, std::vector<PixelPredicate> predicates, int interval, Napi::Function callback) {
+	return addPixelWatch(window.handle, std::move(predicates), interval, callback);
+}
+
+void OSRemovePixelWatch(int id) {
+	removePixelWatch(id);
+}
+
+OSProcessStats OSGetProcessStats(OSWindow window) {
+	pid_t pid = WindowPid(window.handle);
+	if (pid == 0) {
+		return OSProcessStats();
+	}
+	return getProcessStats(pid);
+}
+
 bool OSGetMouseState() {
 	return isLeftMouseDown;
 }
 
 void OSNewWindowListener(OSWindow window, WindowEventType type, Napi::Function callback) {
+	ensureConnection();
 	auto event = TrackedEvent(window.handle, type, callback);
 
 	// If this is a new window, request all its events from X server
 	eventMutex.lock();
 	if (window.handle != 0 && std::find_if(trackedEvents.begin(), trackedEvents.end(), [window](TrackedEvent& e) {return e.window == window.handle;}) == trackedEvents.end()) {
-		constexpr uint32_t values[] = { XCB_EVENT_MASK_STRUCTURE_NOTIFY };
-		xcb_change_window_attributes(connection, window.handle, XCB_CW_EVENT_MASK, values);
+		xcb_change_window_attributes(connection, window.handle, XCB_CW_EVENT_MASK, &trackedWindowMask);
 	}
 	
 	// Add the event
@@ -317,14 +780,6 @@ void OSNewWindowListener(OSWindow window, WindowEventType type, Napi::Function c
 void OSRemoveWindowListener(OSWindow window, WindowEventType type, Napi::Function callback) {
 	eventMutex.lock();
 
-	// If there are no more tracked events for this window, request X server to stop sending any events about it
-	if (window.handle != 0 && std::find_if(trackedEvents.begin(), trackedEvents.end(), [window](TrackedEvent& e) {return e.window == window.handle;}) == trackedEvents.end()) {
-		constexpr uint32_t values[] = { XCB_NONE };
-		xcb_change_window_attributes_checked(connection, window.handle, XCB_CW_EVENT_MASK, values);
-	}
-
-	bool wait = trackedEvents.size() != 0;
-
 	// Remove any matching events
 	trackedEvents.erase(
 		std::remove_if(
@@ -341,35 +796,83 @@ void OSRemoveWindowListener(OSWindow window, WindowEventType type, Napi::Functio
 		trackedEvents.end()
 	);
 
-	wait &= trackedEvents.size() == 0;
+	// If there are no more tracked events for this window, request X server to stop sending any events about it
+	if (window.handle != 0 && std::find_if(trackedEvents.begin(), trackedEvents.end(), [window](TrackedEvent& e) {return e.window == window.handle;}) == trackedEvents.end()) {
+		// Cached titles, pids and shapes still need their property, unmap and destroy events
+		std::lock_guard<std::mutex> lock(titleMutex);
+		std::lock_guard<std::mutex> pidlock(pidMutex);
+		std::lock_guard<std::mutex> shapelock(shapeMutex);
+		if (titleCache.find(window.handle) == titleCache.end() && windowPids.find(window.handle) == windowPids.end() && appliedShapes.find(window.handle) == appliedShapes.end()) {
+			constexpr uint32_t values[] = { XCB_NONE };
+			xcb_change_window_attributes(connection, window.handle, XCB_CW_EVENT_MASK, values);
+			xcb_flush(connection);
+		}
+	}
 	eventMutex.unlock();
 
-	// If the window thread has nothing left to do, send it a wakeup, then wait for it to exit
-	if (wait) {
-		xcb_disconnect(connection);
-		xcb_flush(connection);
-		windowThread.join();
-		recordThread.join();
-		connection = NULL;
-	}
+	StopWindowThreadIfIdle();
 }
 
 bool WindowThreadShouldRun() {
-	eventMutex.lock();
-	bool anyEvents = trackedEvents.size() != 0;
-	eventMutex.unlock();
-	return anyEvents;
+	std::lock_guard<std::mutex> lock(eventMutex);
+	return trackedEvents.size() != 0;
 }
 
 void StartWindowThread() {
 	// Only start if there isn't already a window thread running
-	windowThreadMutex.lock();
-	if (!windowThreadExists) {
-		windowThreadExists = true;
-		windowThread = std::thread(WindowThread);
+	std::lock_guard<std::mutex> lock(windowThreadMutex);
+	if (windowThreadExists && !windowThreadStop) {
+		return;
+	}
+	// The previous threads were asked to stop or died on their own (connection error), reap them before starting new ones
+	JoinWindowThreads();
+
+	ensureConnection();
+	if (wakeWindow == XCB_NONE) {
+		wakeWindow = xcb_generate_id(connection);
+		xcb_create_window(connection, XCB_COPY_FROM_PARENT, wakeWindow, rootWindow, -1, -1, 1, 1, 0, XCB_WINDOW_CLASS_INPUT_ONLY, XCB_COPY_FROM_PARENT, 0, NULL);
+		xcb_flush(connection);
+	}
+	windowThreadStop = false;
+	windowThreadExists = true;
+	windowThread = std::thread(WindowThread);
+	// Raw input events arrive on the window thread, XRecord needs a thread and connection of its own
+	if (!startRawInput()) {
 		recordThread = std::thread(RecordThread);
 	}
-	windowThreadMutex.unlock();
+}
+
+// Asks the window and record threads to stop once no environment has any listeners left. Doesn't wait for them, this
+// runs on the js thread while the window thread may still be waiting on a listener call. They are joined when the
+// next thread starts or the connection closes. The x connection stays open, other environments can still be using it
+void StopWindowThreadIfIdle() {
+	std::lock_guard<std::mutex> lock(windowThreadMutex);
+	if (!windowThreadExists || windowThreadStop || WindowThreadShouldRun()) {
+		return;
+	}
+	windowThreadStop = true;
+
+	// A client message sent with an empty event mask is delivered to the creator of the window, which is us
+	xcb_client_message_event_t wake;
+	memset(&wake, 0, sizeof(wake));
+	wake.response_type = XCB_CLIENT_MESSAGE;
+	wake.format = 32;
+	wake.window = wakeWindow;
+	wake.type = XCB_ATOM_NONE;
+	xcb_send_event(connection, 0, wakeWindow, XCB_EVENT_MASK_NO_EVENT, reinterpret_cast<const char*>(&wake));
+	// Disabling the record context makes the server send XRecordEndOfData to the record thread
+	uint32_t context = recordContext.exchange(0);
+	if (context != 0) {
+		xcb_record_disable_context(connection, context);
+	}
+	xcb_flush(connection);
+}
+
+// Callers hold windowThreadMutex. Only blocks for as long as the threads take to leave their event loops, a stopping
+// window thread doesn't wait on listener calls anymore
+void JoinWindowThreads() {
+	if (windowThread.joinable()) { windowThread.join(); }
+	if (recordThread.joinable()) { recordThread.join(); }
 }
 
 // Should only be called from the window thread.
@@ -411,13 +914,65 @@ void HandleNewWindow(const xcb_window_t window, xcb_window_t parent) {
 	}
 }
 
+// Should only be called from the window thread.
+// Called when the window manager changed _NET_ACTIVE_WINDOW on the root window
+void HandleActiveWindowChange() {
+	xcb_window_t previous = activeWindow;
+	xcb_window_t active = QueryActiveWindow();
+	activeWindow = active;
+	if (active == previous) {
+		return;
+	}
+	IterateEvents(
+		[active, previous](const TrackedEvent& e){return e.type == WindowEventType::Focus && (e.window == 0 || e.window == active || e.window == previous);},
+		[active](Napi::Env env, Napi::Function callback){callback.Call({Napi::BigInt::New(env, (uint64_t)active)});}
+	);
+}
+
+// Should only be called from the window thread.
+// Called when WM_NAME or _NET_WM_NAME of a window we selected property events on changed
+void HandleTitleChange(xcb_window_t window) {
+	std::string previous;
+	titleMutex.lock();
+	auto cached = titleCache.find(window);
+	bool hadPrevious = cached != titleCache.end();
+	if (hadPrevious) {
+		previous = std::move(cached->second);
+		titleCache.erase(cached);
+	}
+	titleMutex.unlock();
+
+	eventMutex.lock();
+	bool listening = std::find_if(trackedEvents.begin(), trackedEvents.end(), [window](TrackedEvent& e) {return e.type == WindowEventType::Title && e.window == window;}) != trackedEvents.end();
+	eventMutex.unlock();
+	if (!listening) {
+		return;
+	}
+	// Apps tend to set both properties at once, only report actual changes
+	std::string title = OSWindow(window).GetTitle();
+	if (hadPrevious && title == previous) {
+		return;
+	}
+	IterateEvents(
+		[window](const TrackedEvent& e){return e.type == WindowEventType::Title && e.window == window;},
+		[title](Napi::Env env, Napi::Function callback){callback.Call({Napi::String::New(env, title)});}
+	);
+}
+
 void WindowThread() {
-	// Request substructure events for root window
-	constexpr uint32_t rootValues[] = { XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY };
-    xcb_change_window_attributes(connection, rootWindow, XCB_CW_EVENT_MASK, rootValues);
+	// Request substructure events for root window, and property events to keep track of the active window
+	constexpr uint32_t rootValues[] = { XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY | XCB_EVENT_MASK_PROPERTY_CHANGE };
+	xcb_change_window_attributes(connection, rootWindow, XCB_CW_EVENT_MASK, rootValues);
+	// Changes are reported from here on, so the value we read now stays valid
+	activeWindow = QueryActiveWindow();
+	activeWindowCached = true;
+	// Monitor topology is cached from here on, RandR reports every change to it
+	startMonitorTracking();
+	// Cursor shape changes come in as XFixes events, apps get them without having to capture around the pointer
+	startCursorTracking();
 
 	xcb_generic_event_t* event;
-	while (WindowThreadShouldRun()) {
+	while (!windowThreadStop) {
 		event = xcb_wait_for_event(connection);
 		if (event) {
 			auto type = event->response_type & ~0x80;
@@ -447,12 +1002,29 @@ void WindowThread() {
 				case XCB_DESTROY_NOTIFY: {
 					xcb_destroy_notify_event_t* destroy = (xcb_destroy_notify_event_t*)event;
 					xcb_window_t window = destroy->window;
+					shapeMutex.lock();
+					appliedShapes.erase(window);
+					shapeMutex.unlock();
+					titleMutex.lock();
+					titleCache.erase(window);
+					titleMutex.unlock();
+					pidMutex.lock();
+					windowPids.erase(window);
+					pidMutex.unlock();
 					IterateEvents(
 						[window](const TrackedEvent& e){return e.type == WindowEventType::Close && e.window == window;},
 						[](Napi::Env env, Napi::Function callback){callback.Call({});}
 					);
 					break;
 				}
+				case XCB_UNMAP_NOTIFY: {
+					// Toolkits reset the input shape of windows they map again
+					xcb_unmap_notify_event_t* unmap = (xcb_unmap_notify_event_t*)event;
+					shapeMutex.lock();
+					appliedShapes.erase(unmap->window);
+					shapeMutex.unlock();
+					break;
+				}
 				case XCB_REPARENT_NOTIFY: {
 					xcb_reparent_notify_event_t* reparent = (xcb_reparent_notify_event_t*)event;
 					if(!reparent->override_redirect) {
@@ -460,12 +1032,45 @@ void WindowThread() {
 					}
 					break;
 				}
-				case XCB_EXPOSE: {
-					// Not an important event, but we use XCB_EXPOSE to wake up the window thread spontaneously,
-					// so it's important to catch it here
+				case XCB_PROPERTY_NOTIFY: {
+					xcb_property_notify_event_t* property = (xcb_property_notify_event_t*)event;
+					if (property->window == rootWindow && property->atom == ewmhConnection._NET_ACTIVE_WINDOW) {
+						HandleActiveWindowChange();
+					} else if (property->window == rootWindow && property->atom == XCB_ATOM_RESOURCE_MANAGER) {
+						// Xft.dpi lives in here
+						invalidateMonitors();
+					} else if (property->atom == ewmhConnection._NET_WM_NAME || property->atom == XCB_ATOM_WM_NAME) {
+						HandleTitleChange(property->window);
+					}
+					break;
+				}
+				case XCB_EXPOSE:
+				case XCB_CLIENT_MESSAGE: {
+					// Not important events, but we use a client message on wakeWindow to wake up the window thread
+					// spontaneously, so it's important to catch it here
 					break;
 				}
 				default: {
+					if (handleMonitorEvent(event)) {
+						break;
+					}
+					if (HandleShapeNotify(event)) {
+						break;
+					}
+					uint32_t button;
+					bool pressed;
+					if (handleRawInputEvent(event, button, pressed)) {
+						HandleRawButton(button, pressed);
+						break;
+					}
+					uint32_t serial;
+					if (handleCursorEvent(event, serial)) {
+						IterateEvents(
+							[](const TrackedEvent& e){return e.type == WindowEventType::Cursor && e.window == 0;},
+							[serial](Napi::Env env, Napi::Function callback){callback.Call({Napi::Number::New(env, serial)});}
+						);
+						break;
+					}
 					//std::cout << "native: got event type " << type << std::endl;
 					break;
 				}
@@ -477,7 +1082,39 @@ void WindowThread() {
 		}
 	}
 
+	activeWindowCached = false;
+	stopMonitorTracking();
+	stopCursorTracking();
+	stopRawInput();
+	// Nothing keeps the cached titles, pids and shapes up to date anymore, stop the events for windows that were only selected for them
+	eventMutex.lock();
+	titleMutex.lock();
+	pidMutex.lock();
+	shapeMutex.lock();
+	auto deselect = [](xcb_window_t window) {
+		if (std::find_if(trackedEvents.begin(), trackedEvents.end(), [window](TrackedEvent& e) {return e.window == window;}) == trackedEvents.end()) {
+			constexpr uint32_t values[] = { XCB_NONE };
+			xcb_change_window_attributes(connection, window, XCB_CW_EVENT_MASK, values);
+		}
+	};
+	for (auto& entry : titleCache) {
+		deselect(entry.first);
+	}
+	for (auto& entry : windowPids) {
+		if (titleCache.find(entry.first) == titleCache.end()) { deselect(entry.first); }
+	}
+	for (auto& entry : appliedShapes) {
+		xcb_shape_select_input(connection, entry.first, 0);
+		if (titleCache.find(entry.first) == titleCache.end() && windowPids.find(entry.first) == windowPids.end()) { deselect(entry.first); }
+	}
+	titleCache.clear();
+	windowPids.clear();
+	appliedShapes.clear();
 	windowThreadExists = false;
+	shapeMutex.unlock();
+	pidMutex.unlock();
+	titleMutex.unlock();
+	eventMutex.unlock();
 	std::cout << "native: window thread exiting" << std::endl;
 }
 
@@ -565,8 +1202,48 @@ xcb_window_t HitTest(int16_t x, int16_t y) {
 	return out;
 }
 
+// Should only be called from the window or record thread
+void HandleButtonPress(uint32_t button, int16_t x, int16_t y) {
+	if (button >= 1 && button <= 3) {
+		xcb_window_t hit = HitTest(x, y);
+		IterateEvents(
+			[hit](const TrackedEvent& e){return e.type == WindowEventType::Click && e.window == hit;},
+			[](Napi::Env env, Napi::Function callback){callback.Call({});}
+		);
+	}
+	if (button == 1) {
+		isLeftMouseDown = true;
+	}
+}
+
+void HandleButtonRelease(uint32_t button) {
+	if (button == 1) {
+		isLeftMouseDown = false;
+	}
+}
+
+// Should only be called from the window thread.
+// Raw events carry no position, only clicks that can hit a tracked window need the pointer
+void HandleRawButton(uint32_t button, bool pressed) {
+	if (!pressed) {
+		HandleButtonRelease(button);
+		return;
+	}
+	int16_t x = 0, y = 0;
+	if (button >= 1 && button <= 3) {
+		xcb_query_pointer_cookie_t cookie = xcb_query_pointer(connection, rootWindow);
+		std::unique_ptr<xcb_query_pointer_reply_t, decltype(&free)> pointer { xcb_query_pointer_reply(connection, cookie, NULL), &free };
+		if (!pointer) {
+			return;
+		}
+		x = pointer->root_x;
+		y = pointer->root_y;
+	}
+	HandleButtonPress(button, x, y);
+}
+
 void RecordThread() {
-	// Second event thread for using the X Record API, which we need to receive mouse button events
+	// Second event thread for using the X Record API, the fallback for mouse button events on servers without XInput 2
 	const xcb_query_extension_reply_t* ext = xcb_get_extension_data(connection, &xcb_record_id);
 	if (!ext) {
 		std::cerr << "native: X record extension is not supported; some features will not work" << std::endl;
@@ -598,16 +1275,29 @@ void RecordThread() {
 	auto rec_connection = xcb_connect(NULL, NULL);
 	if (xcb_connection_has_error(rec_connection)) {
 		std::cout << "native: couldn't start record thread connection; some features will not work" << std::endl;
+		xcb_record_free_context(connection, id);
+		xcb_disconnect(rec_connection);
 		return;
 	}
 
 	// xcb-record event loop
 	xcb_record_enable_context_cookie_t cookie2 = xcb_record_enable_context(rec_connection, id);
-	while (WindowThreadShouldRun()) {
+	xcb_flush(rec_connection);
+	recordContext = id;
+	if (windowThreadStop && recordContext.exchange(0) != 0) {
+		// We were asked to stop before the context was published, nobody else is going to disable it
+		xcb_record_disable_context(connection, id);
+		xcb_flush(connection);
+	}
+	while (!windowThreadStop) {
 		xcb_record_enable_context_reply_t* reply = xcb_record_enable_context_reply(rec_connection, cookie2, NULL);
 		if (!reply) {
 			std::cout << "native: error in xcb_record_enable_context_reply" << std::endl;
-			continue;
+			break;
+		}
+		if (reply->category == 5) {
+			free(reply);
+			break;
 		}
 		if (reply->client_swapped) {
 			std::cout << "native: unsupported setting client_swapped; please report this error" << std::endl;
@@ -615,7 +1305,7 @@ void RecordThread() {
 		}
 
 		// 0 is XRecordFromServer; we also receive 4 (XRecordStartOfData) at the start of execution, and
-		// 5 (XRecordEndOfData) when we invalidate the main connection, which works as this thread's end-wakeup
+		// 5 (XRecordEndOfData) when the context is disabled from the main connection, which works as this thread's end-wakeup
 		if (reply->category == 0) {
 			uint8_t* data = xcb_record_enable_context_data(reply);
 			int data_len = xcb_record_enable_context_data_length(reply);
@@ -624,27 +1314,12 @@ void RecordThread() {
 				switch (ev->response_type) {
 					case XCB_BUTTON_PRESS: {
 						xcb_button_press_event_t* event = (xcb_button_press_event_t*)ev;
-						auto button = event->detail;
-						if (button >= 1 && button <= 3) {
-							int16_t click_x = event->root_x;
-							int16_t click_y = event->root_y;
-							xcb_window_t hit = HitTest(click_x, click_y);
-							IterateEvents(
-								[hit](const TrackedEvent& e){return e.type == WindowEventType::Click && e.window == hit;},
-								[](Napi::Env env, Napi::Function callback){callback.Call({});}
-							);
-						}
-						if(button == 1){
-							isLeftMouseDown = true;
-						}
+						HandleButtonPress(event->detail, event->root_x, event->root_y);
 						break;
 					}
 					case XCB_BUTTON_RELEASE: {
 						xcb_button_press_event_t* event = (xcb_button_press_event_t*)ev;
-						auto button = event->detail;
-						if(button == 1){
-							isLeftMouseDown = false;
-						}
+						HandleButtonRelease(event->detail);
 						break;
 					}
 				}
@@ -653,9 +1328,11 @@ void RecordThread() {
 		free(reply);
 	}
 
-	xcb_record_disable_context(rec_connection, id);
-	xcb_record_free_context(rec_connection, id);
-	xcb_flush(rec_connection);
+	if (recordContext.exchange(0) != 0) {
+		xcb_record_disable_context(connection, id);
+	}
+	xcb_record_free_context(connection, id);
+	xcb_flush(connection);
 	xcb_disconnect(rec_connection);
 	std::cout << "native: record thread exiting" << std::endl;
 }
@@ -0,0 +1,274 @@
+#include <algorithm>
+#include <cmath>
+#include "overlay.h"
+
+//how long deleted primitives stay around in a frozen group, same as the js overlay
+constexpr int64_t frozenBonusTime = 10 * 1000;
+
+uint32_t OverlayPremultiply(uint32_t argb, int coverage) {
+	uint32_t a = coverage;
+	uint32_t r = ((argb >> 16) & 0xff) * a / 255;
+	uint32_t g = ((argb >> 8) & 0xff) * a / 255;
+	uint32_t b = (argb & 0xff) * a / 255;
+	return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+void OverlayBlendPixel(uint32_t* dst, uint32_t premul) {
+	uint32_t srca = premul >> 24;
+	if (srca == 255) { *dst = premul; return; }
+	if (srca == 0) { return; }
+	uint32_t inv = 255 - srca;
+	uint32_t d = *dst;
+	//blend the rb and ag channel pairs in one go
+	uint32_t rb = ((d & 0x00ff00ff) * inv / 255) & 0x00ff00ff;
+	uint32_t ag = (((d >> 8) & 0x00ff00ff) * inv / 255) & 0x00ff00ff;
+	*dst = premul + (rb | (ag << 8));
+}
+
+JSRectangle OverlayIntersect(const JSRectangle& a, const JSRectangle& b) {
+	int x1 = std::max(a.x, b.x);
+	int y1 = std::max(a.y, b.y);
+	int x2 = std::min(a.x + a.width, b.x + b.width);
+	int y2 = std::min(a.y + a.height, b.y + b.height);
+	if (x2 <= x1 || y2 <= y1) { return JSRectangle(0, 0, 0, 0); }
+	return JSRectangle(x1, y1, x2 - x1, y2 - y1);
+}
+
+static void FillRect(OverlaySurface& surface, const JSRectangle& rect, const JSRectangle& clip, uint32_t color) {
+	auto area = OverlayIntersect(rect, clip);
+	uint32_t premul = OverlayPremultiply(color, 255);
+	for (int y = area.y; y < area.y + area.height; y++) {
+		uint32_t* row = surface.pixels + (size_t)y * surface.stride;
+		std::fill(row + area.x, row + area.x + area.width, premul);
+	}
+}
+
+static void DrawLine(OverlaySurface& surface, const OverlayPrimitive& line, const JSRectangle& clip) {
+	auto area = OverlayIntersect(line.bounds, clip);
+	//canvas puts coordinates on the center of pixels
+	float ax = line.x1 + 0.5f, ay = line.y1 + 0.5f;
+	float dx = line.x2 - line.x1, dy = line.y2 - line.y1;
+	float lensq = dx * dx + dy * dy;
+	float halfwidth = std::max(line.linewidth, 1) / 2.0f;
+	for (int y = area.y; y < area.y + area.height; y++) {
+		uint32_t* row = surface.pixels + (size_t)y * surface.stride;
+		for (int x = area.x; x < area.x + area.width; x++) {
+			float px = x + 0.5f - ax, py = y + 0.5f - ay;
+			float t = (lensq == 0 ? 0 : std::clamp((px * dx + py * dy) / lensq, 0.0f, 1.0f));
+			float ex = px - t * dx, ey = py - t * dy;
+			float coverage = std::clamp(halfwidth + 0.5f - std::sqrt(ex * ex + ey * ey), 0.0f, 1.0f);
+			if (coverage > 0) {
+				OverlayBlendPixel(row + x, OverlayPremultiply(line.color, (int)(coverage * 255)));
+			}
+		}
+	}
+}
+
+static void DrawRect(OverlaySurface& surface, const OverlayPrimitive& rect, const JSRectangle& clip) {
+	//same as canvas strokeRect inset by half the line width, the outer edge matches the rect
+	int lw = std::max(rect.linewidth, 1);
+	if (lw * 2 >= rect.width || lw * 2 >= rect.height) {
+		FillRect(surface, rect.bounds, clip, rect.color);
+		return;
+	}
+	FillRect(surface, JSRectangle(rect.x, rect.y, rect.width, lw), clip, rect.color);
+	FillRect(surface, JSRectangle(rect.x, rect.y + rect.height - lw, rect.width, lw), clip, rect.color);
+	FillRect(surface, JSRectangle(rect.x, rect.y + lw, lw, rect.height - 2 * lw), clip, rect.color);
+	FillRect(surface, JSRectangle(rect.x + rect.width - lw, rect.y + lw, lw, rect.height - 2 * lw), clip, rect.color);
+}
+
+static void DrawSprite(OverlaySurface& surface, const OverlayPrimitive& sprite, const JSRectangle& clip) {
+	auto area = OverlayIntersect(sprite.bounds, clip);
+	for (int y = area.y; y < area.y + area.height; y++) {
+		uint32_t* row = surface.pixels + (size_t)y * surface.stride;
+		const byte* src = sprite.sprite.data() + ((size_t)(y - sprite.y) * sprite.width + (area.x - sprite.x)) * 4;
+		for (int x = area.x; x < area.x + area.width; x++, src += 4) {
+			uint32_t argb = (src[0] << 16) | (src[1] << 8) | src[2];
+			OverlayBlendPixel(row + x, OverlayPremultiply(argb, src[3]));
+		}
+	}
+}
+
+OverlayScene::Group* OverlayScene::FindGroup(int frameid, const std::string& name) {
+	for (auto& group : groups) {
+		if (group->frameid == frameid && group->name == name) { return group.get(); }
+	}
+	groups.push_back(std::make_unique<Group>());
+	auto group = groups.back().get();
+	group->frameid = frameid;
+	group->name = name;
+	zsorted = false;
+	return group;
+}
+
+OverlayScene::Group*& OverlayScene::CurrentGroup(int frameid) {
+	for (auto& frame : framegroups) {
+		if (frame.first == frameid) { return frame.second; }
+	}
+	framegroups.push_back({ frameid, FindGroup(frameid, "") });
+	return framegroups.back().second;
+}
+
+void OverlayScene::DamageGroup(const Group& group) {
+	for (auto& prim : group.primitives) {
+		if (prim.visible) { damage.push_back(prim.action->bounds); }
+	}
+}
+
+void OverlayScene::CleanGroup(Group& group, int64_t now) {
+	int64_t bonustime = (group.frozen ? frozenBonusTime : 0);
+	int64_t endtime = now - bonustime;
+	int64_t nextupdate = INT64_MAX;
+	auto& prims = group.primitives;
+	prims.erase(std::remove_if(prims.begin(), prims.end(), [&](const ActivePrimitive& prim) {
+		bool keep = (!prim.deleted || group.frozen) && prim.endtime > endtime;
+		if (!keep && prim.visible) { damage.push_back(prim.action->bounds); }
+		return !keep;
+	}), prims.end());
+	for (auto& prim : prims) {
+		//elements created during freeze
+		if (!group.frozen && !prim.visible) {
+			prim.visible = true;
+			damage.push_back(prim.action->bounds);
+		}
+		nextupdate = std::min(nextupdate, prim.endtime + bonustime);
+	}
+	group.nextupdate = nextupdate;
+}
+
+void OverlayScene::ApplyCommands(int frameid, std::vector<OverlayCommand>& commands, int64_t now) {
+	Group*& current = CurrentGroup(frameid);
+	for (auto& command : commands) {
+		switch (command.type) {
+		case OverlayCommandType::Draw: {
+			auto prim = std::make_shared<OverlayPrimitive>(std::move(command.action));
+			switch (prim->type) {
+			case OverlayPrimitiveType::Line: {
+				int pad = std::max(prim->linewidth, 1) / 2 + 2;
+				prim->bounds = JSRectangle(std::min(prim->x1, prim->x2) - pad, std::min(prim->y1, prim->y2) - pad, std::abs(prim->x2 - prim->x1) + 2 * pad, std::abs(prim->y2 - prim->y1) + 2 * pad);
+				break;
+			}
+			case OverlayPrimitiveType::Text:
+				prim->bounds = (textRenderer ? textRenderer->Measure(*prim) : JSRectangle(0, 0, 0, 0));
+				break;
+			default:
+				prim->bounds = JSRectangle(prim->x, prim->y, prim->width, prim->height);
+				break;
+			}
+			current->primitives.push_back({ now + command.time, !current->frozen, false, prim });
+			if (!current->frozen) {
+				damage.push_back(prim->bounds);
+				current->nextupdate = 0;
+			}
+			break;
+		}
+		case OverlayCommandType::SetGroup:
+			current = FindGroup(frameid, command.groupid);
+			break;
+		case OverlayCommandType::ClearGroup: {
+			auto group = FindGroup(frameid, command.groupid);
+			for (auto& prim : group->primitives) { prim.deleted = true; }
+			if (!group->frozen) { group->nextupdate = 0; }
+			break;
+		}
+		case OverlayCommandType::SetGroupZIndex: {
+			auto group = FindGroup(frameid, command.groupid);
+			group->zindex = command.zindex;
+			zsorted = false;
+			group->nextupdate = 0;
+			DamageGroup(*group);
+			break;
+		}
+		case OverlayCommandType::FreezeGroup:
+			FindGroup(frameid, command.groupid)->frozen = true;
+			break;
+		case OverlayCommandType::ContinueGroup:
+		case OverlayCommandType::RefreshGroup: {
+			auto group = FindGroup(frameid, command.groupid);
+			bool oldfreeze = group->frozen;
+			group->frozen = false;
+			CleanGroup(*group, now);
+			if (command.type == OverlayCommandType::RefreshGroup) {
+				group->frozen = oldfreeze;
+			}
+			group->nextupdate = 0;
+			break;
+		}
+		}
+	}
+}
+
+void OverlayScene::CloseFrame(int frameid) {
+	framegroups.erase(std::remove_if(framegroups.begin(), framegroups.end(), [frameid](auto& frame) {return frame.first == frameid; }), framegroups.end());
+	groups.erase(std::remove_if(groups.begin(), groups.end(), [&](const std::unique_ptr<Group>& group) {
+		if (group->frameid != frameid) { return false; }
+		DamageGroup(*group);
+		return true;
+	}), groups.end());
+}
+
+int64_t OverlayScene::Update(int64_t now) {
+	if (!zsorted) {
+		std::stable_sort(groups.begin(), groups.end(), [](auto& a, auto& b) {return a->zindex < b->zindex; });
+		zsorted = true;
+	}
+	int64_t nextupdate = INT64_MAX;
+	for (auto& group : groups) {
+		CleanGroup(*group, now);
+		nextupdate = std::min(nextupdate, group->nextupdate);
+	}
+
+	//remove obsolete groups, unless a frame is still drawing into it
+	groups.erase(std::remove_if(groups.begin(), groups.end(), [&](const std::unique_ptr<Group>& group) {
+		if (group->primitives.size() != 0 || group->frozen || group->zindex != 0) { return false; }
+		for (auto& frame : framegroups) {
+			if (frame.second == group.get()) { return false; }
+		}
+		return true;
+	}), groups.end());
+	return nextupdate;
+}
+
+bool OverlayScene::IsEmpty() const {
+	for (auto& group : groups) {
+		for (auto& prim : group->primitives) {
+			if (prim.visible) { return false; }
+		}
+	}
+	return true;
+}
+
+void OverlayScene::DamageAll(int width, int height) {
+	damage.clear();
+	damage.push_back(JSRectangle(0, 0, width, height));
+}
+
+ShapeRegion OverlayScene::TakeDamage() {
+	auto region = ShapeRegion::FromRects(damage);
+	damage.clear();
+	return region;
+}
+
+void OverlayScene::Render(OverlaySurface& surface, const JSRectangle& cliprect) {
+	auto clip = OverlayIntersect(cliprect, JSRectangle(0, 0, surface.width, surface.height));
+	if (clip.width == 0) { return; }
+	for (int y = clip.y; y < clip.y + clip.height; y++) {
+		uint32_t* row = surface.pixels + (size_t)y * surface.stride;
+		std::fill(row + clip.x, row + clip.x + clip.width, 0);
+	}
+	for (auto& group : groups) {
+		for (auto& active : group->primitives) {
+			if (!active.visible) { continue; }
+			auto& prim = *active.action;
+			if (OverlayIntersect(prim.bounds, clip).width == 0) { continue; }
+			switch (prim.type) {
+			case OverlayPrimitiveType::Line: DrawLine(surface, prim, clip); break;
+			case OverlayPrimitiveType::Rect: DrawRect(surface, prim, clip); break;
+			case OverlayPrimitiveType::Sprite: DrawSprite(surface, prim, clip); break;
+			case OverlayPrimitiveType::Text:
+				if (textRenderer) { textRenderer->Draw(surface, prim, clip); }
+				break;
+			}
+		}
+	}
+}
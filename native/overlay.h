@@ -0,0 +1,116 @@
+#pragma once
+
+#include <memory>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "util.h"
+#include "region.h"
+
+/**
+ * Native version of the overlay frame in src/overlayframe, keeps the same group/freeze/timing semantics
+ * but rasterizes into a premultiplied argb surface and tracks which areas need to be redrawn
+ */
+
+enum class OverlayPrimitiveType { Line, Rect, Text, Sprite };
+
+struct OverlayPrimitive {
+	OverlayPrimitiveType type = OverlayPrimitiveType::Rect;
+	//argb, alpha is ignored like in the js overlay
+	uint32_t color = 0;
+	int linewidth = 1;
+	//line endpoints
+	int x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+	//rect, or top-left of text and sprites
+	int x = 0, y = 0, width = 0, height = 0;
+	//text
+	int size = 12;
+	std::string text;
+	std::string font;
+	bool shadow = false;
+	bool center = false;
+	//sprite pixels, rgba
+	std::vector<byte> sprite;
+	//pixels touched by this primitive, filled in by the scene
+	JSRectangle bounds;
+};
+
+enum class OverlayCommandType { Draw, SetGroup, ClearGroup, FreezeGroup, ContinueGroup, RefreshGroup, SetGroupZIndex };
+
+struct OverlayCommand {
+	OverlayCommandType type = OverlayCommandType::Draw;
+	std::string groupid;
+	int zindex = 0;
+	//lifetime of a draw command in ms
+	int time = 0;
+	OverlayPrimitive action;
+};
+
+//32 bit premultiplied argb target, x11 ARGB32 visual layout (bgra in memory)
+struct OverlaySurface {
+	uint32_t* pixels = nullptr;
+	int width = 0;
+	int height = 0;
+	//in pixels
+	int stride = 0;
+};
+
+/**
+ * Text rasterization is provided by the platform, the scene only needs the size of a text primitive up front
+ */
+class OverlayTextRenderer {
+public:
+	virtual ~OverlayTextRenderer() = default;
+	virtual JSRectangle Measure(const OverlayPrimitive& text) = 0;
+	virtual void Draw(OverlaySurface& surface, const OverlayPrimitive& text, const JSRectangle& clip) = 0;
+};
+
+class OverlayScene {
+	struct ActivePrimitive {
+		int64_t endtime;
+		bool visible;
+		bool deleted;
+		std::shared_ptr<OverlayPrimitive> action;
+	};
+	struct Group {
+		std::string name;
+		int frameid;
+		int zindex = 0;
+		bool frozen = false;
+		std::vector<ActivePrimitive> primitives;
+		int64_t nextupdate = INT64_MAX;
+	};
+	std::vector<std::unique_ptr<Group>> groups;
+	//current group of each app frame
+	std::vector<std::pair<int, Group*>> framegroups;
+	bool zsorted = true;
+	std::vector<JSRectangle> damage;
+	OverlayTextRenderer* textRenderer;
+
+	Group* FindGroup(int frameid, const std::string& name);
+	Group*& CurrentGroup(int frameid);
+	void DamageGroup(const Group& group);
+	void CleanGroup(Group& group, int64_t now);
+public:
+	OverlayScene(OverlayTextRenderer* textRenderer) :textRenderer(textRenderer) {}
+	void SetTextRenderer(OverlayTextRenderer* renderer) { textRenderer = renderer; }
+
+	void ApplyCommands(int frameid, std::vector<OverlayCommand>& commands, int64_t now);
+	void CloseFrame(int frameid);
+	// Expires primitives and returns the next time (in ms) at which the scene changes on its own
+	int64_t Update(int64_t now);
+	// True if there is nothing left to draw
+	bool IsEmpty() const;
+
+	// Marks the whole surface for redraw, used after resizing
+	void DamageAll(int width, int height);
+	// Takes the accumulated damage as a banded region
+	ShapeRegion TakeDamage();
+	// Clears 'clip' and redraws every visible primitive touching it
+	void Render(OverlaySurface& surface, const JSRectangle& clip);
+};
+
+//exposed for the platform text renderers
+uint32_t OverlayPremultiply(uint32_t argb, int coverage);
+void OverlayBlendPixel(uint32_t* dst, uint32_t premul);
+JSRectangle OverlayIntersect(const JSRectangle& a, const JSRectangle& b);
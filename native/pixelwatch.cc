@@ -0,0 +1,76 @@
+#include <algorithm>
+#include <cstdlib>
+#include "pixelwatch.h"
+#include "resultcache.h"
+
+//same weights as the ncc matcher
+static inline int Luma(const byte* px) {
+	return (px[0] * 77 + px[1] * 150 + px[2] * 29) >> 8;
+}
+
+static bool ColorMatches(const JSImageView& area, const PixelPredicate& pred) {
+	for (int y = 0; y < area.height; y++) {
+		const byte* px = area.Pixel(0, y);
+		for (int x = 0; x < area.width; x++, px += 4) {
+			if (std::abs(px[0] - pred.r) > pred.tolerance || std::abs(px[1] - pred.g) > pred.tolerance || std::abs(px[2] - pred.b) > pred.tolerance) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static bool BrightnessMatches(const JSImageView& area, const PixelPredicate& pred) {
+	uint64_t sum = 0;
+	for (int y = 0; y < area.height; y++) {
+		const byte* px = area.Pixel(0, y);
+		for (int x = 0; x < area.width; x++, px += 4) {
+			sum += Luma(px);
+		}
+	}
+	uint64_t limit = (uint64_t)pred.threshold * area.width * area.height;
+	return (pred.below ? sum < limit : sum > limit);
+}
+
+PixelWatchSet::PixelWatchSet(std::vector<PixelPredicate> preds) :predicates(std::move(preds)), state(predicates.size(), 0) {}
+
+JSRectangle PixelWatchSet::Bounds() const {
+	if (predicates.empty()) {
+		return JSRectangle(0, 0, 0, 0);
+	}
+	int x1 = INT32_MAX, y1 = INT32_MAX, x2 = INT32_MIN, y2 = INT32_MIN;
+	for (auto& pred : predicates) {
+		x1 = std::min(x1, pred.rect.x);
+		y1 = std::min(y1, pred.rect.y);
+		x2 = std::max(x2, pred.rect.x + pred.rect.width);
+		y2 = std::max(y2, pred.rect.y + pred.rect.height);
+	}
+	return JSRectangle(x1, y1, x2 - x1, y2 - y1);
+}
+
+std::vector<int> PixelWatchSet::Evaluate(const JSImageView& frame) {
+	std::vector<int> fired;
+	JSRectangle bounds = Bounds();
+	for (size_t i = 0; i < predicates.size(); i++) {
+		auto& pred = predicates[i];
+		auto area = frame.Sub(JSRectangle(pred.rect.x - bounds.x, pred.rect.y - bounds.y, pred.rect.width, pred.rect.height));
+		uint64_t value;
+		switch (pred.type) {
+			case PixelPredicateType::Color:
+				value = ColorMatches(area, pred);
+				if (value && !state[i]) { fired.push_back(i); }
+				break;
+			case PixelPredicateType::Brightness:
+				value = BrightnessMatches(area, pred);
+				if (value && !state[i]) { fired.push_back(i); }
+				break;
+			case PixelPredicateType::Hash:
+				value = HashImage(area, 0);
+				if (evaluated && value != state[i]) { fired.push_back(i); }
+				break;
+		}
+		state[i] = value;
+	}
+	evaluated = true;
+	return fired;
+}
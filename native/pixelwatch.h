@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "util.h"
+
+/**
+ * Pixel conditions that are checked natively every time new window content arrives, js is only woken up when
+ * one of them fires. Replaces polling captures for apps that wait for a cooldown or a bar to reach some point.
+ */
+
+enum class PixelPredicateType {
+	//every pixel of the area is within tolerance of the color
+	Color,
+	//mean luma of the area is above (or below) the threshold
+	Brightness,
+	//any pixel of the area changed
+	Hash
+};
+
+struct PixelPredicate {
+	PixelPredicateType type = PixelPredicateType::Color;
+	//window client area coordinates
+	JSRectangle rect = JSRectangle(0, 0, 1, 1);
+	byte r = 0, g = 0, b = 0;
+	//largest per channel difference that still matches
+	byte tolerance = 0;
+	//0-255
+	int threshold = 128;
+	bool below = false;
+};
+
+/**
+ * A group of predicates on one window. Color and brightness predicates fire when they become true, including on
+ * the first frame. Hash predicates fire on every change after the first frame
+ */
+class PixelWatchSet {
+	std::vector<PixelPredicate> predicates;
+	//last hash for hash predicates, whether it was true for the others
+	std::vector<uint64_t> state;
+	bool evaluated = false;
+public:
+	PixelWatchSet(std::vector<PixelPredicate> predicates);
+	// Area of the window that Evaluate needs, the bounding box of all predicates
+	JSRectangle Bounds() const;
+	// frame is the Bounds() area of the window, returns the indices of the predicates that fired
+	std::vector<int> Evaluate(const JSImageView& frame);
+};
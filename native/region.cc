@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <climits>
+#include "region.h"
+
+//merges two sorted lists of [x1,x2) span boundaries, op decides if a pixel is in the output given if it is in a and b
+template<typename OP>
+static void CombineSpans(const std::vector<int>& a, const std::vector<int>& b, OP op, std::vector<int>& out) {
+	size_t ia = 0, ib = 0;
+	bool ina = false, inb = false, inout = false;
+	while (ia < a.size() || ib < b.size()) {
+		int xa = (ia < a.size() ? a[ia] : INT_MAX);
+		int xb = (ib < b.size() ? b[ib] : INT_MAX);
+		int x = std::min(xa, xb);
+		//boundaries toggle the inside state, handle both lists at once if they share a boundary
+		if (xa == x) { ina = !ina; ia++; }
+		if (xb == x) { inb = !inb; ib++; }
+		bool now = op(ina, inb);
+		if (now != inout) {
+			out.push_back(x);
+			inout = now;
+		}
+	}
+}
+
+void ShapeRegion::AppendBand(int y1, int y2, std::vector<int>&& spans) {
+	if (spans.empty() || y2 <= y1) {
+		return;
+	}
+	//coalesce with the band above if it touches and has the same spans
+	if (!bands.empty() && bands.back().y2 == y1 && bands.back().spans == spans) {
+		bands.back().y2 = y2;
+		return;
+	}
+	bands.push_back(Band{ y1, y2, std::move(spans) });
+}
+
+template<typename OP>
+ShapeRegion ShapeRegion::Combine(const ShapeRegion& a, const ShapeRegion& b, OP op) {
+	static const std::vector<int> empty;
+	std::vector<int> ys;
+	ys.reserve((a.bands.size() + b.bands.size()) * 2);
+	for (auto& band : a.bands) { ys.push_back(band.y1); ys.push_back(band.y2); }
+	for (auto& band : b.bands) { ys.push_back(band.y1); ys.push_back(band.y2); }
+	std::sort(ys.begin(), ys.end());
+	ys.erase(std::unique(ys.begin(), ys.end()), ys.end());
+
+	ShapeRegion out;
+	size_t ia = 0, ib = 0;
+	for (size_t i = 0; i + 1 < ys.size(); i++) {
+		int y1 = ys[i];
+		int y2 = ys[i + 1];
+		while (ia < a.bands.size() && a.bands[ia].y2 <= y1) { ia++; }
+		while (ib < b.bands.size() && b.bands[ib].y2 <= y1) { ib++; }
+		auto& spansa = (ia < a.bands.size() && a.bands[ia].y1 <= y1 ? a.bands[ia].spans : empty);
+		auto& spansb = (ib < b.bands.size() && b.bands[ib].y1 <= y1 ? b.bands[ib].spans : empty);
+		std::vector<int> spans;
+		CombineSpans(spansa, spansb, op, spans);
+		out.AppendBand(y1, y2, std::move(spans));
+	}
+	return out;
+}
+
+ShapeRegion ShapeRegion::FromRects(const std::vector<JSRectangle>& rects) {
+	std::vector<JSRectangle> sorted;
+	sorted.reserve(rects.size());
+	std::vector<int> ys;
+	for (auto& rect : rects) {
+		if (rect.width <= 0 || rect.height <= 0) { continue; }
+		sorted.push_back(rect);
+		ys.push_back(rect.y);
+		ys.push_back(rect.y + rect.height);
+	}
+	std::sort(sorted.begin(), sorted.end(), [](const JSRectangle& a, const JSRectangle& b) {return a.y < b.y; });
+	std::sort(ys.begin(), ys.end());
+	ys.erase(std::unique(ys.begin(), ys.end()), ys.end());
+
+	ShapeRegion out;
+	std::vector<std::pair<int, int>> covering;
+	for (size_t i = 0; i + 1 < ys.size(); i++) {
+		int y1 = ys[i];
+		int y2 = ys[i + 1];
+		covering.clear();
+		for (auto& rect : sorted) {
+			if (rect.y >= y2) { break; }
+			if (rect.y + rect.height > y1) {
+				covering.push_back({ rect.x, rect.x + rect.width });
+			}
+		}
+		std::sort(covering.begin(), covering.end());
+		std::vector<int> spans;
+		for (auto& span : covering) {
+			//overlapping or touching spans get merged
+			if (!spans.empty() && span.first <= spans.back()) {
+				spans.back() = std::max(spans.back(), span.second);
+			} else {
+				spans.push_back(span.first);
+				spans.push_back(span.second);
+			}
+		}
+		out.AppendBand(y1, y2, std::move(spans));
+	}
+	return out;
+}
+
+ShapeRegion ShapeRegion::FromAlphaMask(const byte* rgba, int width, int height, int stride, byte threshold) {
+	ShapeRegion out;
+	std::vector<int> spans;
+	for (int y = 0; y < height; y++) {
+		const byte* row = rgba + (size_t)y * stride;
+		spans.clear();
+		int x = 0;
+		while (x < width) {
+			while (x < width && row[x * 4 + 3] < threshold) { x++; }
+			if (x == width) { break; }
+			int start = x;
+			while (x < width && row[x * 4 + 3] >= threshold) { x++; }
+			spans.push_back(start);
+			spans.push_back(x);
+		}
+		out.AppendBand(y, y + 1, std::vector<int>(spans));
+	}
+	return out;
+}
+
+ShapeRegion ShapeRegion::Union(const ShapeRegion& other) const {
+	return Combine(*this, other, [](bool a, bool b) {return a || b; });
+}
+
+ShapeRegion ShapeRegion::Subtract(const ShapeRegion& other) const {
+	return Combine(*this, other, [](bool a, bool b) {return a && !b; });
+}
+
+ShapeRegion ShapeRegion::Intersect(const ShapeRegion& other) const {
+	return Combine(*this, other, [](bool a, bool b) {return a && b; });
+}
+
+size_t ShapeRegion::RectCount() const {
+	size_t count = 0;
+	for (auto& band : bands) { count += band.spans.size() / 2; }
+	return count;
+}
+
+std::vector<JSRectangle> ShapeRegion::ToRects() const {
+	std::vector<JSRectangle> rects;
+	rects.reserve(RectCount());
+	for (auto& band : bands) {
+		for (size_t i = 0; i < band.spans.size(); i += 2) {
+			rects.push_back(JSRectangle(band.spans[i], band.y1, band.spans[i + 1] - band.spans[i], band.y2 - band.y1));
+		}
+	}
+	return rects;
+}
+
+bool ShapeRegion::operator==(const ShapeRegion& other) const {
+	if (bands.size() != other.bands.size()) { return false; }
+	for (size_t i = 0; i < bands.size(); i++) {
+		auto& a = bands[i];
+		auto& b = other.bands[i];
+		if (a.y1 != b.y1 || a.y2 != b.y2 || a.spans != b.spans) { return false; }
+	}
+	return true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+#include "util.h"
+
+/**
+ * Set of pixels stored as y-x banded rectangles, the same layout X11 uses for its regions.
+ * The region is split into horizontal bands, every band has the same set of horizontal spans over its full height,
+ * bands are sorted top to bottom and spans within a band left to right. Adjacent bands with identical spans are
+ * always merged so equal regions have the exact same representation and the rect list is minimal for this layout.
+ */
+class ShapeRegion {
+	struct Band {
+		int y1;
+		int y2;
+		//pairs of [x1,x2) boundaries
+		std::vector<int> spans;
+	};
+	std::vector<Band> bands;
+
+	void AppendBand(int y1, int y2, std::vector<int>&& spans);
+	template<typename OP>
+	static ShapeRegion Combine(const ShapeRegion& a, const ShapeRegion& b, OP op);
+public:
+	ShapeRegion() = default;
+	// Union of a set of possibly overlapping rectangles
+	static ShapeRegion FromRects(const std::vector<JSRectangle>& rects);
+	// All pixels of an rgba image with alpha >= threshold
+	static ShapeRegion FromAlphaMask(const byte* rgba, int width, int height, int stride, byte threshold);
+
+	ShapeRegion Union(const ShapeRegion& other) const;
+	ShapeRegion Subtract(const ShapeRegion& other) const;
+	ShapeRegion Intersect(const ShapeRegion& other) const;
+
+	bool IsEmpty() const { return bands.empty(); }
+	size_t RectCount() const;
+	// The banded rectangle list, valid to pass to x11 with YXBanded ordering
+	std::vector<JSRectangle> ToRects() const;
+
+	bool operator==(const ShapeRegion& other) const;
+	bool operator!=(const ShapeRegion& other) const { return !(*this == other); }
+};
@@ -0,0 +1,91 @@
+#include "resultcache.h"
+
+//xxhash64 primes and round, four independent lanes keep the multipliers busy
+constexpr uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t prime3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t prime4 = 0x85EBCA77C2B2AE63ULL;
+
+static inline uint64_t Rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+static inline uint64_t Round(uint64_t acc, uint64_t lane) { return Rotl(acc + lane * prime2, 31) * prime1; }
+static inline uint64_t Read64(const byte* p) { uint64_t v; memcpy(&v, p, 8); return v; }
+
+struct HashState {
+	uint64_t lanes[4];
+	HashState(uint64_t seed) :lanes{ seed + prime1 + prime2, seed + prime2, seed, seed - prime1 } {}
+	void Update(const byte* data, size_t length) {
+		size_t i = 0;
+		for (; i + 32 <= length; i += 32) {
+			lanes[0] = Round(lanes[0], Read64(data + i));
+			lanes[1] = Round(lanes[1], Read64(data + i + 8));
+			lanes[2] = Round(lanes[2], Read64(data + i + 16));
+			lanes[3] = Round(lanes[3], Read64(data + i + 24));
+		}
+		//tail bytes go through the first lane, rows of any width end up here
+		for (; i + 8 <= length; i += 8) { lanes[0] = Round(lanes[0], Read64(data + i)); }
+		for (; i < length; i++) { lanes[0] = Round(lanes[0], data[i]); }
+	}
+	uint64_t Finish(uint64_t length) {
+		uint64_t h = Rotl(lanes[0], 1) + Rotl(lanes[1], 7) + Rotl(lanes[2], 12) + Rotl(lanes[3], 18);
+		h += length;
+		h ^= h >> 33;
+		h *= prime2;
+		h ^= h >> 29;
+		h *= prime3;
+		h ^= h >> 32;
+		return h;
+	}
+};
+
+uint64_t HashBytes(const void* data, size_t length, uint64_t seed) {
+	HashState state(seed);
+	state.Update((const byte*)data, length);
+	return state.Finish(length);
+}
+
+uint64_t HashImage(const JSImageView& img, uint64_t seed) {
+	HashState state(seed ^ (((uint64_t)img.width << 32 | (uint32_t)img.height) * prime4));
+	size_t rowbytes = (size_t)img.width * 4;
+	for (int y = 0; y < img.height; y++) {
+		state.Update(img.Pixel(0, y), rowbytes);
+	}
+	return state.Finish(rowbytes * img.height);
+}
+
+const std::string* ResultCache::Get(uint64_t key) {
+	auto found = index.find(key);
+	if (found == index.end()) {
+		misses++;
+		return nullptr;
+	}
+	hits++;
+	entries.splice(entries.begin(), entries, found->second);
+	return &found->second->value;
+}
+
+void ResultCache::Set(uint64_t key, std::string&& value) {
+	auto found = index.find(key);
+	if (found != index.end()) {
+		used -= EntrySize(*found->second);
+		entries.erase(found->second);
+		index.erase(found);
+	}
+	entries.push_front(Entry{ key, std::move(value) });
+	index[key] = entries.begin();
+	used += EntrySize(entries.front());
+	Evict();
+}
+
+void ResultCache::SetBudget(size_t bytes) {
+	budget = bytes;
+	Evict();
+}
+
+void ResultCache::Evict() {
+	while (used > budget && !entries.empty()) {
+		auto& last = entries.back();
+		used -= EntrySize(last);
+		index.erase(last.key);
+		entries.pop_back();
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <list>
+#include <string>
+#include <cstdint>
+#include <unordered_map>
+#include "util.h"
+
+/**
+ * Reader results keyed by the pixels they were read from, identical captures skip the reader entirely.
+ * Values are opaque (serialized results), entries are evicted least recently used first once the memory budget is exceeded.
+ */
+
+// 64 bit hash of the pixels of an image, the size is part of the hash
+uint64_t HashImage(const JSImageView& img, uint64_t seed);
+uint64_t HashBytes(const void* data, size_t length, uint64_t seed);
+
+class ResultCache {
+	struct Entry {
+		uint64_t key;
+		std::string value;
+	};
+	std::list<Entry> entries;
+	std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+	size_t budget;
+	size_t used = 0;
+
+	//approximate memory use of an entry including container overhead
+	static size_t EntrySize(const Entry& entry) { return sizeof(Entry) + entry.value.capacity() + 64; }
+	void Evict();
+public:
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+
+	ResultCache(size_t budget) :budget(budget) {}
+	// nullptr on a miss, hits become the most recently used entry
+	const std::string* Get(uint64_t key);
+	void Set(uint64_t key, std::string&& value);
+	void SetBudget(size_t bytes);
+	size_t Size() const { return entries.size(); }
+	size_t Used() const { return used; }
+};
@@ -0,0 +1,98 @@
+#include <new>
+#ifdef OS_WIN
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#include "scratch.h"
+
+//enough for a few full client sized images, larger requests get a chunk of their own
+static constexpr size_t chunkSize = 32 * 1024 * 1024;
+static constexpr size_t hugePageSize = 2 * 1024 * 1024;
+//chunks past the first one go back to the os once this many outermost scopes have ended without using them
+static constexpr uint64_t idleScopes = 256;
+
+static byte* MapChunk(size_t size) {
+#ifdef OS_WIN
+	void* mem = VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	if (!mem) { throw std::bad_alloc(); }
+	return static_cast<byte*>(mem);
+#else
+	void* mem = MAP_FAILED;
+#ifdef MAP_HUGETLB
+	//only succeeds if the admin reserved huge pages, those are guaranteed once the map succeeds
+	mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+	if (mem == MAP_FAILED) {
+		mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (mem == MAP_FAILED) { throw std::bad_alloc(); }
+#ifdef MADV_HUGEPAGE
+		//transparent huge pages, ignored when thp is off
+		madvise(mem, size, MADV_HUGEPAGE);
+#endif
+	}
+	return static_cast<byte*>(mem);
+#endif
+}
+
+static void UnmapChunk(byte* data, size_t size) {
+#ifdef OS_WIN
+	VirtualFree(data, 0, MEM_RELEASE);
+#else
+	munmap(data, size);
+#endif
+}
+
+ScratchArena::~ScratchArena() {
+	for (auto& chunk : chunks) {
+		UnmapChunk(chunk.data, chunk.size);
+	}
+}
+
+ScratchArena& ScratchArena::Current() {
+	thread_local ScratchArena arena;
+	return arena;
+}
+
+void* ScratchArena::Allocate(size_t bytes) {
+	bytes = (bytes + alignment - 1) / alignment * alignment;
+	//continue in a later chunk that still fits, chunks are never moved so older pointers stay valid
+	while (current < chunks.size() && offset + bytes > chunks[current].size) {
+		current++;
+		offset = 0;
+	}
+	if (current == chunks.size()) {
+		size_t size = std::max(chunkSize, (bytes + hugePageSize - 1) / hugePageSize * hugePageSize);
+		chunks.push_back({ MapChunk(size), size, scopes });
+		offset = 0;
+	}
+	Chunk& chunk = chunks[current];
+	chunk.lastUse = scopes;
+	void* ret = chunk.data + offset;
+	offset += bytes;
+	return ret;
+}
+
+void ScratchArena::Release(Mark mark) {
+	current = mark.chunk;
+	offset = mark.offset;
+}
+
+ScratchScope::ScratchScope() :arena(ScratchArena::Current()), mark(arena.GetMark()) {
+	arena.depth++;
+}
+
+ScratchScope::~ScratchScope() {
+	arena.Release(mark);
+	if (--arena.depth != 0) { return; }
+	//outermost scope, trim chunks that a single large operation left behind a while ago
+	arena.scopes++;
+	for (size_t i = arena.chunks.size(); i-- > 1;) {
+		if (arena.scopes - arena.chunks[i].lastUse > idleScopes) {
+			UnmapChunk(arena.chunks[i].data, arena.chunks[i].size);
+			arena.chunks.erase(arena.chunks.begin() + i);
+		}
+	}
+}
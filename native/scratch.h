@@ -0,0 +1,72 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+#include "util.h"
+
+/**
+ * Per thread bump allocator for the short lived buffers of the native image operations (masks, row buffers, capture
+ * staging). Memory comes in large chunks that stay mapped between calls, so an operation that runs every frame
+ * reuses pages that are already faulted in instead of getting fresh ones from the heap every time. Chunks are backed
+ * by huge pages when the os has them available. Only used through ScratchScope
+ */
+class ScratchArena {
+public:
+	// Alignment of every allocation, enough for any simd load
+	static constexpr size_t alignment = 64;
+
+	struct Mark {
+		size_t chunk;
+		size_t offset;
+	};
+
+	~ScratchArena();
+	//arena of the calling thread
+	static ScratchArena& Current();
+
+	void* Allocate(size_t bytes);
+	Mark GetMark() const { return { current, offset }; }
+	void Release(Mark mark);
+
+private:
+	struct Chunk {
+		byte* data;
+		size_t size;
+		//outermost scope count at the last allocation from this chunk
+		uint64_t lastUse;
+	};
+	std::vector<Chunk> chunks;
+	size_t current = 0;
+	size_t offset = 0;
+	int depth = 0;
+	uint64_t scopes = 0;
+	friend class ScratchScope;
+};
+
+/**
+ * Everything allocated through the scope is released when it ends, the arena is reset when the outermost scope of
+ * the thread ends. Pointers must not outlive the scope and values are never destructed
+ */
+class ScratchScope {
+	ScratchArena& arena;
+	ScratchArena::Mark mark;
+public:
+	ScratchScope();
+	~ScratchScope();
+	ScratchScope(const ScratchScope&) = delete;
+	ScratchScope& operator=(const ScratchScope&) = delete;
+
+	//uninitialized room for count values
+	template<typename T>
+	T* Alloc(size_t count) {
+		static_assert(std::is_trivially_destructible<T>::value, "scratch memory is never destructed");
+		return static_cast<T*>(arena.Allocate(count * sizeof(T)));
+	}
+	template<typename T>
+	T* Alloc(size_t count, const T& value) {
+		T* ret = Alloc<T>(count);
+		std::fill(ret, ret + count, value);
+		return ret;
+	}
+};
@@ -0,0 +1,80 @@
+#include <algorithm>
+#include <vector>
+#include "textmetrics.h"
+#include "scratch.h"
+
+TextLineMetrics MeasureTextLine(const JSImageView& img, int x, int y, const ComponentColorClass& color, const TextMetricsOptions& opts) {
+	TextLineMetrics ret;
+	int x1 = std::max(x - opts.searchwidth / 2, 0);
+	int x2 = std::min(x + opts.searchwidth / 2, img.width);
+	int y1 = std::max(y - opts.searchheight / 2, 0);
+	int y2 = std::min(y + opts.searchheight / 2, img.height);
+	if (x1 >= x2 || y < y1 || y >= y2) { return ret; }
+	int w = x2 - x1;
+	int h = y2 - y1;
+
+	std::vector<ComponentColorClass> classes = { color };
+	ScratchScope scratch;
+	int* rowclasses = scratch.Alloc<int>(w);
+	byte* mask = scratch.Alloc<byte>((size_t)w * h);
+	int* rowcounts = scratch.Alloc<int>(h, 0);
+	for (int row = 0; row < h; row++) {
+		ClassifyColorRow(img.Pixel(x1, y1 + row), w, classes, rowclasses);
+		for (int col = 0; col < w; col++) {
+			bool ink = rowclasses[col] == 0;
+			mask[(size_t)row * w + col] = ink;
+			rowcounts[row] += ink;
+		}
+	}
+
+	//nearest row with ink, the point can be in a gap between letters or just under a letter
+	int start = -1;
+	for (int d = 0; d <= opts.slack && start == -1; d++) {
+		if (y - y1 - d >= 0 && rowcounts[y - y1 - d] != 0) { start = y - y1 - d; }
+		else if (y - y1 + d < h && rowcounts[y - y1 + d] != 0) { start = y - y1 + d; }
+	}
+	if (start == -1) { return ret; }
+	//a text line has ink on every row between its top and bottom, an empty row is the gap to the next line
+	int top = start, bottom = start;
+	while (top > 0 && rowcounts[top - 1] != 0) { top--; }
+	while (bottom < h - 1 && rowcounts[bottom + 1] != 0) { bottom++; }
+
+	//descender rows only have a few pixels, the baseline is the lowest row that still has a good part of the ink
+	int maxcount = 0;
+	int total = 0;
+	for (int row = top; row <= bottom; row++) {
+		maxcount = std::max(maxcount, rowcounts[row]);
+		total += rowcounts[row];
+	}
+	int baseline = bottom;
+	while (baseline > top && rowcounts[baseline] * 10 < maxcount * 3) { baseline--; }
+
+	std::vector<int> runs;
+	for (int row = top; row <= baseline; row++) {
+		const byte* maskrow = mask + (size_t)row * w;
+		for (int col = 0; col < w;) {
+			if (!maskrow[col]) { col++; continue; }
+			int runstart = col;
+			while (col < w && maskrow[col]) { col++; }
+			runs.push_back(col - runstart);
+		}
+	}
+	std::nth_element(runs.begin(), runs.begin() + runs.size() / 2, runs.end());
+
+	ret.found = true;
+	ret.top = y1 + top;
+	ret.baseline = y1 + baseline;
+	ret.bottom = y1 + bottom;
+	ret.ascent = baseline - top + 1;
+	ret.stroke = runs[runs.size() / 2];
+	//lines that touch the search area edge can be a solid block or several lines merged together
+	double confidence = 1;
+	if (top == 0 || bottom == h - 1) { confidence *= 0.5; }
+	//strokes are thin compared to the letter height, wide runs are interface graphics or a filled area
+	if (ret.stroke * 3 > ret.ascent) { confidence *= 0.3; }
+	//a few stray pixels of the right color are not a line of text
+	if (total < ret.ascent * 4) { confidence *= (double)total / (ret.ascent * 4); }
+	if (ret.ascent < 4) { confidence *= 0.3; }
+	ret.confidence = confidence;
+	return ret;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "util.h"
+#include "components.h"
+
+/**
+ * Measures the text line under a point in a single color, used to pick the plausible font sizes before
+ * running any OCR instead of trying every font in turn
+ */
+
+struct TextMetricsOptions {
+	//area around the point that is measured
+	int searchwidth = 160;
+	int searchheight = 48;
+	//how many rows above or below the point the line may start if the point itself is between letters
+	int slack = 4;
+};
+
+struct TextLineMetrics {
+	bool found = false;
+	//rows of the ink of the line, the baseline is the last row of the letter bodies
+	int top = 0, baseline = 0, bottom = 0;
+	//rows from the top of the ink to the baseline inclusive
+	int ascent = 0;
+	//median horizontal run length of ink pixels above the baseline
+	double stroke = 0;
+	//0-1, low when the ink doesn't look like a single line of text
+	double confidence = 0;
+};
+
+TextLineMetrics MeasureTextLine(const JSImageView& img, int x, int y, const ComponentColorClass& color, const TextMetricsOptions& opts);
@@ -12,6 +12,9 @@
 #include <assert.h>
 #include <unordered_map>
 #include <list>
+#include <cstring>
+#include <atomic>
+#include <memory>
 
 using std::string;
 using std::vector;
@@ -19,15 +22,47 @@ using std::wstring;
 
 typedef unsigned char byte;
 
-//state storage per context
-struct PluginInstance {};
+class FrameDiffStream;
+class ImagePyramid;
+class IconIndex;
+class ResultCache;
+class IntegralImage;
+class ScaledNeedleSet;
+class ChatLineTracker;
+class CaptureScheduler;
+
+//state storage per node environment, the addon can be loaded by the main thread and any number of worker_threads
+//anything that is genuinely process wide (x connection, window thread, hooks) lives in the os layer and is
+//reference counted through OSAttachInstance/OSDetachInstance
+struct PluginInstance {
+	//set once the environment is being torn down, shared with native threads that might still be waiting on a js callback
+	std::shared_ptr<std::atomic<bool>> closing = std::make_shared<std::atomic<bool>>(false);
+	//previous frames of diffStream calls by stream id
+	std::map<std::string, std::shared_ptr<FrameDiffStream>> diffStreams;
+	//cached image pyramids by id, searched coarse-to-fine by nccMatchPyramid
+	std::map<std::string, std::shared_ptr<ImagePyramid>> pyramids;
+	//icon libraries by id
+	std::map<std::string, std::shared_ptr<IconIndex>> iconIndexes;
+	//summed-area tables of captures by id, built once and matched against with any number of needles
+	std::map<std::string, std::shared_ptr<IntegralImage>> integrals;
+	//needles pre-rendered at several scales by id
+	std::map<std::string, std::shared_ptr<ScaledNeedleSet>> scaledNeedles;
+	//scale factor of the last multi-scale match by needle id and client, tried first on the next search
+	std::map<std::string, std::map<std::string, double>> bestScales;
+	//line hashes of the previous frame of incremental chatbox readers by id
+	std::map<std::string, std::shared_ptr<ChatLineTracker>> chatTrackers;
+	//reader results by content hash, created on first use
+	std::shared_ptr<ResultCache> readerCache;
+	//capture quotas of the apps served from this environment, created on first use
+	std::shared_ptr<CaptureScheduler> captureScheduler;
+};
 
 enum class CaptureMode {
 	//Capture the desktop pixels relative to target window
 	Desktop = 0,
 	//Capture the window front buffer directly, before os scaling is applied
 	Window = 1,
-	//Capture the opengl front buffer directly from the rs client process, this mode is much more complicated and only works on windows right now
+	//Capture the opengl front buffer directly from the rs client process, this mode is much more complicated. On linux the client has to run with the alt1glhook.so swap hook preloaded, otherwise this falls back to window mode
 	OpenGL = 2
 };
 
@@ -54,6 +89,57 @@ struct JSRectangle {
 		int h = rect.Get("height").As<Napi::Number>().Int32Value();
 		return JSRectangle(x, y, w, h);
 	}
+	//rects can also be passed as a packed Int32Array of [x,y,width,height] quads, this skips all per-rect property lookups
+	static vector<JSRectangle> FromPackedArray(const Napi::Value& val) {
+		if (!val.IsTypedArray() || val.As<Napi::TypedArray>().TypedArrayType() != napi_int32_array) {
+			throw Napi::TypeError::New(val.Env(), "Int32Array expected");
+		}
+		auto arr = val.As<Napi::Int32Array>();
+		if (arr.ElementLength() % 4 != 0) {
+			throw Napi::RangeError::New(val.Env(), "packed rectangle list length should be a multiple of 4");
+		}
+		vector<JSRectangle> rects(arr.ElementLength() / 4);
+		if (!rects.empty()) {
+			memcpy(rects.data(), arr.Data(), rects.size() * sizeof(JSRectangle));
+		}
+		return rects;
+	}
+	static Napi::Int32Array ToPackedArray(Napi::Env env, const vector<JSRectangle>& rects) {
+		auto arr = Napi::Int32Array::New(env, rects.size() * 4);
+		if (!rects.empty()) {
+			memcpy(arr.Data(), rects.data(), rects.size() * sizeof(JSRectangle));
+		}
+		return arr;
+	}
+};
+static_assert(sizeof(JSRectangle) == 4 * sizeof(int32_t), "JSRectangle is reinterpreted as a packed Int32Array");
+
+//non-owning view of rgba pixels, can be created from any ImageData-like {data,width,height} js object
+struct JSImageView {
+	byte* data = nullptr;
+	int width = 0;
+	int height = 0;
+	//bytes per row
+	int stride = 0;
+	JSImageView() = default;
+	JSImageView(byte* data, int w, int h, int stride) :data(data), width(w), height(h), stride(stride) {}
+	JSImageView(byte* data, int w, int h) :data(data), width(w), height(h), stride(w * 4) {}
+	byte* Pixel(int x, int y) const { return data + (size_t)y * stride + (size_t)x * 4; }
+	//view of a part of this image, the rect has to be inside the image
+	JSImageView Sub(const JSRectangle& rect) const { return JSImageView(Pixel(rect.x, rect.y), rect.width, rect.height, stride); }
+	//the sums are never formed, js can pass rects whose far edge overflows an int
+	bool Contains(const JSRectangle& rect) const { return rect.x >= 0 && rect.y >= 0 && rect.width >= 0 && rect.height >= 0 && rect.x <= width && rect.y <= height && rect.width <= width - rect.x && rect.height <= height - rect.y; }
+	static JSImageView FromJsValue(const Napi::Value& val) {
+		auto obj = val.As<Napi::Object>();
+		auto arr = obj.Get("data").As<Napi::TypedArray>();
+		int w = obj.Get("width").As<Napi::Number>().Int32Value();
+		int h = obj.Get("height").As<Napi::Number>().Int32Value();
+		if (w < 0 || h < 0 || arr.ByteLength() < (size_t)w * h * 4) {
+			throw Napi::RangeError::New(val.Env(), "image data is smaller than its dimensions");
+		}
+		byte* data = (byte*)arr.ArrayBuffer().Data() + arr.ByteOffset();
+		return JSImageView(data, w, h);
+	}
 };
 
 void fillImageOpaque(void* data, size_t len);
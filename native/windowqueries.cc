@@ -0,0 +1,118 @@
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include "windowqueries.h"
+
+struct PendingWindowQueries {
+	vector<WindowQuery> queries;
+	std::function<Napi::Value(Napi::Env, vector<WindowQuery>&)> convert;
+	Napi::Promise::Deferred deferred;
+	Napi::ThreadSafeFunction callback;
+	// Set when the batch this request was in failed, the promise is rejected with it
+	std::string error;
+	PendingWindowQueries(Napi::Env env) :deferred(Napi::Promise::Deferred::New(env)) {}
+};
+
+std::thread queryThread;
+std::mutex queryMutex; // Locks queryQueue, queryThreadStop and attachedEnvironments
+std::condition_variable queryWake;
+std::vector<PendingWindowQueries*> queryQueue;
+bool queryThreadStop = false;
+size_t attachedEnvironments = 0;
+
+void QueryThread() {
+	std::unique_lock<std::mutex> lock(queryMutex);
+	while (true) {
+		queryWake.wait(lock, [] {return queryThreadStop || !queryQueue.empty(); });
+		if (queryThreadStop) {
+			break;
+		}
+		std::vector<PendingWindowQueries*> pending;
+		pending.swap(queryQueue);
+		lock.unlock();
+
+		// One batch for everything that is queued, the os layer pipelines the requests of all of them
+		vector<WindowQuery> batch;
+		for (auto request : pending) {
+			batch.insert(batch.end(), request->queries.begin(), request->queries.end());
+		}
+		std::string error;
+		try {
+			OSRunWindowQueries(batch);
+		} catch (std::exception& e) {
+			error = std::string("window query failed: ") + e.what();
+		} catch (...) {
+			error = "window query failed";
+		}
+		size_t index = 0;
+		for (auto request : pending) {
+			for (auto& query : request->queries) {
+				query = std::move(batch[index++]);
+			}
+			// Default results of a failed batch would look like "no window", reject instead
+			request->error = error;
+			auto callback = request->callback;
+			auto status = callback.BlockingCall(request, [](Napi::Env env, Napi::Function, PendingWindowQueries* request) {
+				try {
+					if (!request->error.empty()) {
+						throw Napi::Error::New(env, request->error);
+					}
+					request->deferred.Resolve(request->convert(env, request->queries));
+				} catch (Napi::Error& e) {
+					request->deferred.Reject(e.Value());
+				}
+				delete request;
+			});
+			// The environment is being torn down, nobody is waiting for the promise anymore
+			if (status != napi_ok) {
+				delete request;
+			}
+			callback.Release();
+		}
+		lock.lock();
+	}
+	lock.unlock();
+	OSEndWindowQueries();
+}
+
+Napi::Promise QueueWindowQueries(Napi::Env env, vector<WindowQuery> queries, std::function<Napi::Value(Napi::Env, vector<WindowQuery>&)> convert) {
+	auto request = new PendingWindowQueries(env);
+	request->queries = std::move(queries);
+	request->convert = convert;
+	request->callback = Napi::ThreadSafeFunction::New(env, Napi::Function::New(env, [](const Napi::CallbackInfo&) {}), "windowquery", 0, 1);
+	auto promise = request->deferred.Promise();
+
+	std::lock_guard<std::mutex> lock(queryMutex);
+	if (!queryThread.joinable()) {
+		queryThreadStop = false;
+		queryThread = std::thread(QueryThread);
+	}
+	queryQueue.push_back(request);
+	queryWake.notify_one();
+	return promise;
+}
+
+void AttachWindowQueries() {
+	std::lock_guard<std::mutex> lock(queryMutex);
+	attachedEnvironments++;
+}
+
+void DetachWindowQueries() {
+	std::unique_lock<std::mutex> lock(queryMutex);
+	attachedEnvironments--;
+	if (attachedEnvironments != 0 || !queryThread.joinable()) {
+		return;
+	}
+	queryThreadStop = true;
+	queryWake.notify_one();
+	lock.unlock();
+	queryThread.join();
+	// Requests queued after the last batch are dropped, their environments are gone
+	lock.lock();
+	for (auto request : queryQueue) {
+		request->callback.Release();
+		delete request;
+	}
+	queryQueue.clear();
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "os.h"
+
+/**
+ * Promise based window queries. Queries run on a dedicated thread so the js thread never waits on the window
+ * system, everything that was queued while the previous batch ran is answered as one batch.
+ */
+
+// Queues the queries, the promise resolves on the js thread of env with the result of convert
+Napi::Promise QueueWindowQueries(Napi::Env env, vector<WindowQuery> queries, std::function<Napi::Value(Napi::Env, vector<WindowQuery>&)> convert);
+
+// Reference counted by node environment, the thread is stopped once the last environment is gone
+void AttachWindowQueries();
+void DetachWindowQueries();
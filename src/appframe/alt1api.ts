@@ -27,6 +27,14 @@ ipcRenderer.on("appevent", <T extends keyof alt1types.Alt1EventType>(e, type: T,
 	}
 });
 
+//the host raises the interval while this app is throttled to the background capture quota
+ipcRenderer.on("captureinterval", (e, interval: number) => {
+	if (interval > alt1api.captureInterval!) {
+		warn("capturethrottled", `Captures are throttled while this app is in the background, captureInterval is now ${interval}ms`);
+	}
+	alt1api.captureInterval = interval;
+});
+
 function captureSync(x: number, y: number, w: number, h: number) {
 	warn("captsync", "Synchonous capture is depricated");
 	let img: SyncResponse<FlatImageData> = ipcRenderer.sendSync("capturesync", x, y, w, h);
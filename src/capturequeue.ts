@@ -0,0 +1,88 @@
+import { native } from "./native";
+
+//capture interval apps are told to use while they are not throttled, alt1's default
+export const defaultCaptureInterval = 100;
+//captures one app can have waiting, further requests are refused
+const maxPendingPerApp = 4;
+
+type PendingCapture = {
+	requester: string,
+	bytes: number,
+	foreground: boolean,
+	run: () => void
+};
+
+//foreground captures first, in order of arrival otherwise
+let pending: PendingCapture[] = [];
+let pumpTimer: ReturnType<typeof setTimeout> | null = null;
+let pumpDue = 0;
+
+function schedulePump(delay: number) {
+	let due = Date.now() + delay;
+	if (pumpTimer) {
+		if (pumpDue <= due) { return; }
+		clearTimeout(pumpTimer);
+	}
+	pumpDue = due;
+	pumpTimer = setTimeout(pump, Math.ceil(delay));
+}
+
+function pump() {
+	pumpTimer = null;
+	let wait = Infinity;
+	//captures of one app stay in order, a waiting app doesn't hold up the others
+	let blocked = new Set<string>();
+	for (let i = 0; i < pending.length;) {
+		let capt = pending[i];
+		if (blocked.has(capt.requester)) { i++; continue; }
+		let delay = native.captureQuotaRequest(capt.requester, capt.bytes, capt.foreground);
+		if (delay == 0) {
+			pending.splice(i, 1);
+			capt.run();
+		} else {
+			blocked.add(capt.requester);
+			wait = Math.min(wait, delay);
+			i++;
+		}
+	}
+	if (pending.length != 0) { schedulePump(wait); }
+}
+
+//runs the capture once the quota of the requester allows it
+export function scheduleCapture<T>(requester: string, bytes: number, foreground: boolean, capture: () => T): Promise<T> {
+	//skip the queue if nothing would have to go before this capture
+	let queuedbefore = pending.some(p => p.requester == requester || (p.foreground && !foreground));
+	if (!queuedbefore && native.captureQuotaRequest(requester, bytes, foreground) == 0) {
+		return new Promise<T>(resolve => resolve(capture()));
+	}
+	if (pending.filter(p => p.requester == requester).length >= maxPendingPerApp) {
+		return Promise.reject(new Error("too many pending captures"));
+	}
+	return new Promise<T>((resolve, reject) => {
+		let run = () => {
+			try { resolve(capture()); }
+			catch (err) { reject(err); }
+		};
+		pending.push({ requester, bytes, foreground, run });
+		//stable sort, keeps the arrival order within a priority
+		pending.sort((a, b) => +b.foreground - +a.foreground);
+		schedulePump(0);
+	});
+}
+
+//synchronous captures can't wait, foreground apps always get them and background apps get an error while throttled
+export function admitCaptureNow(requester: string, bytes: number, foreground: boolean) {
+	let delay = native.captureQuotaRequest(requester, bytes, foreground, foreground);
+	if (delay != 0) {
+		throw new Error(`capture throttled, retry in ${Math.ceil(delay)}ms`);
+	}
+}
+
+//interval an app should capture at to stay within its quota
+export function suggestedCaptureInterval(foreground: boolean) {
+	if (foreground) { return defaultCaptureInterval; }
+	let quota = native.captureQuotaConfigure();
+	let rate = quota.capturesPerSecond * quota.backgroundShare;
+	return Math.max(defaultCaptureInterval, rate > 0 ? Math.ceil(1000 / rate) : 1000);
+}
+
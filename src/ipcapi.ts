@@ -1,6 +1,7 @@
 import * as a1lib from "@alt1/base/dist";
 import { IpcMain, IpcMainEvent, IpcMainInvokeEvent, screen } from "electron/main"
 import { identifyApp } from "./appconfig";
+import { admitCaptureNow, defaultCaptureInterval, scheduleCapture, suggestedCaptureInterval } from "./capturequeue";
 import { sameDomainResolve } from "./lib";
 import { fixTooltip, getManagedAppWindow, ManagedWindow } from "./main";
 import { native } from "./native";
@@ -176,6 +177,29 @@ function startDrag(wnd: ManagedWindow, left: boolean, top: boolean, right: boole
 	let interval = setInterval(tick, 20);
 }
 
+//apps the user is looking at or playing with get priority over the rest
+function isForegroundApp(wnd: ManagedWindow) {
+	return wnd.window.isFocused() || wnd.rsClient.isActive;
+}
+
+//capture interval last sent to each app frame, apps are told when they get throttled and when that ends
+const sentCaptureIntervals = new WeakMap<Electron.WebContents, number>();
+
+//checks the priority of the app and returns what it needs to request captures
+function captureRequester(e: IpcMainEvent | IpcMainInvokeEvent, wnd: ManagedWindow) {
+	let foreground = isForegroundApp(wnd);
+	let interval = suggestedCaptureInterval(foreground);
+	if ((sentCaptureIntervals.get(e.sender) ?? defaultCaptureInterval) != interval) {
+		sentCaptureIntervals.set(e.sender, interval);
+		e.sender.send("captureinterval", interval);
+	}
+	return { requester: wnd.appConfig.configUrl, foreground };
+}
+
+function captureBytes(rects: Rectangle[]) {
+	return rects.reduce((a, r) => a + Math.max(0, r.width) * Math.max(0, r.height) * 4, 0);
+}
+
 function syncwrap(fn: (e: Electron.IpcMainEvent, ...args: any[]) => any) {
 	return (e: Electron.IpcMainEvent, ...args: any[]) => {
 		try {
@@ -200,6 +224,8 @@ export function initIpcApi(ipcMain: IpcMain) {
 	ipcMain.on("capturesync", (e, x, y, width, height) => {
 		try {
 			let wnd = expectAppWindow(e);
+			let { requester, foreground } = captureRequester(e, wnd);
+			admitCaptureNow(requester, captureBytes([{ x, y, width, height }]), foreground);
 			let capt = native.captureWindowMulti(wnd.rsClient.window.handle, settings.captureMode, { main: { x, y, width, height } });
 			e.returnValue = { value: { width, height, data: capt.main } };
 		} catch (err) {
@@ -214,7 +240,7 @@ export function initIpcApi(ipcMain: IpcMain) {
 			clientRect: wnd.rsClient.window.getClientBounds(),
 			lastActiveTime: wnd.rsClient.lastActiveTime,
 			ping: 10,//TODO
-			scaling: 1,//TODO
+			scaling: wnd.rsClient.screenScale(),
 			captureMode: settings.captureMode
 		};
 		e.returnValue = { value: state };
@@ -222,12 +248,18 @@ export function initIpcApi(ipcMain: IpcMain) {
 
 	ipcMain.handle("capture", (e, x, y, width, height) => {
 		let wnd = expectAppWindow(e);
-		return native.captureWindowMulti(wnd.rsClient.window.handle, settings.captureMode, { main: { x, y, width, height } }).main;
+		let { requester, foreground } = captureRequester(e, wnd);
+		return scheduleCapture(requester, captureBytes([{ x, y, width, height }]), foreground, () => {
+			return native.captureWindowMulti(wnd.rsClient.window.handle, settings.captureMode, { main: { x, y, width, height } }).main;
+		});
 	});
 
 	ipcMain.handle("capturemulti", (e, rects: { [key: string]: Rectangle }) => {
 		let wnd = expectAppWindow(e);
-		return native.captureWindowMulti(wnd.rsClient.window.handle, settings.captureMode, rects);
+		let { requester, foreground } = captureRequester(e, wnd);
+		return scheduleCapture(requester, captureBytes(Object.values(rects)), foreground, () => {
+			return native.captureWindowMulti(wnd.rsClient.window.handle, settings.captureMode, rects);
+		});
 	});
 
 	ipcMain.on("settooltip", syncwrap((e, text: string) => {
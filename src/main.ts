@@ -69,9 +69,9 @@ function alt1Pressed() {
 	}
 }
 
-export function openApp(app: Bookmark, inst?: RsInstance) {
+export async function openApp(app: Bookmark, inst?: RsInstance) {
 	if (!inst) {
-		detectInstances();
+		await detectInstances().catch(e => console.error("rs client detection failed", e));
 		inst = rsInstances[0];
 	}
 	if (!inst) { console.error("no rs instance found"); }
@@ -126,6 +126,7 @@ export class ManagedWindow {
 
 		this.window.loadFile(path.resolve(__dirname, "appframe/index.html"));
 		this.window.once("close", () => {
+			if (this.appFrameId != -1) { this.rsClient.overlayCloseFrame(this.appFrameId); }
 			managedWindows.splice(managedWindows.indexOf(this), 1);
 			this.windowPin.unpin();
 			fixTooltip();
@@ -161,7 +162,7 @@ export function updateTray() {
 				app.quit();
 			}
 		});
-		menu.push({ label: "Repin RS", click: e => { rsInstances.forEach(e => e.close()); detectInstances(); } });
+		menu.push({ label: "Repin RS", click: e => { rsInstances.forEach(e => e.close()); detectInstances().catch(e => console.error("rs client detection failed", e)); } });
 		menu.push({ label: "Reload native addon", click: e => { reloadAddon(); } });
 		menu.push({ label: "Hook dev tools", type: "checkbox", checked: alwaysOpenDevtools, click: e => alwaysOpenDevtools = !alwaysOpenDevtools });
 	}
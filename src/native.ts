@@ -1,23 +1,94 @@
 import * as path from "path";
 import * as fs from "fs";
 import { BrowserWindow } from "electron";
-import { Rectangle } from "./shared";
+import { FlatImageData, OverlayCommand, Rectangle } from "./shared";
 import { boundMethod } from "autobind-decorator";
 import { TypedEmitter } from "./typedemitter";
 import { PinRect } from "./settings";
 
 export type CaptureMode = "desktop" | "window" | "opengl";
 
+//rectangle lists can be passed as packed [x,y,width,height,...] Int32Arrays, which avoids all per-rect marshalling
+export type PackedRects = Int32Array;
+//all packed captures in one buffer, rect i lives at data[offsets[i]] up to data[offsets[i+1]]
+export type PackedCapture = { data: Uint8ClampedArray, offsets: Uint32Array };
+
 export var native: {
-	captureWindowMulti: <T extends { [key: string]: Rectangle | undefined | null }>(wnd: BigInt, mode: CaptureMode, rect: T) => { [key in keyof T]: Uint8ClampedArray },
+	captureWindowMulti: {
+		//scale box filters the output down to ceil(width/scale) by ceil(height/scale)
+		<T extends { [key: string]: Rectangle | undefined | null }>(wnd: BigInt, mode: CaptureMode, rect: T, scale?: CaptureScale): { [key in keyof T]: Uint8ClampedArray },
+		(wnd: BigInt, mode: CaptureMode, rects: PackedRects, scale?: CaptureScale): PackedCapture
+	},
 	getRsHandles: () => BigInt[],
 	getActiveWindow: () => BigInt,
-	getWindowBounds: (wnd: BigInt) => Rectangle,
-	getClientBounds: (wnd: BigInt) => Rectangle,
+	getWindowBounds: {
+		(wnd: BigInt): Rectangle,
+		(wnds: BigInt[]): PackedRects
+	},
+	getClientBounds: {
+		(wnd: BigInt): Rectangle,
+		(wnds: BigInt[]): PackedRects
+	},
 	getWindowTitle: (wnd: BigInt) => string,
+	getRsHandlesAsync: () => Promise<BigInt[]>,
+	getActiveWindowAsync: () => Promise<BigInt>,
+	getWindowBoundsAsync: {
+		(wnd: BigInt): Promise<Rectangle>,
+		(wnds: BigInt[]): Promise<PackedRects>
+	},
+	getClientBoundsAsync: {
+		(wnd: BigInt): Promise<Rectangle>,
+		(wnds: BigInt[]): Promise<PackedRects>
+	},
+	getWindowTitleAsync: (wnd: BigInt) => Promise<string>,
 	setWindowParent: (wnd: BigInt, parent: BigInt) => void,
 	getMouseState: () => boolean,
-	setWindowShape: (wnd: BigInt, rects: Rectangle[]) => void,
+	setWindowShape: (wnd: BigInt, rects: Rectangle[] | PackedRects) => void,
+	setWindowShapeMask: (wnd: BigInt, mask: FlatImageData, alphaThreshold?: number) => void,
+	overlayCommands: (wnd: BigInt, frameid: number, commands: OverlayCommand[]) => void,
+	overlayCloseFrame: (wnd: BigInt, frameid: number) => void,
+	getProcessStats: (wnd: BigInt) => ProcessStats | null,
+	getMonitors: () => Monitor[],
+	getCursorImage: (knownserial?: number) => CursorImage | null,
+	pixelWatchAdd: (wnd: BigInt, predicates: PixelPredicate[], cb: (fired: number[]) => void, opts?: { interval?: number }) => number,
+	pixelWatchRemove: (watchid: number) => void,
+	diffFrames: (a: FlatImageData, b: FlatImageData, opts?: FrameDiffOptions) => PackedRects,
+	diffStream: (streamid: string, frame: FlatImageData, opts?: FrameDiffOptions) => PackedRects,
+	diffStreamClose: (streamid: string) => void,
+	//returns the level count, the levels stay native until asked for
+	pyramidBuild: (id: string, img: FlatImageData, levels?: number) => number,
+	pyramidLevel: (id: string, level: number) => FlatImageData | null,
+	pyramidClose: (id: string) => void,
+	findComponents: (img: FlatImageData, opts?: ComponentOptions) => ImageComponent[],
+	iconIndexAdd: (indexid: string, key: string, icon: FlatImageData) => number,
+	iconIndexQuery: {
+		(indexid: string, img: FlatImageData, opts?: IconQueryOptions): IconMatch[],
+		//one result list per slot rect inside img
+		(indexid: string, img: FlatImageData, opts: IconQueryOptions | undefined, slots: PackedRects): IconMatch[][]
+	},
+	iconIndexClose: (indexid: string) => void,
+	//fonts follow the FontDefinition layout of @alt1/ocr with Float32Array glyph pixels
+	loadAssetPack: (file: string) => { images: Record<string, FlatImageData>, fonts: Record<string, object> },
+	integralBuild: (id: string, img: FlatImageData) => void,
+	integralClose: (id: string) => void,
+	//haystack is an image or the id of an integral image built with integralBuild
+	nccMatch: (haystack: string | FlatImageData, needle: FlatImageData, opts?: NccOptions) => NccMatch[],
+	//nccMatch on level 0 of a pyramid from pyramidBuild, searched coarse-to-fine
+	nccMatchPyramid: (pyramidid: string, needle: FlatImageData, opts?: NccOptions) => NccMatch[],
+	nccNeedleBuild: (id: string, needle: FlatImageData, scales: number[]) => void,
+	nccNeedleClose: (id: string) => void,
+	nccMatchScaled: (haystack: string | FlatImageData, needleid: string, opts?: ScaledNccOptions) => ScaledNccMatch[],
+	//scroll is the number of lines the chat moved up, -1 if the previous frame couldn't be matched
+	chatLinesPush: (id: string, chatbox: FlatImageData, opts: ChatLineOptions) => { scroll: number, lines: ChatLine[] },
+	chatLinesClose: (id: string) => void,
+	measureTextLine: (img: FlatImageData, x: number, y: number, color: [number, number, number], tolerance?: number) => TextLineMetrics | null,
+	readerCacheKey: (img: FlatImageData, readerid: string, params?: string) => BigInt,
+	readerCacheGet: (key: BigInt) => string | null,
+	readerCacheSet: (key: BigInt, value: string) => void,
+	readerCacheConfigure: (budgetbytes?: number) => { entries: number, bytes: number, hits: number, misses: number },
+	captureQuotaRequest: (requester: string, bytes: number, foreground: boolean, force?: boolean) => number,
+	captureQuotaConfigure: (quota?: Partial<CaptureQuota>) => CaptureQuota,
+	captureQuotaStats: (requester: string) => { captures: number, bytes: number, deferred: number },
 
 	newWindowListener: <T extends keyof windowEvents>(wnd: BigInt, type: T, cb: windowEvents[T]) => void,
 	removeWindowListener: <T extends keyof windowEvents>(wnd: BigInt, type: T, cb: windowEvents[T]) => void,
@@ -41,13 +112,189 @@ export function reloadAddon() {
 	native = __non_webpack_require__(addonpath);
 }
 
+export type CaptureScale = 1 | 2 | 4 | 8;
+
+export type FrameDiffOptions = {
+	//largest per channel difference that still counts as unchanged, default 0
+	tolerance?: number,
+	//size of the compared tiles in pixels, default 16
+	tile?: number
+};
+
+export type ComponentOptions = {
+	//pixels belong to the first color within tolerance, without colors every pixel with alpha >= 128 is class 0
+	colors?: { r: number, g: number, b: number, tolerance?: number }[],
+	//connect diagonal neighbours as well
+	diagonal?: boolean,
+	minArea?: number,
+	maxArea?: number,
+	minWidth?: number,
+	maxWidth?: number,
+	minHeight?: number,
+	maxHeight?: number,
+	//at least 1, default 10000
+	maxCount?: number
+};
+
+export type ImageComponent = Rectangle & {
+	area: number,
+	//centroid
+	cx: number,
+	cy: number,
+	//index into ComponentOptions.colors
+	colorclass: number
+};
+
+export type IconQueryOptions = {
+	//largest hamming distance of the 64 bit dct hash, 0 to 15, default 8
+	maxDistance?: number,
+	//weight of the mean color difference when ranking, default 0.25
+	colorWeight?: number,
+	count?: number,
+	//compare candidates pixel by pixel, transparent reference pixels are ignored
+	verify?: boolean,
+	verifyTolerance?: number
+};
+
+export type IconMatch = {
+	key: string,
+	id: number,
+	distance: number,
+	colordistance: number,
+	verified: boolean
+};
+
+export type NccOptions = {
+	//lowest score in [-1,1] that counts as a match, defaults to 0.9
+	threshold?: number,
+	//most matches to return, defaults to 16
+	count?: number,
+	//only try locations with their top left corner in this rect
+	area?: Rectangle
+};
+
+export type NccMatch = {
+	x: number,
+	y: number,
+	score: number
+};
+
+export type ScaledNccOptions = NccOptions & {
+	//the best scale is remembered per client (and needle set) and searched first on the next call
+	client?: string
+};
+
+export type ScaledNccMatch = Rectangle & {
+	score: number,
+	scale: number
+};
+
+export type ChatLineOptions = {
+	//line pitch of the chat font in pixels
+	lineheight: number,
+	//text colors as [r,g,b]
+	colors: [number, number, number][],
+	//largest per channel difference of a text pixel, defaults to 8
+	tolerance?: number
+};
+
+export type ChatLine = Rectangle & {
+	//band index from the top of the chatbox
+	index: number,
+	//first text pixel of the line
+	textx: number,
+	texty: number,
+	//index into ChatLineOptions.colors
+	color: number
+};
+
+export type TextLineMetrics = {
+	top: number,
+	//last row of the letter bodies, descenders are below it
+	baseline: number,
+	bottom: number,
+	//rows from the top of the ink to the baseline
+	ascent: number,
+	//median horizontal ink run length
+	stroke: number,
+	confidence: number
+};
+
+//areas are in window client coordinates and default to a single pixel
+type PredicateArea = { x: number, y: number, width?: number, height?: number };
+export type PixelPredicate = PredicateArea & (
+	//fires when every pixel is within tolerance of the color
+	{ type: "color", color: [number, number, number], tolerance?: number } |
+	//fires when the mean luma (0-255) goes above the threshold, or below it
+	{ type: "brightness", threshold: number, below?: boolean } |
+	//fires whenever the area changes
+	{ type: "hash" }
+);
+
+export type CaptureQuota = {
+	//per app limits for foreground apps
+	capturesPerSecond: number,
+	bytesPerSecond: number,
+	//limit over all apps together
+	totalBytesPerSecond: number,
+	//seconds worth of quota an app can save up
+	burst: number,
+	//fraction of the per app limits background apps get
+	backgroundShare: number,
+	//fraction of the total that only foreground apps can use
+	foregroundReserve: number
+};
+
+export type CursorImage = FlatImageData & {
+	//pixel of the image that is at the pointer position
+	hotx: number,
+	hoty: number,
+	//changes every time the cursor shape changes
+	serial: number
+};
+
+export type Monitor = Rectangle & {
+	//physical size, 0 when unknown
+	mmwidth: number,
+	mmheight: number,
+	primary: boolean,
+	name: string,
+	//screen pixels per device independent (electron) pixel
+	scale: number
+};
+
+export type ProcessStats = {
+	pid: number,
+	//cores used over the last second, null until there are two samples
+	cpu: number | null,
+	//bytes
+	rss: number,
+	threads: number
+};
+
 type windowEvents = {
 	close: () => any,
 	move: (bounds: Rectangle, phase: "start" | "moving" | "end") => any,
 	show: (wnd: BigInt, event: number) => any,
-	click: () => any
+	click: () => any,
+	focus: (activewnd: BigInt) => any,
+	title: (title: string) => any,
+	//cursor shape changed, only fires for the null window
+	cursor: (serial: number) => any
 };
 
+export function packRects(rects: Rectangle[]) {
+	let packed = new Int32Array(rects.length * 4);
+	for (let i = 0; i < rects.length; i++) {
+		packed[i * 4 + 0] = rects[i].x;
+		packed[i * 4 + 1] = rects[i].y;
+		packed[i * 4 + 2] = rects[i].width;
+		packed[i * 4 + 3] = rects[i].height;
+	}
+	return packed;
+}
+
+//answered from the native cache of _NET_ACTIVE_WINDOW while window events are tracked, no round trip
 export function getActiveWindow() {
 	return new OSWindow(native.getActiveWindow());
 }
@@ -66,6 +313,7 @@ export class OSWindow {
 	getTitle() { return native.getWindowTitle(this.handle); }
 	getBounds() { return native.getWindowBounds(this.handle); }
 	getClientBounds() { return native.getClientBounds(this.handle); }
+	getProcessStats() { return native.getProcessStats(this.handle); }
 	setParent(parent: OSWindow | null) { return native.setWindowParent(this.handle, parent ? parent.handle : BigInt(0)) }
 
 	on<T extends keyof windowEvents>(type: T, cb: windowEvents[T]) {
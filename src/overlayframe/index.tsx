@@ -40,7 +40,7 @@ ipcRenderer.on("overlay", (e, frameid: number, commands) => {
 
 ipcRenderer.on("closeframe", (e, frameid: number) => {
 	framestates.delete(frameid);
-	groupstates = groupstates.filter(q => q.frameid == frameid);
+	groupstates = groupstates.filter(q => q.frameid != frameid);
 	redraw(Date.now());
 });
 
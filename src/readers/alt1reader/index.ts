@@ -1,24 +1,64 @@
 import { ImgRefData, Rect } from "@alt1/base";
 import * as OCR from "@alt1/ocr";
 import RightClickReader from "../rightclick";
+import { readerAssets } from "../assets";
+import { native } from "../../native";
 
-const chatfonts: { name: TextResult["font"], font: OCR.FontDefinition }[] = [
-	{ name: "10pt", font: require("@alt1/ocr/fonts/chatbox/10pt.js") },
-	{ name: "12pt", font: require("@alt1/ocr/fonts/chatbox/12pt.js") },
-	{ name: "14pt", font: require("@alt1/ocr/fonts/chatbox/14pt.js") },
-	{ name: "16pt", font: require("@alt1/ocr/fonts/chatbox/16pt.js") },
-	{ name: "18pt", font: require("@alt1/ocr/fonts/chatbox/18pt.js") },
+//bundled fonts are only evaluated when the asset pack isn't available
+//the larger fonts are only tried when the text metrics prefilter points at them
+const bundledchatfonts: { name: TextResult["font"], fallback: boolean, load: () => OCR.FontDefinition }[] = [
+	{ name: "10pt", fallback: true, load: () => require("@alt1/ocr/fonts/chatbox/10pt.js") },
+	{ name: "12pt", fallback: true, load: () => require("@alt1/ocr/fonts/chatbox/12pt.js") },
+	{ name: "14pt", fallback: true, load: () => require("@alt1/ocr/fonts/chatbox/14pt.js") },
+	{ name: "16pt", fallback: true, load: () => require("@alt1/ocr/fonts/chatbox/16pt.js") },
+	{ name: "18pt", fallback: true, load: () => require("@alt1/ocr/fonts/chatbox/18pt.js") },
+	{ name: "20pt", fallback: false, load: () => require("@alt1/ocr/fonts/chatbox/20pt.js") },
+	{ name: "22pt", fallback: false, load: () => require("@alt1/ocr/fonts/chatbox/22pt.js") },
 ];
 
+type ChatFont = { name: TextResult["font"], fallback: boolean, font: OCR.FontDefinition, ascent: number };
+
+const chatfonts: ChatFont[] = bundledchatfonts.map(f => {
+	let font = readerAssets()?.fonts[`chatbox/${f.name}`] ?? f.load();
+	return { name: f.name, fallback: f.fallback, font, ascent: fontAscent(font) };
+});
+
+//ink rows from the top of the letters and digits to the baseline, measured the same way as native.measureTextLine
+function fontAscent(font: OCR.FontDefinition) {
+	let step = (font.shadow ? 4 : 3);
+	let top = font.basey;
+	for (let chr of font.chars) {
+		if (!/[A-Za-z0-9]/.test(chr.chr)) { continue; }
+		for (let i = 0; i < chr.pixels.length; i += step) {
+			top = Math.min(top, chr.pixels[i + 1]);
+		}
+	}
+	return font.basey - top + 1;
+}
+
+//the one or two fonts whose size fits the text line at x,y, null if the line couldn't be measured
+export function plausibleChatFonts(img: ImageData, x: number, y: number, col: OCR.ColortTriplet) {
+	let metrics = native.measureTextLine(img, x, y, col);
+	if (!metrics || metrics.confidence < 0.2) { return null; }
+	let ranked = chatfonts
+		.map(font => ({ font, diff: Math.abs(font.ascent - metrics!.ascent) }))
+		.filter(r => r.diff <= 2)
+		.sort((a, b) => a.diff - b.diff)
+		.slice(0, 2);
+	if (ranked.length == 0) { return null; }
+	return ranked.map(r => ({ ...r.font, confidence: metrics!.confidence * (1 - r.diff / 3) }));
+}
+
 type TextResult = {
 	type: "text",
-	font: "10pt" | "12pt" | "14pt" | "16pt" | "18pt",//larger than 18 has unreasonable perf cost
+	font: "10pt" | "12pt" | "14pt" | "16pt" | "18pt" | "20pt" | "22pt",
 	line: ReturnType<typeof OCR["findReadLine"]>
 }
 
 type RightClickResult = {
 	type: "rightclick",
-	line: ReturnType<typeof OCR["findReadLine"]>,
+	//null when the menu is at an interface scale the font doesn't exist for
+	line: ReturnType<typeof OCR["findReadLine"]> | null,
 	menu: ReturnType<InstanceType<typeof RightClickReader>["read"]>
 }
 
@@ -54,14 +94,16 @@ export const defaultcolors: OCR.ColortTriplet[] = [
 
 export function readAnything(img: ImageData, x: number, y: number) {
 	let reader = new RightClickReader();
-	if (reader.find(new ImgRefData(img))) {
+	if (reader.find(new ImgRefData(img), { x, y })) {
 		let menu = reader.read(img);
 		return { type: "rightclick", line: menu.hoveredText, menu } as RightClickResult;
 	}
 
 	let col = OCR.getChatColor(img, new Rect(x - 10, y - 7, 20, 7), defaultcolors);
 	if (col) {
-		for (let font of chatfonts) {
+		//without a usable measurement fall back to trying the smaller fonts in turn
+		let fonts = plausibleChatFonts(img, x, y, col) ?? chatfonts.filter(f => f.fallback);
+		for (let font of fonts) {
 			let text11pt = OCR.findReadLine(img, font.font, [col], x, y);
 			let m = text11pt.text.match(/\w/g);
 			//match at least 3 word characters efore we accept it
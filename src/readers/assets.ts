@@ -0,0 +1,34 @@
+import * as path from "path";
+import * as OCR from "@alt1/ocr";
+import { ImageData } from "@alt1/base";
+import { native } from "../native";
+
+//the pack is built by src/tools/buildassetpack.ts next to the bundle, it holds the decoded
+//reader needles and compiled fonts so they don't have to be decoded on every start
+const assetpackfile = "readerassets.bin";
+
+type ReaderAssets = {
+	images: Record<string, ImageData>,
+	fonts: Record<string, OCR.FontDefinition>
+};
+
+let assets: ReaderAssets | null | undefined = undefined;
+
+//returns null when there is no (valid) pack, readers fall back to their bundled assets
+export function readerAssets() {
+	if (assets === undefined) {
+		try {
+			let pack = native.loadAssetPack(path.resolve(__dirname, assetpackfile));
+			let images: Record<string, ImageData> = {};
+			for (let name in pack.images) {
+				let img = pack.images[name];
+				images[name] = new ImageData(img.data, img.width, img.height);
+			}
+			assets = { images, fonts: pack.fonts as any };
+		} catch (e) {
+			console.log(`reader asset pack not loaded, using bundled reader assets: ${e}`);
+			assets = null;
+		}
+	}
+	return assets;
+}
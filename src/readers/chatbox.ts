@@ -0,0 +1,44 @@
+import * as OCR from "@alt1/ocr";
+import { native } from "../native";
+import { defaultcolors } from "./alt1reader";
+
+let nextTrackerId = 0;
+
+export type ChatReadLine = {
+	//band index from the top of the chatbox
+	index: number,
+	text: string,
+	fragments: ReturnType<typeof OCR["findReadLine"]>["fragments"]
+};
+
+//reads a chatbox area over consecutive polls, only lines that scrolled in or changed since the previous
+//poll are OCR'd. The native tracker matches line hashes between frames to find the scroll offset
+export class IncrementalChatReader {
+	id = `chat${nextTrackerId++}`;
+	font: OCR.FontDefinition;
+	lineheight: number;
+	colors: OCR.ColortTriplet[];
+
+	constructor(font: OCR.FontDefinition, lineheight: number, colors = defaultcolors) {
+		this.font = font;
+		this.lineheight = lineheight;
+		this.colors = colors;
+	}
+
+	read(chatbox: ImageData) {
+		let update = native.chatLinesPush(this.id, chatbox, { lineheight: this.lineheight, colors: this.colors });
+		let lines: ChatReadLine[] = [];
+		for (let line of update.lines) {
+			//chat lines mix colors (timestamp, name, message, links), read every fragment like the full chatbox reader
+			let res = OCR.findReadLine(chatbox, this.font, this.colors, line.textx, line.texty);
+			if (res.text) {
+				lines.push({ index: line.index, text: res.text, fragments: res.fragments });
+			}
+		}
+		return { scroll: update.scroll, lines };
+	}
+
+	close() {
+		native.chatLinesClose(this.id);
+	}
+}
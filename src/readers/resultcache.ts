@@ -0,0 +1,14 @@
+import { native } from "../native";
+
+//runs a reader through the native result cache, identical pixels with the same reader and parameters
+//return the previous result without reading again. Results have to survive a JSON round trip
+export function cachedRead<T>(img: ImageData, readerid: string, params: any[], read: () => T): T {
+	let key = native.readerCacheKey(img, readerid, JSON.stringify(params));
+	let cached = native.readerCacheGet(key);
+	if (cached != null) {
+		return JSON.parse(cached);
+	}
+	let res = read();
+	native.readerCacheSet(key, JSON.stringify(res ?? null));
+	return res;
+}
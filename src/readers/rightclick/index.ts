@@ -2,13 +2,45 @@ import { ImageData, ImgRef, Rect, RectLike } from "@alt1/base";
 import { ImageDetect } from "@alt1/base";
 import * as OCR from "@alt1/ocr";
 
-let rightclickfont = require("./imgs/rightclick.fontmeta.json");
+import { readerAssets } from "../assets";
+import { native } from "../../native";
 
-let imgs = ImageDetect.webpackImages({
+let packedassets = readerAssets();
+
+let rightclickfont: OCR.FontDefinition = packedassets?.fonts["rightclick"] ?? require("./imgs/rightclick.fontmeta.json");
+
+let imgs = (packedassets ? {
+	topleft: packedassets.images["rightclick/topleft"],
+	botleft: packedassets.images["rightclick/botleft"],
+	topright: packedassets.images["rightclick/topright"]
+} : ImageDetect.webpackImages({
 	topleft: require("./imgs/topleft.data.png"),
 	botleft: require("./imgs/botleft.data.png"),
 	topright: require("./imgs/topright.data.png")
-});
+}));
+
+//interface scales other than 100% the menu corners are searched at, 100% is covered by the exact search
+const interfaceScales = [1.25, 1.5, 1.75, 2, 2.5, 3];
+const maxScale = interfaceScales[interfaceScales.length - 1];
+//the menu opens with its title bar under the cursor, the scaled search only looks for the corner in this band
+const cursorBandAbove = 24;
+const cursorBandBelow = 4;
+//smallest menu at 100%, the title bar and one option
+const minMenuWidth = 50;
+const minMenuHeight = 34;
+//the side corners are small enough to match most edges, only accept near perfect ones
+const cornerThreshold = 0.95;
+let scaledNeedlesBuilt = false;
+function buildScaledNeedles() {
+	if (scaledNeedlesBuilt) { return; }
+	native.nccNeedleBuild("rightclick/topleft", imgs.topleft, interfaceScales);
+	//the other corners are only checked at the scale the top left one was found at
+	for (let scale of interfaceScales) {
+		native.nccNeedleBuild(`rightclick/topright/${scale}`, imgs.topright, [scale]);
+		native.nccNeedleBuild(`rightclick/botleft/${scale}`, imgs.botleft, [scale]);
+	}
+	scaledNeedlesBuilt = true;
+}
 
 export function mapRightclickColorSpace(src: ImageData, rect: RectLike) {
 	let dest = new ImageData(rect.width, rect.height);
@@ -33,9 +65,17 @@ export function mapRightclickColorSpace(src: ImageData, rect: RectLike) {
 
 export default class RightClickReader {
 	pos: RectLike | null = null;
-	find(img: ImgRef) {
+	//interface scale the menu was found at
+	scale = 1;
+	//the native matcher remembers the interface scale per client and tries it first
+	client: string | undefined;
+	constructor(client?: string) {
+		this.client = client;
+	}
+	//the scaled search only runs with a cursor position, relative to img
+	find(img: ImgRef, cursor?: { x: number, y: number }) {
 		let locs = img.findSubimage(imgs.topleft);
-		if (locs.length == 0) { return null; }
+		if (locs.length == 0) { return (cursor ? this.findScaled(img, cursor) : null); }
 		let topleft = locs[0];
 		let topright = img.findSubimage(imgs.topright, topleft.x, topleft.y, img.width - topleft.x, imgs.topright.height);
 		let botleft = img.findSubimage(imgs.botleft, topleft.x, topleft.y, imgs.botleft.width, img.height - topleft.y);
@@ -46,10 +86,45 @@ export default class RightClickReader {
 			width: topright[0].x - topleft.x + 3,
 			height: botleft[0].y - topleft.y + 9
 		};
+		this.scale = 1;
 		return this.pos;
 	}
+	//corners drawn at another interface scale, exact matching can't find resampled pixels
+	findScaled(img: ImgRef, cursor: { x: number, y: number }) {
+		let band = { x: 0, y: Math.max(0, cursor.y - cursorBandAbove * maxScale), width: Math.min(img.width, cursor.x + 1), height: (cursorBandAbove + cursorBandBelow) * maxScale };
+		if (band.width <= 0 || band.y >= img.height) { return null; }
+		buildScaledNeedles();
+		const integralid = "rightclick/find";
+		native.integralBuild(integralid, img.toData());
+		try {
+			let topleft = native.nccMatchScaled(integralid, "rightclick/topleft", { client: this.client, count: 1, area: band })[0];
+			if (!topleft) { return null; }
+			let scale = topleft.scale;
+			//nearest corners that leave room for at least the smallest menu, the same ones the exact search takes
+			let rightx = topleft.x + Math.round(minMenuWidth * scale);
+			let bottomy = topleft.y + Math.round(minMenuHeight * scale);
+			if (rightx >= img.width || bottomy >= img.height) { return null; }
+			let toprights = native.nccMatchScaled(integralid, `rightclick/topright/${scale}`, { threshold: cornerThreshold, count: 64, area: { x: rightx, y: topleft.y - 1, width: img.width - rightx, height: 3 } });
+			let botlefts = native.nccMatchScaled(integralid, `rightclick/botleft/${scale}`, { threshold: cornerThreshold, count: 64, area: { x: topleft.x - 1, y: bottomy, width: 3, height: img.height - bottomy } });
+			if (toprights.length == 0 || botlefts.length == 0) { return null; }
+			let topright = toprights.reduce((a, b) => b.x < a.x ? b : a);
+			let botleft = botlefts.reduce((a, b) => b.y < a.y ? b : a);
+			this.pos = {
+				x: topleft.x,
+				y: topleft.y - Math.round(scale),
+				width: topright.x - topleft.x + Math.round(3 * scale),
+				height: botleft.y - topleft.y + Math.round(9 * scale)
+			};
+			this.scale = scale;
+			return this.pos;
+		} finally {
+			native.integralClose(integralid);
+		}
+	}
 	read(buf: ImageData) {
 		if (!this.pos) { throw new Error("not found yet"); }
+		//the font only exists at 100% interface scale
+		if (this.scale != 1) { return { hoveredText: null, nlines: Math.round((this.pos.height - 21 * this.scale) / (16 * this.scale)) }; }
 		const lineheight = 16;
 		let nlines = Math.round((this.pos.height - 18 - 3) / lineheight);
 		let line0y = this.pos.y + 18;
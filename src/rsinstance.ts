@@ -11,23 +11,29 @@ import { openApp, managedWindows, selectAppContexts } from "./main";
 import { Alt1EventType, ImgRef, ImgRefData, PointLike, Rect, RectLike } from "@alt1/base";
 import { readAnything } from "./readers/alt1reader";
 import RightClickReader from "./readers/rightclick";
+import { cachedRead } from "./readers/resultcache";
 
 
 export var rsInstances: RsInstance[] = [];
 
 const newRsWindow = (handle) => new RsInstance(new OSWindow(handle));
+const activeWindowChanged = (handle: BigInt) => rsInstances.forEach(inst => inst.setActive(inst.window.handle == handle));
 
 export function initRsInstanceTracking() {
-	detectInstances();
+	detectInstances().catch(e => console.error("rs client detection failed", e));
 	OSNullWindow.on("show", newRsWindow);
+	OSNullWindow.on("focus", activeWindowChanged);
+	activeWindowChanged(native.getActiveWindow());
 };
 
 export function stopRsInstanceTracking() {
 	OSNullWindow.removeListener("show", newRsWindow);
+	OSNullWindow.removeListener("focus", activeWindowChanged);
 }
 
-export function detectInstances() {
-	let handles = native.getRsHandles();
+//window queries run on a native thread, the window tree search never blocks the main process
+export async function detectInstances() {
+	let handles = await native.getRsHandlesAsync();
 
 	// Make a list of currently-tracked instances that were not detected this time, for removal
 	// Note: this variable is not inlined because iterating a list while modifying it would not behave as expected
@@ -76,10 +82,12 @@ class ActiveRightclick {
 		let screenbotright = this.inst.clientToScreen({ x: this.clientRect.x + this.clientRect.width, y: this.clientRect.y + this.clientRect.height });
 		for (let wnd of managedWindows) {
 			if (wnd.rsClient != this.inst) { continue; }
+			//native bounds are in screen pixels, the rect is sent in css pixels
 			let wndbounds = wnd.nativeWindow.getClientBounds();
+			let scale = this.inst.screenScale();
 			let rect = {
-				x: screentopleft.x - wndbounds.x,
-				y: screentopleft.y - wndbounds.y,
+				x: screentopleft.x - wndbounds.x / scale,
+				y: screentopleft.y - wndbounds.y / scale,
 				width: screenbotright.x - screentopleft.x,
 				height: screenbotright.y - screentopleft.y
 			};
@@ -130,6 +138,7 @@ export class RsInstance extends TypedEmitter<RsInstanceEvents>{
 			}
 		}
 
+		this.isActive = native.getActiveWindow() == rswindow.handle;
 		rsInstances.push(this);
 		console.log(`new rs client tracked with handle: ${this.window.handle}`);
 	}
@@ -167,10 +176,17 @@ export class RsInstance extends TypedEmitter<RsInstanceEvents>{
 				return;
 			}
 			let capt = this.capture(captrect);
-			let reader = new RightClickReader();
+			let reader = new RightClickReader(String(this.window.handle));
 			let img = new ImgRefData(capt, 0, 0);
-			if (reader.find(img)) {
-				let pos = reader.pos!;
+			//the menu area is often captured unchanged several times in a row
+			let cursor = { x: mousepos.x - captrect.x, y: mousepos.y - captrect.y };
+			let found = cachedRead(capt, "rightclick.find", [cursor.x, cursor.y], () => reader.find(img, cursor) ? { pos: reader.pos, scale: reader.scale } : null);
+			if (found) {
+				reader.pos = found.pos;
+				reader.scale = found.scale;
+			}
+			if (reader.pos) {
+				let pos = reader.pos;
 				new ActiveRightclick(this, reader, new ImgRefData(capt, captrect.x, captrect.y));
 				this.emitAppEvent("", "menudetected", {
 					eventName: "menudetected",
@@ -196,20 +212,32 @@ export class RsInstance extends TypedEmitter<RsInstanceEvents>{
 		}
 	}
 
+	//screen pixels per electron screen (dip) pixel, the native monitor topology is cached so this is cheap
+	//TODO windows per-monitor scaling
+	screenScale() {
+		if (process.platform != "linux") { return 1; }
+		let bounds = this.window.getClientBounds();
+		let monitors = native.getMonitors();
+		let monitor = monitors.find(m => bounds.x >= m.x && bounds.y >= m.y && bounds.x < m.x + m.width && bounds.y < m.y + m.height);
+		return (monitor ?? monitors[0])?.scale ?? 1;
+	}
+
+	//electron screen coordinates to client pixels
 	screenToClient(p: PointLike) {
 		let rsrect = this.window.getClientBounds();
-		//TODO add scaling
-		return { x: p.x - rsrect.x, y: p.y - rsrect.y };
+		let scale = this.screenScale();
+		return { x: Math.round(p.x * scale) - rsrect.x, y: Math.round(p.y * scale) - rsrect.y };
 	}
 
+	//client pixels to electron screen coordinates
 	clientToScreen(p: PointLike) {
 		let rsrect = this.window.getClientBounds();
-		//TODO add scaling
-		return { x: p.x + rsrect.x, y: p.y + rsrect.y };
+		let scale = this.screenScale();
+		return { x: (p.x + rsrect.x) / scale, y: (p.y + rsrect.y) / scale };
 	}
 
+	//in client pixels, the same units as capture rects
 	getClientSize() {
-		//TODO this doesn't account for scaling
 		let rect = this.window.getClientBounds();
 		return { width: rect.width, height: rect.height };
 	}
@@ -226,21 +254,23 @@ export class RsInstance extends TypedEmitter<RsInstanceEvents>{
 		captrect.intersect({ x: 0, y: 0, ...this.getClientSize() });
 		if (!captrect.containsPoint(mousepos.x, mousepos.y)) { throw new Error("alt+1 pressed outside client"); }
 		let img = this.capture(captrect);
-		let res = readAnything(img, mousepos.x - captrect.x, mousepos.y - captrect.y);
+		let x = mousepos.x - captrect.x, y = mousepos.y - captrect.y;
+		let res = cachedRead(img, "readAnything", [x, y], () => readAnything(img, x, y));
 		if (res?.type == "text") {
 			let str = res.line.text;
 			console.log("text " + res.font + ": " + str);
 			//TODO grab these from c# alt1
 
 		} else if (res?.type == "rightclick") {
-			console.log("rightclick: " + res.line.text);
+			//menus at other interface scales are found but can't be read
+			console.log("rightclick: " + (res.line?.text ?? "(unreadable)"));
 		}
 		else {
 			console.log("no text found under cursor")
 		}
 		this.emitAppEvent("", "alt1pressed", {
 			eventName: "alt1pressed",
-			text: res?.line.text || "",
+			text: res?.line?.text || "",
 			rsLinked: true,//event is no emited in new api if this is not true
 			x: mousepos.x, y: mousepos.y,
 			mouseAbs: mousescreen,
@@ -248,7 +278,21 @@ export class RsInstance extends TypedEmitter<RsInstanceEvents>{
 		});
 	}
 
+	//drops everything an app frame drew, called when the app closes
+	overlayCloseFrame(frameid: number) {
+		if (process.platform == "linux") {
+			native.overlayCloseFrame(this.window.handle, frameid);
+			return;
+		}
+		this.overlayWindow?.browser.webContents.send("closeframe", frameid);
+	}
+
 	overlayCommands(frameid: number, commands: OverlayCommand[]) {
+		if (process.platform == "linux") {
+			//drawn by the native compositor on its own thread, no need for a browser window
+			native.overlayCommands(this.window.handle, frameid, commands);
+			return;
+		}
 		if (!this.overlayWindow) {
 			console.log("opening overlay");
 			let bounds = this.window.getClientBounds();
@@ -19,7 +19,7 @@ export default (async function () {
 		let img: ImageData = await require(`./alt1pressedimgs/${test.img}.data.png`);
 		img.show();
 		let res = readAnything(img, Math.round(img.width / 2), Math.round(img.height / 2));
-		let restext = res?.line.text;
+		let restext = res?.line?.text;
 		console.log(`== ${test.img} ==\nexpected: ${test.expected}\nread:     ${restext}`);
 	}
 })();
\ No newline at end of file
@@ -0,0 +1,41 @@
+import { native } from "../native";
+
+const size = 16;
+const intmax = 0x7fffffff;
+
+let tests = [
+	{ name: "negative x", rect: [-1, 0, 4, 4] },
+	{ name: "past the right edge", rect: [14, 0, 4, 4] },
+	{ name: "past the bottom edge", rect: [0, 14, 4, 4] },
+	{ name: "x outside the image", rect: [size + 1, 0, 0, 0] },
+	{ name: "width overflows", rect: [1, 0, intmax, 4] },
+	{ name: "height overflows", rect: [0, 1, 4, intmax] },
+	{ name: "both overflow", rect: [intmax, intmax, intmax, intmax] }
+];
+
+export default (async function () {
+	console.log("starting icon query slot tests");
+	let data = new Uint8ClampedArray(size * size * 4);
+	for (let i = 0; i < data.length; i += 4) {
+		//some contrast so the icon gets a real hash
+		data[i] = data[i + 1] = data[i + 2] = ((i / 4) % size < size / 2 ? 0 : 255);
+		data[i + 3] = 255;
+	}
+	let img = { data, width: size, height: size };
+	native.iconIndexAdd("test/slots", "icon", img);
+	try {
+		let inside = native.iconIndexQuery("test/slots", img, undefined, new Int32Array([0, 0, size, size]));
+		console.log(`== inside ==\nexpected: 1 result list\nread:     ${inside.length} result list`);
+		for (let test of tests) {
+			let error = "";
+			try {
+				native.iconIndexQuery("test/slots", img, undefined, new Int32Array(test.rect));
+			} catch (e) {
+				error = (e instanceof RangeError ? "RangeError" : "other error") + ": " + e.message;
+			}
+			console.log(`== ${test.name} ==\nexpected: RangeError: query rect is outside of the image\nread:     ${error || "no error"}`);
+		}
+	} finally {
+		native.iconIndexClose("test/slots");
+	}
+})();
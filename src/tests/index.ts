@@ -4,3 +4,4 @@
 
 import "./index.html";
 require("./alt1press");
+require("./iconquery");
@@ -0,0 +1,140 @@
+//Builds the binary reader asset pack that native.loadAssetPack maps at startup, see native/assetpack.h for the layout.
+//Decodes the reader needles and compiles the fonts once at build time so readers don't have to on every start.
+//usage: node -r ts-node/register ./src/tools/buildassetpack.ts <outfile>
+import * as fs from "fs";
+import * as path from "path";
+import * as OCR from "@alt1/ocr";
+import { ImageData } from "@alt1/base";
+//installed through @alt1/font-loader
+const sharp = require("sharp");
+
+const magic = 0x4b503141;//"A1PK"
+const version = 1;
+const headersize = 64;
+const entrysize = 64;
+const glyphsize = 32;
+const kindImage = 1;
+const kindFont = 2;
+
+const readerdir = path.resolve(__dirname, "../readers");
+
+type PackImage = { kind: "image", name: string, img: ImageData };
+type PackFont = { kind: "font", name: string, font: OCR.FontDefinition };
+type PackEntry = PackImage | PackFont;
+
+async function loadPng(file: string) {
+	let { data, info } = await sharp(file).ensureAlpha().raw().toBuffer({ resolveWithObject: true });
+	return new ImageData(new Uint8ClampedArray(data.buffer, data.byteOffset, data.byteLength), info.width, info.height);
+}
+
+async function collectEntries() {
+	let entries: PackEntry[] = [];
+	for (let size of ["10pt", "12pt", "14pt", "16pt", "18pt", "20pt", "22pt"]) {
+		entries.push({ kind: "font", name: `chatbox/${size}`, font: require(`@alt1/ocr/fonts/chatbox/${size}.js`) });
+	}
+	let imgdir = path.resolve(readerdir, "rightclick/imgs");
+	for (let name of ["topleft", "botleft", "topright"]) {
+		entries.push({ kind: "image", name: `rightclick/${name}`, img: await loadPng(path.resolve(imgdir, `${name}.data.png`)) });
+	}
+	//same as what @alt1/font-loader does with a .fontmeta.json in webpack
+	let fontmeta = JSON.parse(fs.readFileSync(path.resolve(imgdir, "rightclick.fontmeta.json"), "utf8"));
+	let fontimg = await loadPng(path.resolve(imgdir, "rightclick.data.png"));
+	entries.push({ kind: "font", name: "rightclick", font: OCR.loadFontImage(fontimg, fontmeta) });
+	return entries;
+}
+
+function align64(n: number) {
+	return Math.ceil(n / 64) * 64;
+}
+
+function writePack(entries: PackEntry[]) {
+	let names = entries.map(e => Buffer.from(e.name, "utf8"));
+	let offset = headersize + entries.length * entrysize;
+	let nameoffsets = names.map(n => { let o = offset; offset += n.length; return o; });
+
+	//blob sizes, fonts are the glyph table followed by the pixel lists
+	let dataoffsets: number[] = [];
+	let datasizes: number[] = [];
+	for (let entry of entries) {
+		offset = align64(offset);
+		dataoffsets.push(offset);
+		let size = 0;
+		if (entry.kind == "image") {
+			size = entry.img.width * entry.img.height * 4;
+		} else {
+			size = entry.font.chars.length * glyphsize;
+			for (let chr of entry.font.chars) { size += chr.pixels.length * 4; }
+		}
+		datasizes.push(size);
+		offset += size;
+	}
+	let filesize = align64(offset);
+
+	let buf = Buffer.alloc(filesize);
+	buf.writeUInt32LE(magic, 0);
+	buf.writeUInt32LE(version, 4);
+	buf.writeUInt32LE(entries.length, 8);
+	buf.writeUInt32LE(filesize, 12);
+	for (let i = 0; i < entries.length; i++) {
+		let entry = entries[i];
+		let e = headersize + i * entrysize;
+		buf.writeUInt32LE(entry.kind == "image" ? kindImage : kindFont, e + 0);
+		buf.writeUInt32LE(nameoffsets[i], e + 4);
+		buf.writeUInt32LE(names[i].length, e + 8);
+		buf.writeUInt32LE(dataoffsets[i], e + 12);
+		buf.writeUInt32LE(datasizes[i], e + 16);
+		names[i].copy(buf, nameoffsets[i]);
+
+		let data = dataoffsets[i];
+		if (entry.kind == "image") {
+			buf.writeUInt32LE(entry.img.width, e + 20);
+			buf.writeUInt32LE(entry.img.height, e + 24);
+			Buffer.from(entry.img.data.buffer, entry.img.data.byteOffset, entry.img.data.byteLength).copy(buf, data);
+		} else {
+			let font = entry.font;
+			buf.writeUInt32LE(font.chars.length, e + 20);
+			buf.writeUInt32LE(font.width, e + 24);
+			buf.writeUInt32LE(font.spacewidth, e + 28);
+			buf.writeUInt32LE(font.shadow ? 1 : 0, e + 32);
+			buf.writeUInt32LE(font.height, e + 36);
+			buf.writeUInt32LE(font.basey, e + 40);
+			buf.writeUInt32LE(typeof font.maxspaces == "number" ? font.maxspaces : 0xffffffff, e + 44);
+			buf.writeFloatLE(typeof font.minrating == "number" ? font.minrating : NaN, e + 48);
+
+			let pixeloffset = data + font.chars.length * glyphsize;
+			font.chars.forEach((chr, j) => {
+				if (chr.chr.length != 1) { throw new Error(`font ${entry.name} has a multi unit character ${chr.chr}`); }
+				let g = data + j * glyphsize;
+				buf.writeUInt32LE(chr.chr.charCodeAt(0), g + 0);
+				buf.writeUInt32LE(chr.width, g + 4);
+				buf.writeFloatLE(chr.bonus, g + 8);
+				buf.writeUInt32LE(chr.secondary ? 1 : 0, g + 12);
+				buf.writeUInt32LE(pixeloffset, g + 16);
+				buf.writeUInt32LE(chr.pixels.length, g + 20);
+				for (let px of chr.pixels) {
+					buf.writeFloatLE(px, pixeloffset);
+					pixeloffset += 4;
+				}
+			});
+		}
+	}
+	return buf;
+}
+
+async function run() {
+	let outfile = process.argv[2];
+	if (!outfile) {
+		console.log("usage: buildassetpack <outfile>");
+		process.exit(1);
+	}
+	let entries = await collectEntries();
+	let buf = writePack(entries);
+	fs.mkdirSync(path.dirname(path.resolve(outfile)), { recursive: true });
+	fs.writeFileSync(outfile, buf);
+	console.log(`wrote ${entries.length} reader assets (${buf.length} bytes) to ${outfile}`);
+}
+
+run().catch(e => {
+	console.error(e);
+	process.exit(1);
+});